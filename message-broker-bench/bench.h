@@ -0,0 +1,95 @@
+#pragma once
+
+#include <string>
+#include <string_view>
+#include <vector>
+#include <map>
+#include <chrono>
+#include <ostream>
+#include <filesystem>
+#include <algorithm>
+#include <cstdint>
+
+// Results of one run. Every result has a stable name, so a run can be saved as a baseline and a
+// later run compared against it.
+class Bench {
+public:
+    struct Result {
+        std::string name;
+        double value;
+        std::string unit;
+        bool higherIsBetter;
+    };
+
+    // out is where results are printed; the benchmarked code's own output is silenced separately
+    Bench(std::ostream& out, std::filesystem::path scratchRoot);
+
+    // empty directory for one benchmark's files
+    std::filesystem::path scratch_dir(std::string_view name);
+    void report(std::string name, double value, std::string_view unit, bool higherIsBetter = true);
+    void section(std::string_view title);
+
+    // tab separated name, value, unit per line
+    bool load_baseline(const std::filesystem::path& path);
+    bool save(const std::filesystem::path& path) const;
+    // a result counts as a regression when it is worse than the baseline by more than this fraction
+    void set_threshold(double fraction) { threshold = fraction; }
+    size_t regressions() const { return regressionCount; }
+
+private:
+    std::ostream& out;
+    std::filesystem::path scratchRoot;
+    std::vector<Result> results;
+    std::map<std::string, double, std::less<>> baseline;
+    double threshold = 0.1;
+    size_t regressionCount = 0;
+};
+
+inline double seconds_since(std::chrono::steady_clock::time_point start) {
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+// calls op in doubling rounds until minTime has passed; returns nanoseconds per call
+template <typename Op>
+double time_per_op(Op&& op, std::chrono::duration<double> minTime = std::chrono::milliseconds(200)) {
+    size_t calls = 0;
+    size_t round = 1;
+    auto start = std::chrono::steady_clock::now();
+    double elapsed = 0;
+    while (elapsed < minTime.count()) {
+        for (size_t i = 0; i < round; ++i)
+            op();
+        calls += round;
+        round *= 2;
+        elapsed = seconds_since(start);
+    }
+    return elapsed * 1e9 / static_cast<double>(calls);
+}
+
+// shortest of runs timings of fn, in seconds; the shortest is the one least disturbed by the rest
+// of the machine
+template <typename Fn>
+double best_of(size_t runs, Fn&& fn) {
+    double best = 1e300;
+    for (size_t i = 0; i < runs; ++i) {
+        auto start = std::chrono::steady_clock::now();
+        fn();
+        best = std::min(best, seconds_since(start));
+    }
+    return best;
+}
+
+// value at fraction (0.5, 0.99, ...) of sorted samples
+inline int64_t percentile(const std::vector<int64_t>& sorted, double fraction) {
+    if (sorted.empty())
+        return 0;
+    size_t index = static_cast<size_t>(fraction * static_cast<double>(sorted.size() - 1));
+    return sorted[index];
+}
+
+void disk_append_benchmarks(Bench& bench);
+void disk_rotate_benchmarks(Bench& bench);
+void disk_scan_benchmarks(Bench& bench);
+void topic_queue_benchmarks(Bench& bench);
+void topic_lookup_benchmarks(Bench& bench);
+void command_parse_benchmarks(Bench& bench);
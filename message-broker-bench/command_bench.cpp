@@ -0,0 +1,107 @@
+#include <string>
+#include <string_view>
+#include <vector>
+#include <memory>
+#include <format>
+
+#include "bench.h"
+#include "async_logger.h"
+#include "buffer_pool.h"
+#include "client_context.h"
+#include "command_handler.h"
+#include "topic_manager.h"
+
+namespace {
+    constexpr size_t messageSize = 100;
+    constexpr size_t batchRecords = 16;
+
+    PooledString encode(protocol::RequestType type, std::string_view topic, std::string_view payload) {
+        PooledString frame;
+        protocol::Request request;
+        request.type = type;
+        request.correlationId = 1;
+        request.topic = topic;
+        request.payload = payload;
+        protocol::encode_request(frame, request);
+        return frame;
+    }
+}
+
+// Cost of one binary request from its frame bytes to the response: parse_frame, then
+// handle_command's dispatch and work on a memory-only topic. Diagnostic logging is off, the
+// logger's cost is not what is measured here. A memory-only topic refuses produces once its queue
+// is full, so the produce-only cases empty the queue after every request, inside the timing.
+void command_parse_benchmarks(Bench& bench) {
+    AsyncLogger::get_instance().set_level(LogLevel::Off);
+
+    const std::string topic = "command-bench";
+    TopicManager::get_instance().create(topic, 1);
+
+    ClientContext context(BufferPool::get_instance(), nullptr);
+    context.mode = protocol::Mode::Binary;
+    context.command_handler = std::make_unique<CommandHandler>();
+    CommandHandler& handler = *context.command_handler;
+
+    std::string message(messageSize, 'x');
+    PooledString batch;
+    for (size_t i = 0; i < batchRecords; ++i)
+        protocol::append_record(batch, message);
+    PooledString keyed;
+    for (size_t i = 0; i < batchRecords; ++i) {
+        protocol::append_record(keyed, std::format("key-{}", i));
+        protocol::append_record(keyed, message);
+    }
+    protocol::FetchParams params;
+    params.maxRecords = batchRecords;
+    PooledString fetchParams;
+    protocol::encode_fetch_params(fetchParams, params);
+    PooledString partitions;
+    protocol::encode_u32(partitions, 1);
+
+    struct Case {
+        std::string name;
+        std::vector<PooledString> frames;
+        bool drain = false;
+    };
+    std::vector<Case> cases;
+    cases.push_back({ "subscribe", {} });
+    cases.back().frames.push_back(encode(protocol::RequestType::Subscribe, topic, {}));
+    cases.push_back({ "publish", {}, true });
+    cases.back().frames.push_back(encode(protocol::RequestType::Publish, topic, message));
+    cases.push_back({ "produce_batch", {}, true });
+    cases.back().frames.push_back(encode(protocol::RequestType::ProduceBatch, topic, batch));
+    cases.push_back({ "produce_keyed", {}, true });
+    cases.back().frames.push_back(encode(protocol::RequestType::ProduceKeyed, topic, keyed));
+    // the fetch drains what the produce before it queued, so every fetch finds a full batch
+    cases.push_back({ "produce_batch+fetch_batch", {} });
+    cases.back().frames.push_back(encode(protocol::RequestType::ProduceBatch, topic, batch));
+    cases.back().frames.push_back(encode(protocol::RequestType::FetchBatch, topic, fetchParams));
+    cases.push_back({ "create_topic_existing", {} });
+    cases.back().frames.push_back(encode(protocol::RequestType::CreateTopic, topic, partitions));
+    cases.push_back({ "invalid_fetch", {} });
+    cases.back().frames.push_back(encode(protocol::RequestType::FetchBatch, topic, "x"));
+
+    for (const Case& c : cases) {
+        double parse = time_per_op([&] {
+            for (const PooledString& frame : c.frames) {
+                protocol::Request request;
+                size_t consumed = 0;
+                protocol::parse_frame(frame, request, consumed);
+            }
+        });
+        double handle = time_per_op([&] {
+            for (const PooledString& frame : c.frames) {
+                protocol::Request request;
+                size_t consumed = 0;
+                if (protocol::parse_frame(frame, request, consumed) == protocol::ParseResult::Ok)
+                    protocol::Response response = handler.handle_command(request, &context);
+            }
+            if (c.drain)
+                TopicManager::get_instance().pull_batch(topic, Topic::anyPartition, SIZE_MAX, SIZE_MAX, 0, [](SharedMessage&&) {});
+        });
+        bench.report(std::format("command.{}.parse_frame", c.name), parse, "ns", false);
+        bench.report(std::format("command.{}.handle", c.name), handle, "ns", false);
+    }
+
+    AsyncLogger::get_instance().set_level(LogLevel::Info);
+}
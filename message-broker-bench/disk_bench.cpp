@@ -0,0 +1,177 @@
+#include <string>
+#include <vector>
+#include <thread>
+#include <atomic>
+#include <chrono>
+#include <format>
+#include <algorithm>
+#include <filesystem>
+
+#include "bench.h"
+#include "disk_handler.h"
+
+namespace {
+    constexpr size_t mib = 1024 * 1024;
+
+    // segment files the handler left in dir
+    size_t count_segments(const std::filesystem::path& dir) {
+        size_t count = 0;
+        for (const auto& entry : std::filesystem::directory_iterator(dir))
+            count += entry.path().extension() == ".log";
+        return count;
+    }
+
+    // [INFO] timestamp: ..., message: ... around every message
+    size_t line_size(size_t messageSize) {
+        return messageSize + 50;
+    }
+}
+
+// Lines per second through DiskHandler::log: formatting, the handler's mutex and the copy into the
+// mapped segment, including the rolls the run crosses.
+void disk_append_benchmarks(Bench& bench) {
+    constexpr size_t bytesPerRun = 32 * mib;
+    constexpr size_t segmentSize = 16 * mib;
+
+    for (size_t messageSize : { 16, 128, 1024 }) {
+        std::string message(messageSize, 'x');
+        for (size_t threads : { 1, 2, 4, 8 }) {
+            std::filesystem::path dir = bench.scratch_dir("append");
+            size_t perThread = bytesPerRun / line_size(messageSize) / threads;
+
+            double seconds;
+            {
+                DiskHandler handler((dir / "bench").string(), segmentSize);
+                std::atomic<bool> start{ false };
+                std::vector<std::jthread> workers;
+                for (size_t t = 0; t < threads; ++t) {
+                    workers.emplace_back([&] {
+                        while (!start.load(std::memory_order_acquire))
+                            std::this_thread::yield();
+                        for (size_t i = 0; i < perThread; ++i)
+                            handler.log("INFO", message);
+                    });
+                }
+
+                auto begin = std::chrono::steady_clock::now();
+                start.store(true, std::memory_order_release);
+                workers.clear();
+                seconds = seconds_since(begin);
+            }
+
+            double lines = static_cast<double>(perThread * threads);
+            bench.report(std::format("append.{}B.{}t", messageSize, threads), lines / seconds / 1e3, "Klines/s");
+        }
+    }
+}
+
+// Per-call latency of DiskHandler::log with small segments. The slowest calls are the ones that
+// sealed a segment and opened the next, so the mean of the slowest (rolls) calls is the roll stall.
+void disk_rotate_benchmarks(Bench& bench) {
+    constexpr size_t messageSize = 256;
+    std::string message(messageSize, 'x');
+
+    for (size_t segmentSize : { 1 * mib, 4 * mib }) {
+        std::filesystem::path dir = bench.scratch_dir("rotate");
+        size_t calls = 32 * segmentSize / line_size(messageSize);
+
+        std::vector<int64_t> latencies;
+        latencies.reserve(calls);
+        {
+            DiskHandler handler((dir / "bench").string(), segmentSize);
+            for (size_t i = 0; i < calls; ++i) {
+                auto begin = std::chrono::steady_clock::now();
+                handler.log("INFO", message);
+                latencies.push_back(std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - begin).count());
+            }
+        }
+
+        size_t rolls = std::max<size_t>(count_segments(dir), 1) - 1;
+        std::sort(latencies.begin(), latencies.end());
+        double stall = 0;
+        for (size_t i = latencies.size() - rolls; i < latencies.size(); ++i)
+            stall += static_cast<double>(latencies[i]);
+        if (rolls)
+            stall /= static_cast<double>(rolls);
+
+        std::string prefix = std::format("rotate.{}MiB", segmentSize / mib);
+        bench.report(prefix + ".p50", static_cast<double>(percentile(latencies, 0.5)) / 1e3, "us", false);
+        bench.report(prefix + ".p99", static_cast<double>(percentile(latencies, 0.99)) / 1e3, "us", false);
+        bench.report(prefix + ".p999", static_cast<double>(percentile(latencies, 0.999)) / 1e3, "us", false);
+        bench.report(prefix + ".max", static_cast<double>(latencies.back()) / 1e3, "us", false);
+        bench.report(prefix + ".roll_stall", stall / 1e3, "us", false);
+    }
+}
+
+// Scan rate of one written log through each read path, best of three warm passes.
+void disk_scan_benchmarks(Bench& bench) {
+    constexpr size_t lineCount = 200000;
+    constexpr size_t messageSize = 100;
+    constexpr size_t segmentSize = 4 * mib;
+    constexpr size_t runs = 3;
+
+    std::filesystem::path dir = bench.scratch_dir("scan");
+    DiskHandler handler((dir / "bench").string(), segmentSize);
+    std::string message(messageSize, 'x');
+    for (size_t i = 0; i < lineCount; ++i)
+        handler.log("INFO", message);
+
+    size_t bytes = 0;
+    size_t lines = 0;
+    auto report = [&](std::string_view name, double seconds) {
+        bench.report(std::format("scan.{}.lines", name), static_cast<double>(lines) / seconds / 1e6, "Mlines/s");
+        bench.report(std::format("scan.{}.bytes", name), static_cast<double>(bytes) / seconds / mib, "MiB/s");
+    };
+
+    double seconds = best_of(runs, [&] {
+        bytes = 0;
+        lines = 0;
+        LogCursor cursor{ 0, 0 };
+        while (auto line = handler.read_next(cursor)) {
+            bytes += line->size();
+            ++lines;
+        }
+    });
+    report("read_next", seconds);
+
+    seconds = best_of(runs, [&] {
+        bytes = 0;
+        lines = 0;
+        LogCursor cursor{ 0, 0 };
+        while (true) {
+            LogRange range = handler.read_range(cursor, 4096, mib);
+            if (range.lines.empty())
+                break;
+            for (std::string_view line : range.lines)
+                bytes += line.size();
+            lines += range.lines.size();
+        }
+    });
+    report("read_range", seconds);
+
+    seconds = best_of(runs, [&] {
+        bytes = 0;
+        lines = 0;
+        for (size_t segment = 0; lines < lineCount; ++segment) {
+            std::vector<std::string> segmentLines = handler.read_all(segment);
+            if (segmentLines.empty())
+                break;
+            for (const std::string& line : segmentLines)
+                bytes += line.size();
+            lines += segmentLines.size();
+        }
+    });
+    report("read_all", seconds);
+
+    seconds = best_of(runs, [&] {
+        std::atomic<size_t> visitedBytes{ 0 };
+        lines = handler.replay(0, [&](size_t, const std::vector<std::string_view>& segmentLines) {
+            size_t sum = 0;
+            for (std::string_view line : segmentLines)
+                sum += line.size();
+            visitedBytes.fetch_add(sum, std::memory_order_relaxed);
+        });
+        bytes = visitedBytes.load();
+    });
+    report("replay", seconds);
+}
@@ -0,0 +1,301 @@
+// Loopback throughput of every network engine in the build, each serving the same in-process broker
+// core. Every connection pipelines PRODUCE_BATCH and FETCH_BATCH requests on its own memory-only
+// topic over 127.0.0.1 and counts the records produced and fetched. The first engine (IOCP on
+// Windows, epoll on Linux) is the single-thread reference; the run fails when another engine
+// stays below --min-ratio of it or any request fails. With only the reference engine there is
+// nothing to compare: the run exits with skipCode (ctest reports it skipped), or fails with
+// --require-engines.
+//
+//   loopback_bench [--seconds=3] [--connections=4] [--window=16] [--port=23456] [--min-ratio=0.8] [--require-engines]
+
+#include <iostream>
+#include <string>
+#include <string_view>
+#include <vector>
+#include <deque>
+#include <thread>
+#include <future>
+#include <optional>
+#include <memory>
+#include <mutex>
+#include <atomic>
+#include <chrono>
+#include <format>
+#include <filesystem>
+#include <system_error>
+
+#include "platform.h"
+#include "protocol.h"
+#include "buffer_pool.h"
+#include "disk_handler.h"
+#include "net_engine.h"
+#include "command_handler.h"
+#include "shard_runtime.h"
+#include "async_logger.h"
+
+std::mutex cout_mutex;
+
+namespace {
+    constexpr size_t batchRecords = 16;
+    constexpr size_t messageSize = 100;
+
+    struct Options {
+        double seconds = 3;
+        size_t connections = 4;
+        size_t window = 16;
+        uint16_t port = 23456;
+        double minRatio = 0.8;
+        std::string dir = "loopback-data";
+        bool requireEngines = false;
+    };
+
+    // SKIP_RETURN_CODE of the ctest entry
+    constexpr int skipCode = 77;
+
+    struct ConnectionResult {
+        uint64_t produced = 0;
+        uint64_t fetched = 0;
+        uint64_t errors = 0;
+    };
+
+    bool send_all(socket_t sock, std::string_view data) {
+        size_t sent = 0;
+        while (sent < data.size()) {
+            int n = send(sock, data.data() + sent, static_cast<int>(data.size() - sent), 0);
+            if (n <= 0) return false;
+            sent += static_cast<size_t>(n);
+        }
+        return true;
+    }
+
+    bool recv_exact(socket_t sock, char* buf, size_t len) {
+        size_t received = 0;
+        while (received < len) {
+            int n = recv(sock, buf + received, static_cast<int>(len - received), 0);
+            if (n <= 0) return false;
+            received += static_cast<size_t>(n);
+        }
+        return true;
+    }
+
+    // one response frame, length prefix included
+    bool recv_frame(socket_t sock, std::string& frame) {
+        frame.resize(protocol::lengthSize);
+        if (!recv_exact(sock, frame.data(), protocol::lengthSize))
+            return false;
+        const auto* b = reinterpret_cast<const unsigned char*>(frame.data());
+        uint32_t length = (uint32_t(b[0]) << 24) | (uint32_t(b[1]) << 16) | (uint32_t(b[2]) << 8) | uint32_t(b[3]);
+        if (length > protocol::maxFrameSize)
+            return false;
+        frame.resize(protocol::lengthSize + length);
+        return recv_exact(sock, frame.data() + protocol::lengthSize, length);
+    }
+
+    socket_t connect_loopback(uint16_t port) {
+        sockaddr_in addr{};
+        addr.sin_family = AF_INET;
+        addr.sin_port = htons(port);
+        inet_pton(AF_INET, "127.0.0.1", &addr.sin_addr);
+
+        socket_t sock = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+        if (sock == invalid_socket)
+            return invalid_socket;
+        if (connect(sock, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) != 0) {
+            close_socket(sock);
+            return invalid_socket;
+        }
+        int noDelay = 1;
+        setsockopt(sock, IPPROTO_TCP, TCP_NODELAY, reinterpret_cast<const char*>(&noDelay), sizeof(noDelay));
+        return sock;
+    }
+
+    // Alternates a produce of batchRecords and a fetch of up to as many, so the topic's queue stays
+    // short, keeping up to window requests in flight until the deadline and then draining them.
+    void run_connection(uint16_t port, std::string topic, size_t window, std::chrono::steady_clock::time_point deadline, ConnectionResult& result) {
+        socket_t sock = connect_loopback(port);
+        if (sock == invalid_socket) {
+            ++result.errors;
+            return;
+        }
+
+        PooledString batch;
+        std::string message(messageSize, 'x');
+        for (size_t i = 0; i < batchRecords; ++i)
+            protocol::append_record(batch, message);
+        protocol::FetchParams params;
+        params.maxRecords = batchRecords;
+        PooledString fetchParams;
+        protocol::encode_fetch_params(fetchParams, params);
+
+        std::deque<protocol::RequestType> inflight;
+        uint32_t nextCorrelation = 1;
+        uint32_t expected = 1;
+        PooledString out;
+        std::string frame;
+        std::vector<std::string_view> records;
+
+        while (true) {
+            if (inflight.size() < window && std::chrono::steady_clock::now() < deadline) {
+                protocol::Request request;
+                request.type = nextCorrelation % 2 ? protocol::RequestType::ProduceBatch : protocol::RequestType::FetchBatch;
+                request.correlationId = nextCorrelation++;
+                request.topic = topic;
+                request.payload = request.type == protocol::RequestType::ProduceBatch ? std::string_view(batch) : std::string_view(fetchParams);
+                out.clear();
+                protocol::encode_request(out, request);
+                if (!send_all(sock, out)) {
+                    ++result.errors;
+                    break;
+                }
+                inflight.push_back(request.type);
+                continue;
+            }
+            if (inflight.empty())
+                break;
+
+            protocol::Request response;
+            size_t consumed = 0;
+            if (!recv_frame(sock, frame) || protocol::parse_frame(frame, response, consumed) != protocol::ParseResult::Ok ||
+                response.correlationId != expected++) {
+                ++result.errors;
+                break;
+            }
+            protocol::RequestType type = inflight.front();
+            inflight.pop_front();
+
+            protocol::Status status = protocol::frame_status(frame);
+            records.clear();
+            if (type == protocol::RequestType::ProduceBatch && status == protocol::Status::Ok)
+                result.produced += batchRecords;
+            else if (type == protocol::RequestType::FetchBatch && status == protocol::Status::Ok && protocol::parse_records(response.payload, records))
+                result.fetched += records.size();
+            else if (!(type == protocol::RequestType::FetchBatch && status == protocol::Status::NoMessages))
+                ++result.errors;
+        }
+        close_socket(sock);
+    }
+
+    struct EngineResult {
+        std::string name;
+        double recordsPerSecond = 0;
+        uint64_t errors = 0;
+    };
+
+    // nullopt when the build or the machine does not have the engine
+    std::optional<EngineResult> run_engine(std::string_view kind, const Options& options, uint16_t port, std::shared_ptr<DiskHandler> diskHandler) {
+        std::unique_ptr<NetEngine> engine = create_net_engine(kind, BufferPool::get_instance(), diskHandler);
+        // create_net_engine falls back to epoll when io_uring is unavailable at run time
+        if (!engine || engine->name() != kind)
+            return std::nullopt;
+
+        engine->set_shard(0, 1);
+        ShardRuntime::get_instance().assign({ engine.get() });
+
+        // the engine thread initializes its own engine, as broker.cpp does: an io_uring ring only
+        // accepts submissions from the thread that created it
+        std::promise<bool> initialized;
+        std::future<bool> ready = initialized.get_future();
+        std::thread loop([&] {
+            bool ok = engine->init(port);
+            initialized.set_value(ok);
+            if (ok)
+                engine->run();
+        });
+        if (!ready.get()) {
+            loop.join();
+            return EngineResult{ std::string(kind), 0, 1 };
+        }
+
+        std::vector<ConnectionResult> results(options.connections);
+        std::vector<std::thread> clients;
+        auto begin = std::chrono::steady_clock::now();
+        auto deadline = begin + std::chrono::duration_cast<std::chrono::steady_clock::duration>(std::chrono::duration<double>(options.seconds));
+        for (size_t i = 0; i < options.connections; ++i)
+            clients.emplace_back(run_connection, port, std::format("loopback-{}-{}", kind, i), options.window, deadline, std::ref(results[i]));
+        for (auto& client : clients)
+            client.join();
+        double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count();
+
+        engine->stop();
+        loop.join();
+
+        EngineResult result{ std::string(kind) };
+        uint64_t records = 0;
+        for (const ConnectionResult& r : results) {
+            records += r.produced + r.fetched;
+            result.errors += r.errors;
+        }
+        result.recordsPerSecond = static_cast<double>(records) / seconds;
+        return result;
+    }
+}
+
+int main(int argc, char* argv[]) {
+    Options options;
+    for (int i = 1; i < argc; ++i) {
+        std::string_view arg = argv[i];
+        if (arg.starts_with("--seconds=")) options.seconds = std::atof(argv[i] + 10);
+        else if (arg.starts_with("--connections=")) options.connections = std::strtoul(argv[i] + 14, nullptr, 10);
+        else if (arg.starts_with("--window=")) options.window = std::strtoul(argv[i] + 9, nullptr, 10);
+        else if (arg.starts_with("--port=")) options.port = static_cast<uint16_t>(std::strtoul(argv[i] + 7, nullptr, 10));
+        else if (arg.starts_with("--min-ratio=")) options.minRatio = std::atof(argv[i] + 12);
+        else if (arg.starts_with("--dir=")) options.dir = arg.substr(6);
+        else if (arg == "--require-engines") options.requireEngines = true;
+        else {
+            std::cerr << "usage: loopback_bench [--seconds=3] [--connections=4] [--window=16] [--port=23456] [--min-ratio=0.8] [--dir=loopback-data] [--require-engines]" << std::endl;
+            return 1;
+        }
+    }
+    if (options.seconds <= 0 || options.connections == 0 || options.window == 0) {
+        std::cerr << "[error] --seconds, --connections and --window must be positive" << std::endl;
+        return 1;
+    }
+
+#ifdef _WIN32
+    WSADATA wsaData;
+    WSAStartup(MAKEWORD(2, 2), &wsaData);
+    const std::vector<std::string_view> kinds = { "iocp" };
+#else
+    const std::vector<std::string_view> kinds = { "epoll", "uring" };
+#endif
+
+    // the engines are compared, not the diagnostic logger
+    AsyncLogger::get_instance().set_level(LogLevel::Off);
+    std::error_code ec;
+    std::filesystem::create_directories(options.dir, ec);
+    auto diskHandler = std::make_shared<DiskHandler>((std::filesystem::path(options.dir) / "broker_log").string(), 1024 * 1024);
+
+    std::vector<EngineResult> results;
+    for (size_t i = 0; i < kinds.size(); ++i) {
+        // a port per engine, so the next one never waits for the previous listener's TIME_WAIT
+        if (auto result = run_engine(kinds[i], options, static_cast<uint16_t>(options.port + i), diskHandler))
+            results.push_back(*result);
+        else
+            std::cout << std::format("{:<8} not available in this build\n", kinds[i]);
+    }
+
+    bool ok = !results.empty();
+    std::cout << std::format("{:<8} {:>16} {:>10} {:>8}\n", "engine", "records/s", "vs " + (results.empty() ? std::string() : results.front().name), "errors");
+    for (const EngineResult& result : results) {
+        double ratio = results.front().recordsPerSecond > 0 ? result.recordsPerSecond / results.front().recordsPerSecond : 0;
+        bool pass = result.errors == 0 && result.recordsPerSecond > 0 && ratio >= options.minRatio;
+        ok = ok && pass;
+        std::cout << std::format("{:<8} {:>16.0f} {:>10.2f} {:>8}{}\n", result.name, result.recordsPerSecond, ratio, result.errors, pass ? "" : "  FAIL");
+    }
+
+    // the reference engine alone still has to answer every request
+    bool compared = results.size() >= 2;
+    if (ok && !compared)
+        std::cout << (options.requireEngines ? "FAIL" : "skipped") << ": only one engine in this build, nothing to compare" << std::endl;
+
+    diskHandler.reset();
+    std::filesystem::remove_all(options.dir, ec);
+#ifdef _WIN32
+    WSACleanup();
+#endif
+    if (!ok)
+        return 1;
+    if (!compared)
+        return options.requireEngines ? 1 : skipCode;
+    return 0;
+}
@@ -0,0 +1,176 @@
+// Microbenchmarks of the broker's components in isolation, meant as the regression baseline for
+// performance changes: save a run on the old tree, compare a run on the new one.
+//
+//   cmake -S . -B build -DCMAKE_BUILD_TYPE=Release && cmake --build build
+//   ./build/message-broker-bench/micro_bench --save=baseline.tsv
+//   ./build/message-broker-bench/micro_bench --compare=baseline.tsv [--threshold=0.1] [append rotate scan queue lookup command]
+
+#include <iostream>
+#include <fstream>
+#include <string>
+#include <string_view>
+#include <vector>
+#include <format>
+#include <system_error>
+
+#include "bench.h"
+
+Bench::Bench(std::ostream& out, std::filesystem::path scratchRoot)
+    : out(out), scratchRoot(std::move(scratchRoot)) {}
+
+std::filesystem::path Bench::scratch_dir(std::string_view name) {
+    std::filesystem::path dir = scratchRoot / name;
+    std::error_code ec;
+    std::filesystem::remove_all(dir, ec);
+    std::filesystem::create_directories(dir, ec);
+    return dir;
+}
+
+void Bench::section(std::string_view title) {
+    out << std::format("\n{}\n", title) << std::flush;
+}
+
+void Bench::report(std::string name, double value, std::string_view unit, bool higherIsBetter) {
+    std::string line = std::format("  {:<44} {:>14.2f} {:<8}", name, value, unit);
+
+    auto it = baseline.find(name);
+    if (it != baseline.end() && it->second != 0) {
+        double change = (value - it->second) / it->second;
+        bool worse = higherIsBetter ? change < -threshold : change > threshold;
+        line += std::format(" {:>+8.1f}%", change * 100);
+        if (worse) {
+            line += "  REGRESSION";
+            ++regressionCount;
+        }
+    }
+    out << line << '\n' << std::flush;
+    results.push_back({ std::move(name), value, std::string(unit), higherIsBetter });
+}
+
+bool Bench::load_baseline(const std::filesystem::path& path) {
+    std::ifstream file(path);
+    if (!file)
+        return false;
+
+    std::string line;
+    while (std::getline(file, line)) {
+        size_t tab = line.find('\t');
+        if (tab == std::string::npos)
+            continue;
+        size_t end = line.find('\t', tab + 1);
+        std::string_view value = std::string_view(line).substr(tab + 1, end == std::string::npos ? std::string::npos : end - tab - 1);
+        try {
+            baseline[line.substr(0, tab)] = std::stod(std::string(value));
+        }
+        catch (const std::exception&) {
+        }
+    }
+    return true;
+}
+
+bool Bench::save(const std::filesystem::path& path) const {
+    std::ofstream file(path, std::ios::trunc);
+    for (const Result& result : results)
+        file << result.name << '\t' << std::format("{:.4f}", result.value) << '\t' << result.unit << '\n';
+    return static_cast<bool>(file);
+}
+
+namespace {
+    // swallows the benchmarked code's own console output (segment rolls, disk warnings)
+    class NullBuffer : public std::streambuf {
+    protected:
+        int overflow(int c) override { return c; }
+        std::streamsize xsputn(const char*, std::streamsize n) override { return n; }
+    };
+
+    struct Suite {
+        const char* name;
+        const char* title;
+        void (*run)(Bench&);
+    };
+
+    constexpr Suite suites[] = {
+        { "append", "DiskHandler::log append rate", disk_append_benchmarks },
+        { "rotate", "DiskHandler segment roll stalls", disk_rotate_benchmarks },
+        { "scan", "DiskHandler read_next / read_range / read_all / replay scan rate", disk_scan_benchmarks },
+        { "queue", "TopicQueue publish / pull under contention", topic_queue_benchmarks },
+        { "lookup", "TopicManager lookup by topic count", topic_lookup_benchmarks },
+        { "command", "CommandHandler::handle_command parse and dispatch cost", command_parse_benchmarks },
+    };
+
+    void usage() {
+        std::cerr << "usage: micro_bench [--save=<file>] [--compare=<file>] [--threshold=0.1] [--dir=bench-data] [--verbose] [suite...]\n"
+            << "suites:";
+        for (const Suite& suite : suites)
+            std::cerr << ' ' << suite.name;
+        std::cerr << std::endl;
+    }
+}
+
+int main(int argc, char* argv[]) {
+    std::string savePath;
+    std::string comparePath;
+    std::string scratch = "bench-data";
+    double threshold = 0.1;
+    bool verbose = false;
+    std::vector<std::string_view> selected;
+
+    for (int i = 1; i < argc; ++i) {
+        std::string_view arg = argv[i];
+        if (arg.starts_with("--save=")) savePath = arg.substr(7);
+        else if (arg.starts_with("--compare=")) comparePath = arg.substr(10);
+        else if (arg.starts_with("--dir=")) scratch = arg.substr(6);
+        else if (arg.starts_with("--threshold=")) threshold = std::atof(std::string(arg.substr(12)).c_str());
+        else if (arg == "--verbose") verbose = true;
+        else if (!arg.starts_with("--")) selected.push_back(arg);
+        else {
+            usage();
+            return 1;
+        }
+    }
+    for (std::string_view name : selected) {
+        if (std::none_of(std::begin(suites), std::end(suites), [&](const Suite& s) { return name == s.name; })) {
+            usage();
+            return 1;
+        }
+    }
+
+    std::ostream out(std::cout.rdbuf());
+    Bench bench(out, scratch);
+    bench.set_threshold(threshold);
+    if (!comparePath.empty() && !bench.load_baseline(comparePath)) {
+        std::cerr << "[error] cannot read baseline " << comparePath << std::endl;
+        return 1;
+    }
+
+    NullBuffer null;
+    std::streambuf* coutBuffer = std::cout.rdbuf();
+    std::streambuf* cerrBuffer = std::cerr.rdbuf();
+    if (!verbose) {
+        std::cout.rdbuf(&null);
+        std::cerr.rdbuf(&null);
+    }
+
+    for (const Suite& suite : suites) {
+        if (!selected.empty() && std::find(selected.begin(), selected.end(), suite.name) == selected.end())
+            continue;
+        bench.section(suite.title);
+        suite.run(bench);
+    }
+
+    std::cout.rdbuf(coutBuffer);
+    std::cerr.rdbuf(cerrBuffer);
+
+    std::error_code ec;
+    std::filesystem::remove_all(scratch, ec);
+
+    if (!savePath.empty() && !bench.save(savePath)) {
+        std::cerr << "[error] cannot write " << savePath << std::endl;
+        return 1;
+    }
+    if (bench.regressions()) {
+        std::cout << std::format("\n{} results regressed by more than {:.0f}%\n", bench.regressions(), threshold * 100);
+        return 2;
+    }
+    return 0;
+}
@@ -0,0 +1,90 @@
+#include <string>
+#include <vector>
+#include <thread>
+#include <atomic>
+#include <chrono>
+#include <format>
+#include <algorithm>
+
+#include "bench.h"
+#include "topic_queue.h"
+
+namespace {
+    constexpr size_t messagesPerProducer = 200000;
+    constexpr size_t messageSize = 64;
+
+    struct QueueRun {
+        double seconds;
+        size_t consumed;
+    };
+
+    // producers publish messagesPerProducer each while consumers pull batches of pullBatch until
+    // every message was either pulled or dropped by the full ring
+    QueueRun run_queue(size_t producers, size_t consumers, size_t pullBatch) {
+        TopicQueue queue;
+        size_t total = producers * messagesPerProducer;
+        std::string payload(messageSize, 'x');
+
+        std::atomic<size_t> consumed{ 0 };
+        std::atomic<size_t> producing{ producers };
+        std::atomic<bool> start{ false };
+        auto done = [&] {
+            return producing.load() == 0 && consumed.load() + queue.dropped() >= total;
+        };
+
+        std::vector<std::jthread> workers;
+        for (size_t p = 0; p < producers; ++p) {
+            workers.emplace_back([&] {
+                while (!start.load(std::memory_order_acquire))
+                    std::this_thread::yield();
+                for (size_t i = 0; i < messagesPerProducer; ++i)
+                    queue.publish(SharedMessage::create(payload));
+                producing.fetch_sub(1);
+            });
+        }
+        for (size_t c = 0; c < consumers; ++c) {
+            workers.emplace_back([&] {
+                while (!start.load(std::memory_order_acquire))
+                    std::this_thread::yield();
+                size_t sink = 0;
+                while (!done()) {
+                    size_t got = queue.pull_batch(pullBatch, SIZE_MAX, 0, [&](SharedMessage&& m) { sink += m.size(); });
+                    consumed.fetch_add(got, std::memory_order_relaxed);
+                    if (got == 0)
+                        std::this_thread::yield();
+                }
+            });
+        }
+
+        auto begin = std::chrono::steady_clock::now();
+        start.store(true, std::memory_order_release);
+        workers.clear();
+        return { seconds_since(begin), consumed.load() };
+    }
+}
+
+// Publish and pull throughput of one TopicQueue with equal numbers of producer and consumer
+// threads. Producers never wait: as for a partition with a commit log, the ring drops the oldest
+// messages when consumers fall behind, so what was delivered is reported apart from what was published.
+void topic_queue_benchmarks(Bench& bench) {
+    {
+        // one thread alternating publish and pull: the uncontended cost of a round trip
+        TopicQueue queue;
+        std::string payload(messageSize, 'x');
+        double ns = time_per_op([&] {
+            queue.publish(SharedMessage::create(payload));
+            auto msg = queue.pull();
+        });
+        bench.report("queue.publish_pull.uncontended", ns, "ns/msg", false);
+    }
+
+    for (size_t pullBatch : { 1, 16 }) {
+        for (size_t threads : { 1, 2, 4, 8, 16 }) {
+            QueueRun run = run_queue(threads, threads, pullBatch);
+            size_t total = threads * messagesPerProducer;
+            std::string prefix = std::format("queue.{}p{}c.batch{}", threads, threads, pullBatch);
+            bench.report(prefix + ".published", static_cast<double>(total) / run.seconds / 1e6, "Mmsg/s");
+            bench.report(prefix + ".delivered", static_cast<double>(run.consumed) / run.seconds / 1e6, "Mmsg/s");
+        }
+    }
+}
@@ -0,0 +1,51 @@
+#include <string>
+#include <vector>
+#include <random>
+#include <format>
+
+#include "bench.h"
+#include "topic_manager.h"
+
+// Lookup cost of TopicManager as the number of topics grows. Topics stay memory-only (no
+// init_storage); every partition still allocates its queue's ring, which bounds the counts here.
+void topic_lookup_benchmarks(Bench& bench) {
+    TopicManager& manager = TopicManager::get_instance();
+    std::mt19937 rng(42);
+    size_t created = 0;
+    std::vector<std::string> names;
+
+    for (size_t count : { 1, 16, 256, 1024, 4096 }) {
+        for (; created < count; ++created) {
+            names.push_back(std::format("lookup-{}", created));
+            manager.create(names.back(), 1);
+        }
+
+        // lookups walk names in a shuffled order so the registry's buckets are not visited in sequence
+        std::vector<std::string> order = names;
+        std::shuffle(order.begin(), order.end(), rng);
+        std::vector<std::string> missing;
+        for (size_t i = 0; i < order.size(); ++i)
+            missing.push_back(std::format("missing-{}", i));
+
+        size_t next = 0;
+        size_t found = 0;
+        double hit = time_per_op([&] {
+            found += manager.find(order[next]) != nullptr;
+            next = next + 1 == order.size() ? 0 : next + 1;
+        });
+        next = 0;
+        double miss = time_per_op([&] {
+            found += manager.find(missing[next]) != nullptr;
+            next = next + 1 == missing.size() ? 0 : next + 1;
+        });
+        next = 0;
+        double existing = time_per_op([&] {
+            found += manager.get_or_create(order[next]).partition_count();
+            next = next + 1 == order.size() ? 0 : next + 1;
+        });
+
+        bench.report(std::format("lookup.{}.find_hit", count), hit, "ns", false);
+        bench.report(std::format("lookup.{}.find_miss", count), miss, "ns", false);
+        bench.report(std::format("lookup.{}.get_or_create", count), existing, "ns", false);
+    }
+}
@@ -0,0 +1,143 @@
+// TopicQueue contention: the lock-free ring against the previous mutex + std::queue implementation.
+// Half the threads publish, half pull (one thread alternates), 1 to 64 threads. Throughput counts
+// only the messages pulled; the ring drops its oldest messages when full, and those are listed
+// apart rather than counted as delivered.
+//
+//   built by CMakeLists.txt next to it as topic_queue_bench
+
+#include <iostream>
+#include <string>
+#include <string_view>
+#include <vector>
+#include <queue>
+#include <mutex>
+#include <thread>
+#include <atomic>
+#include <chrono>
+#include <optional>
+#include <functional>
+#include <format>
+
+#include "topic_queue.h"
+
+// TopicQueue before the ring: one mutex around a std::queue, holding the same shared messages so
+// only the queue differs
+class MutexTopicQueue {
+public:
+    void publish(SharedMessage msg) {
+        std::lock_guard<std::mutex> lock(mtx);
+        queuedBytes += msg.size();
+        q.push(std::move(msg));
+    }
+
+    std::vector<SharedMessage> pull_batch(size_t maxRecords, size_t maxBytes, size_t minBytes) {
+        std::vector<SharedMessage> batch;
+        std::lock_guard<std::mutex> lock(mtx);
+        if (q.empty() || queuedBytes < minBytes) return batch;
+
+        size_t bytes = 0;
+        while (!q.empty() && batch.size() < maxRecords) {
+            size_t next = q.front().size();
+            if (!batch.empty() && bytes + next > maxBytes) break;
+
+            bytes += next;
+            batch.push_back(std::move(q.front()));
+            q.pop();
+        }
+        queuedBytes -= bytes;
+        return batch;
+    }
+
+    size_t pull_batch(size_t maxRecords, size_t maxBytes, size_t minBytes, const TopicQueue::MessageSink& sink) {
+        auto batch = pull_batch(maxRecords, maxBytes, minBytes);
+        for (auto& msg : batch)
+            sink(std::move(msg));
+        return batch.size();
+    }
+
+    uint64_t dropped() const { return 0; }
+
+private:
+    std::mutex mtx;
+    std::queue<SharedMessage> q;
+    size_t queuedBytes = 0;
+};
+
+namespace {
+    constexpr size_t messagesPerProducer = 200000;
+    constexpr size_t messageSize = 64;
+    constexpr size_t batchRecords = 16;
+
+    struct Result {
+        double mmsgPerSec;      // messages pulled
+        uint64_t dropped;
+    };
+
+    template <typename Queue>
+    Result run(size_t threads) {
+        Queue queue;
+        size_t producers = std::max<size_t>(threads / 2, 1);
+        size_t consumers = std::max<size_t>(threads - producers, 1);
+        size_t total = producers * messagesPerProducer;
+
+        std::atomic<size_t> consumed{ 0 };
+        std::atomic<size_t> producing{ producers };
+        std::atomic<bool> start{ false };
+        std::string payload(messageSize, 'x');
+
+        auto consume = [&] {
+            size_t sink = 0;
+            size_t got = queue.pull_batch(batchRecords, SIZE_MAX, 0, [&](SharedMessage&& m) { sink += m.size(); });
+            consumed.fetch_add(got, std::memory_order_relaxed);
+            return got;
+        };
+        auto done = [&] { return consumed.load() + queue.dropped() >= total && producing.load() == 0; };
+
+        std::vector<std::jthread> workers;
+        if (threads == 1) {
+            workers.emplace_back([&] {
+                while (!start) {}
+                for (size_t i = 0; i < messagesPerProducer; ++i) {
+                    queue.publish(SharedMessage::create(payload));
+                    consume();
+                }
+                producing = 0;
+                while (!done()) consume();
+            });
+        }
+        else {
+            for (size_t p = 0; p < producers; ++p) {
+                workers.emplace_back([&] {
+                    while (!start) {}
+                    for (size_t i = 0; i < messagesPerProducer; ++i)
+                        queue.publish(SharedMessage::create(payload));
+                    producing.fetch_sub(1);
+                });
+            }
+            for (size_t c = 0; c < consumers; ++c) {
+                workers.emplace_back([&] {
+                    while (!start) {}
+                    while (!done()) {
+                        if (consume() == 0) std::this_thread::yield();
+                    }
+                });
+            }
+        }
+
+        auto begin = std::chrono::steady_clock::now();
+        start = true;
+        workers.clear();
+        std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - begin;
+        return { static_cast<double>(consumed.load()) / elapsed.count() / 1e6, queue.dropped() };
+    }
+}
+
+int main() {
+    std::cout << std::format("{:>8} {:>14} {:>14} {:>12}\n", "threads", "mutex Mmsg/s", "ring Mmsg/s", "ring drops");
+    for (size_t threads : { 1, 2, 4, 8, 16, 32, 64 }) {
+        Result baseline = run<MutexTopicQueue>(threads);
+        Result ring = run<TopicQueue>(threads);
+        std::cout << std::format("{:>8} {:>14.2f} {:>14.2f} {:>12}\n", threads, baseline.mmsgPerSec, ring.mmsgPerSec, ring.dropped);
+    }
+    return 0;
+}
@@ -1,143 +1,555 @@
+// Open-loop load generator. Producers send on a fixed schedule whatever the broker's latency, and
+// every message carries the time it was due to be sent, not the time it went out: a stalled
+// broker then shows up as latency of all the messages that should have been sent meanwhile
+// instead of silently lowering the send rate (coordinated omission).
+//
+//   client --producers=4 --consumers=4 --topics=2 --size=256 --rate=50000 --duration=30 --json=run.json
+
 #include <iostream>
+#include <fstream>
 #include <string>
-#include <winsock2.h>
-#include <ws2tcpip.h>
 #include <thread>
 #include <atomic>
 #include <chrono>
 #include <mutex>
 #include <vector>
+#include <string_view>
+#include <charconv>
+#include <cstring>
+#include <format>
+#include <memory>
+#include <algorithm>
+
+#include "../message-broker/platform.h"
+#include "../message-broker/protocol.h"
+#include "latency_histogram.h"
 
+#ifdef _WIN32
 #pragma comment(lib, "Ws2_32.lib")
+#endif
 
-std::atomic<bool> running(true);
 std::mutex cout_mutex;
 
-void topic_pull_thread(SOCKET sock, const std::string& topic) {
+struct Options {
+    std::string host = "127.0.0.1";
+    uint16_t port = 12345;
+    size_t producers = 1;
+    size_t consumers = 1;
+    size_t topics = 1;
+    uint32_t partitions = 1;
+    size_t messageSize = 100;
+    // messages per second over all producers; 0 sends as fast as the broker acknowledges
+    uint64_t rate = 10000;
+    size_t batch = 100;
+    double warmupSeconds = 2;
+    double durationSeconds = 10;
+    std::string topicPrefix = "bench";
+    // "-" for stdout, empty for no JSON report
+    std::string jsonPath;
+};
+
+// monotonic nanoseconds; producers and consumers share one process, so one clock serves both ends
+int64_t now_ns() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+void sleep_until_ns(int64_t deadline) {
+    // sleeping is coarse, so the last stretch is spent yielding
+    int64_t remaining = deadline - now_ns();
+    if (remaining > 2'000'000)
+        std::this_thread::sleep_for(std::chrono::nanoseconds(remaining - 1'000'000));
+    while (now_ns() < deadline)
+        std::this_thread::yield();
+}
+
+bool send_all(socket_t sock, std::string_view data) {
+    size_t sent = 0;
+    while (sent < data.size()) {
+        int n = send(sock, data.data() + sent, static_cast<int>(data.size() - sent), 0);
+        if (n <= 0) return false;
+        sent += static_cast<size_t>(n);
+    }
+    return true;
+}
+
+bool recv_exact(socket_t sock, char* buf, size_t len) {
+    size_t received = 0;
+    while (received < len) {
+        int n = recv(sock, buf + received, static_cast<int>(len - received), 0);
+        if (n <= 0) return false;
+        received += static_cast<size_t>(n);
+    }
+    return true;
+}
+
+// reads one response frame, length prefix included
+bool recv_frame(socket_t sock, std::string& frame) {
+    char lengthBuf[protocol::lengthSize];
+    if (!recv_exact(sock, lengthBuf, sizeof(lengthBuf))) return false;
+
+    const auto* b = reinterpret_cast<const unsigned char*>(lengthBuf);
+    uint32_t length = (uint32_t(b[0]) << 24) | (uint32_t(b[1]) << 16) | (uint32_t(b[2]) << 8) | uint32_t(b[3]);
+    if (length > protocol::maxFrameSize) return false;
+
+    frame.assign(lengthBuf, sizeof(lengthBuf));
+    frame.resize(protocol::lengthSize + length);
+    return recv_exact(sock, frame.data() + protocol::lengthSize, length);
+}
 
-    std::string subscribeCommand = "SUBSCRIBE " + topic;
-    int bytesSent = send(sock, subscribeCommand.c_str(), static_cast<int>(subscribeCommand.length()), 0);
+bool init_connection(socket_t& sock, const std::string& server_ip, uint16_t port) {
+    sockaddr_in serverAddr{};
+    serverAddr.sin_family = AF_INET;
+    serverAddr.sin_port = htons(port);
 
-    if (bytesSent == SOCKET_ERROR) {
+    if (inet_pton(AF_INET, server_ip.c_str(), &serverAddr.sin_addr) <= 0) {
         std::lock_guard<std::mutex> lock(cout_mutex);
-        std::cerr << "[error] Topic subscribe: " << WSAGetLastError() << std::endl;
-        return;
+        std::cerr << "[error] Invalid Broker Address." << std::endl;
+        return false;
     }
 
-    {
+    sock = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+    if (sock == invalid_socket) {
+        std::lock_guard<std::mutex> lock(cout_mutex);
+        std::cerr << "[error] socket error: " << last_socket_error() << std::endl;
+        return false;
+    }
+
+    if (connect(sock, reinterpret_cast<sockaddr*>(&serverAddr), sizeof(serverAddr)) != 0) {
         std::lock_guard<std::mutex> lock(cout_mutex);
-        std::cout << "[info] subscirbed Topic: " << topic << std::endl;
+        std::cerr << "[error] connect error: " << last_socket_error() << std::endl;
+        close_socket(sock);
+        return false;
     }
 
-    while (running) {
-        std::this_thread::sleep_for(std::chrono::milliseconds(100));
+    int noDelay = 1;
+    setsockopt(sock, IPPROTO_TCP, TCP_NODELAY, reinterpret_cast<const char*>(&noDelay), sizeof(noDelay));
+    return true;
+}
 
-        std::string pullCommand = "PULL " + topic;
-        bytesSent = send(sock, pullCommand.c_str(), static_cast<int>(pullCommand.length()), 0);
+// sends one request and waits for its response frame
+bool round_trip(socket_t sock, const protocol::Request& request, std::string& frame) {
+    PooledString out;
+    protocol::encode_request(out, request);
+    return send_all(sock, out) && recv_frame(sock, frame);
+}
 
+// Shared between all threads of a run. Only messages due inside the measured window count; the
+// warmup before it fills connections, pools and page caches.
+struct Run {
+    Options options;
+    int64_t start = 0;
+    int64_t measureStart = 0;
+    int64_t measureEnd = 0;
+    std::atomic<bool> consuming{ true };
+    std::atomic<uint64_t> errors{ 0 };
+};
 
-        if (bytesSent == SOCKET_ERROR) {
-            std::lock_guard<std::mutex> lock(cout_mutex);
-            std::cerr << "[error] Message pull: " << WSAGetLastError() << std::endl;
-            break;
-        }
+struct ProducerStats {
+    LatencyHistogram ack;
+    uint64_t sent = 0;
+    uint64_t acked = 0;
+    uint64_t bytes = 0;
+};
+
+struct ConsumerStats {
+    LatencyHistogram endToEnd;
+    uint64_t received = 0;
+    uint64_t bytes = 0;
+};
+
+std::string topic_name(const Options& options, size_t index) {
+    return std::format("{}-{}", options.topicPrefix, index);
+}
+
+// Producer k's schedule is one message every producers / rate seconds. Acks are read on a second
+// thread, so a slow ack never delays the next send. Ack latency runs from the batch's oldest due time.
+void producer_thread(Run& run, size_t id, ProducerStats& stats) {
+    const Options& options = run.options;
+    socket_t sock;
+    if (!init_connection(sock, options.host, options.port)) {
+        run.errors++;
+        return;
+    }
+
+    std::string topic = topic_name(options, id % options.topics);
+    int64_t interval = options.rate ? static_cast<int64_t>(1e9 * static_cast<double>(options.producers) / static_cast<double>(options.rate)) : 0;
+    // spreads the producers' schedules over one interval
+    int64_t first = run.start + (interval ? interval * static_cast<int64_t>(id) / static_cast<int64_t>(options.producers) : 0);
 
-        char buffer[1024];
-        int bytesReceived = recv(sock, buffer, sizeof(buffer), 0);
+    // due time of the oldest record per correlation id; acks of one connection come back in order
+    constexpr size_t inflightSlots = 1 << 16;
+    std::vector<int64_t> dueTimes(inflightSlots);
+    std::vector<uint32_t> batchSizes(inflightSlots);
+    std::atomic<uint32_t> sentRequests{ 0 };
+    std::atomic<uint32_t> ackedRequests{ 0 };
+    std::atomic<bool> sending{ true };
 
-        if (bytesReceived > 0) {
-            std::string receivedMessage(buffer, bytesReceived);
+    std::thread acks([&] {
+        std::string frame;
+        while (ackedRequests.load(std::memory_order_relaxed) < sentRequests.load(std::memory_order_acquire) ||
+            sending.load(std::memory_order_acquire)) {
+            if (ackedRequests.load(std::memory_order_relaxed) == sentRequests.load(std::memory_order_acquire)) {
+                std::this_thread::sleep_for(std::chrono::microseconds(50));
+                continue;
+            }
+            if (!recv_frame(sock, frame)) {
+                run.errors++;
+                sending = false;
+                break;
+            }
 
-            if (receivedMessage != "NO_MESSAGES") {
-                std::lock_guard<std::mutex> lock(cout_mutex);
-                std::cout << "[info] message: " << receivedMessage << std::endl;
+            int64_t now = now_ns();
+            protocol::Request response;
+            size_t consumed = 0;
+            if (protocol::parse_frame(frame, response, consumed) != protocol::ParseResult::Ok ||
+                protocol::frame_status(frame) != protocol::Status::Ok)
+                run.errors++;
+
+            size_t slot = response.correlationId % inflightSlots;
+            int64_t due = dueTimes[slot];
+            if (due >= run.measureStart && due < run.measureEnd) {
+                stats.ack.record(now - due);
+                stats.acked += batchSizes[slot];
             }
+            ackedRequests.fetch_add(1, std::memory_order_release);
         }
-        else if (bytesReceived == 0) {
-            std::lock_guard<std::mutex> lock(cout_mutex);
-            std::cout << "[error] Connection closed." << std::endl;
+    });
+
+    std::string padding(std::max<size_t>(options.messageSize, sizeof(int64_t)) - sizeof(int64_t), 'x');
+    PooledString payload;
+    PooledString out;
+    protocol::Request request;
+    request.type = protocol::RequestType::ProduceBatch;
+    request.topic = topic;
+
+    uint64_t next = 0;
+    while (sending.load(std::memory_order_acquire)) {
+        int64_t now = now_ns();
+        if (now >= run.measureEnd)
             break;
+        if (interval) {
+            int64_t due = first + static_cast<int64_t>(next) * interval;
+            if (due > now) {
+                sleep_until_ns(due);
+                now = now_ns();
+            }
         }
-        else {
-            std::lock_guard<std::mutex> lock(cout_mutex);
-            std::cerr << "[error] receive failed: " << WSAGetLastError() << std::endl;
+
+        // everything due by now goes in one request, so a producer that fell behind catches up in batches
+        payload.clear();
+        int64_t oldest = 0;
+        uint32_t count = 0;
+        while (count < options.batch) {
+            int64_t due = interval ? first + static_cast<int64_t>(next) * interval : now;
+            if (interval && due > now && count > 0)
+                break;
+
+            char record[sizeof(int64_t)];
+            std::memcpy(record, &due, sizeof(due));
+            protocol::encode_u32(payload, static_cast<uint32_t>(sizeof(record) + padding.size()));
+            payload.append(record, sizeof(record));
+            payload.append(padding);
+            if (count == 0)
+                oldest = due;
+            ++count;
+            ++next;
+            if (due >= run.measureStart && due < run.measureEnd) {
+                stats.sent++;
+                stats.bytes += sizeof(record) + padding.size();
+            }
+        }
+
+        // the slot ring bounds what is in flight; waiting here only happens when the broker is far behind
+        while (sentRequests.load(std::memory_order_relaxed) - ackedRequests.load(std::memory_order_acquire) >= inflightSlots &&
+            sending.load(std::memory_order_acquire))
+            std::this_thread::yield();
+
+        uint32_t correlationId = sentRequests.load(std::memory_order_relaxed) + 1;
+        dueTimes[correlationId % inflightSlots] = oldest;
+        batchSizes[correlationId % inflightSlots] = count;
+        request.correlationId = correlationId;
+        request.payload = payload;
+        out.clear();
+        protocol::encode_request(out, request);
+        if (!send_all(sock, out)) {
+            run.errors++;
             break;
         }
+        sentRequests.store(correlationId, std::memory_order_release);
     }
+
+    // the ack thread finishes once every request sent is answered
+    sending = false;
+    acks.join();
+    close_socket(sock);
 }
 
-bool init_connection(SOCKET& sock, const std::string& server_ip, uint16_t port) {
-    sockaddr_in serverAddr;
-    serverAddr.sin_family = AF_INET;
-    serverAddr.sin_port = htons(port);
+// Long-polls FETCH_BATCH on one topic; end-to-end latency runs from a message's due time to its arrival.
+void consumer_thread(Run& run, size_t id, ConsumerStats& stats) {
+    const Options& options = run.options;
+    socket_t sock;
+    if (!init_connection(sock, options.host, options.port)) {
+        run.errors++;
+        return;
+    }
 
-    if (inet_pton(AF_INET, server_ip.c_str(), &serverAddr.sin_addr) <= 0) {
-        std::lock_guard<std::mutex> lock(cout_mutex);
-        std::cerr << "[error] Invalid Broker Address." << std::endl;
-        return false;
+    std::string topic = topic_name(options, id % options.topics);
+    std::string frame;
+    protocol::Request subscribe;
+    subscribe.type = protocol::RequestType::Subscribe;
+    subscribe.topic = topic;
+    if (!round_trip(sock, subscribe, frame)) {
+        run.errors++;
+        close_socket(sock);
+        return;
     }
 
-    sock = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
-    if (sock == INVALID_SOCKET) {
-        std::lock_guard<std::mutex> lock(cout_mutex);
-        std::cerr << "[error] socket WSAGetLastError: " << WSAGetLastError() << std::endl;
-        return false;
+    protocol::FetchParams params;
+    params.maxRecords = 1000;
+    params.maxBytes = 1024 * 1024;
+    // short enough that the consumer notices the end of the run
+    params.maxWaitMs = 100;
+
+    PooledString fetchPayload;
+    protocol::encode_fetch_params(fetchPayload, params);
+    protocol::Request fetch;
+    fetch.type = protocol::RequestType::FetchBatch;
+    fetch.payload = fetchPayload;
+
+    std::vector<std::string_view> records;
+    uint32_t correlationId = 0;
+    while (run.consuming.load(std::memory_order_acquire)) {
+        fetch.correlationId = ++correlationId;
+        if (!round_trip(sock, fetch, frame)) {
+            run.errors++;
+            break;
+        }
+
+        int64_t now = now_ns();
+        protocol::Request response;
+        size_t consumed = 0;
+        if (protocol::parse_frame(frame, response, consumed) != protocol::ParseResult::Ok)
+            break;
+        if (protocol::frame_status(frame) != protocol::Status::Ok)
+            continue;
+
+        records.clear();
+        if (!protocol::parse_records(response.payload, records))
+            continue;
+        for (std::string_view record : records) {
+            int64_t due;
+            if (record.size() < sizeof(due))
+                continue;
+            std::memcpy(&due, record.data(), sizeof(due));
+            if (due < run.measureStart || due >= run.measureEnd)
+                continue;
+            stats.endToEnd.record(now - due);
+            stats.received++;
+            stats.bytes += record.size();
+        }
     }
+    close_socket(sock);
+}
 
-    if (connect(sock, (SOCKADDR*)&serverAddr, sizeof(serverAddr)) == SOCKET_ERROR) {
-        std::lock_guard<std::mutex> lock(cout_mutex);
-        std::cerr << "[error] connect WSAGetLastError: " << WSAGetLastError() << std::endl;
-        closesocket(sock);
+bool create_topics(const Options& options) {
+    socket_t sock;
+    if (!init_connection(sock, options.host, options.port))
         return false;
+
+    std::string frame;
+    bool ok = true;
+    for (size_t i = 0; i < options.topics && ok; ++i) {
+        std::string topic = topic_name(options, i);
+        PooledString payload;
+        protocol::encode_u32(payload, options.partitions);
+        protocol::Request create;
+        create.type = protocol::RequestType::CreateTopic;
+        create.topic = topic;
+        create.payload = payload;
+        ok = round_trip(sock, create, frame) && protocol::frame_status(frame) == protocol::Status::Ok;
+        if (!ok) {
+            std::lock_guard<std::mutex> lock(cout_mutex);
+            std::cerr << "[error] CREATE_TOPIC " << topic << " failed, it may exist with another partition count" << std::endl;
+        }
     }
+    close_socket(sock);
+    return ok;
+}
 
-    return true;
+std::string latency_json(const LatencyHistogram& h) {
+    auto us = [](int64_t ns) { return static_cast<double>(ns) / 1000.0; };
+    return std::format("{{\"count\":{},\"min_us\":{:.1f},\"mean_us\":{:.1f},\"p50_us\":{:.1f},\"p99_us\":{:.1f},\"p999_us\":{:.1f},\"max_us\":{:.1f}}}",
+        h.count(), us(h.min()), h.mean() / 1000.0, us(h.percentile(0.5)), us(h.percentile(0.99)), us(h.percentile(0.999)), us(h.max()));
 }
 
-int main() {
+std::string latency_line(const LatencyHistogram& h) {
+    auto ms = [](int64_t ns) { return static_cast<double>(ns) / 1e6; };
+    return std::format("p50 {:.3f} ms  p99 {:.3f} ms  p999 {:.3f} ms  max {:.3f} ms  ({} samples)",
+        ms(h.percentile(0.5)), ms(h.percentile(0.99)), ms(h.percentile(0.999)), ms(h.max()), h.count());
+}
+
+template <typename T>
+bool parse_number(std::string_view value, T& out) {
+    auto [end, ec] = std::from_chars(value.data(), value.data() + value.size(), out);
+    return ec == std::errc() && end == value.data() + value.size();
+}
+
+bool parse_options(int argc, char* argv[], Options& options) {
+    for (int i = 1; i < argc; ++i) {
+        std::string_view arg = argv[i];
+        size_t equals = arg.find('=');
+        std::string_view name = arg.substr(0, equals);
+        std::string_view value = equals == std::string_view::npos ? std::string_view() : arg.substr(equals + 1);
+
+        bool ok = true;
+        if (name == "--host") options.host = value;
+        else if (name == "--port") ok = parse_number(value, options.port);
+        else if (name == "--producers") ok = parse_number(value, options.producers);
+        else if (name == "--consumers") ok = parse_number(value, options.consumers);
+        else if (name == "--topics") ok = parse_number(value, options.topics) && options.topics > 0;
+        else if (name == "--partitions") ok = parse_number(value, options.partitions) && options.partitions > 0;
+        else if (name == "--size") ok = parse_number(value, options.messageSize);
+        else if (name == "--rate") ok = parse_number(value, options.rate);
+        else if (name == "--batch") ok = parse_number(value, options.batch) && options.batch > 0;
+        else if (name == "--warmup") ok = parse_number(value, options.warmupSeconds) && options.warmupSeconds >= 0;
+        else if (name == "--duration") ok = parse_number(value, options.durationSeconds) && options.durationSeconds > 0;
+        else if (name == "--topic-prefix") options.topicPrefix = value;
+        else if (name == "--json") options.jsonPath = value.empty() ? "-" : std::string(value);
+        else ok = false;
+
+        if (!ok) {
+            std::cerr << "[error] bad option: " << arg << "\n"
+                << "usage: client [--host=127.0.0.1] [--port=12345] [--producers=1] [--consumers=1] [--topics=1]\n"
+                << "              [--partitions=1] [--size=100] [--rate=10000 (msg/s, 0 = unthrottled)] [--batch=100]\n"
+                << "              [--warmup=2] [--duration=10] [--topic-prefix=bench] [--json[=<file>|-]]" << std::endl;
+            return false;
+        }
+    }
+    return options.producers > 0 || options.consumers > 0;
+}
+
+int main(int argc, char* argv[]) {
+    Run run;
+    if (!parse_options(argc, argv, run.options))
+        return 1;
+    const Options& options = run.options;
+
+#ifdef _WIN32
     WSADATA wsaData;
     if (WSAStartup(MAKEWORD(2, 2), &wsaData) != 0) {
         std::lock_guard<std::mutex> lock(cout_mutex);
         std::cerr << "[error] WSAStartup failed." << std::endl;
         return 1;
     }
+#endif
 
-    int count;
-    std::cout << "Input thread count: ";
-    std::cin >> count;
+    if (!create_topics(options)) {
+#ifdef _WIN32
+        WSACleanup();
+#endif
+        return 1;
+    }
 
-    std::string server_ip = "127.0.0.1";
-    uint16_t port = 12345;
-    std::string topic = "topic1";
+    // consumers connect and subscribe before the schedule starts
+    std::vector<ConsumerStats> consumerStats(options.consumers);
+    std::vector<ProducerStats> producerStats(options.producers);
+    std::vector<std::thread> consumers;
+    std::vector<std::thread> producers;
 
-    std::vector<std::thread> threads;
-    std::vector<SOCKET> sockets;
+    run.start = now_ns() + 200'000'000;
+    run.measureStart = run.start + static_cast<int64_t>(options.warmupSeconds * 1e9);
+    run.measureEnd = run.measureStart + static_cast<int64_t>(options.durationSeconds * 1e9);
 
-    for (int i = 0; i < count; ++i) {
-        SOCKET clientSocket;
-        if (!init_connection(clientSocket, server_ip, port)) {
-            std::lock_guard<std::mutex> lock(cout_mutex);
-            std::cerr << "[error] Connect failed for broker #" << i << std::endl;
-            continue;
-        }
+    for (size_t i = 0; i < options.consumers; ++i)
+        consumers.emplace_back(consumer_thread, std::ref(run), i, std::ref(consumerStats[i]));
+    sleep_until_ns(run.start);
+    for (size_t i = 0; i < options.producers; ++i)
+        producers.emplace_back(producer_thread, std::ref(run), i, std::ref(producerStats[i]));
 
-        {
-            std::lock_guard<std::mutex> lock(cout_mutex);
-            std::cout << "[info] Connect successed for broker #" << i << std::endl;
-        }
+    for (auto& t : producers)
+        t.join();
 
-        threads.emplace_back(topic_pull_thread, clientSocket, topic);
-        sockets.push_back(clientSocket);
+    // consumers drain what is still queued; messages due in the window may still be in flight
+    uint64_t sent = 0;
+    for (const ProducerStats& s : producerStats)
+        sent += s.sent;
+    int64_t drainDeadline = now_ns() + 5'000'000'000;
+    auto received = [&] {
+        uint64_t total = 0;
+        for (const ConsumerStats& s : consumerStats)
+            total += s.received;
+        return total;
+    };
+    uint64_t last = UINT64_MAX;
+    while (options.consumers > 0 && now_ns() < drainDeadline) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(250));
+        // counters are read racily here; a stable count for a quarter second ends the drain
+        uint64_t now = received();
+        if (now >= sent || now == last)
+            break;
+        last = now;
     }
+    run.consuming = false;
+    for (auto& t : consumers)
+        t.join();
 
-    for (auto& t : threads) {
-        if (t.joinable()) t.join();
+    LatencyHistogram ack;
+    LatencyHistogram endToEnd;
+    uint64_t acked = 0;
+    uint64_t producedBytes = 0;
+    uint64_t consumed = 0;
+    uint64_t consumedBytes = 0;
+    for (const ProducerStats& s : producerStats) {
+        ack.merge(s.ack);
+        acked += s.acked;
+        producedBytes += s.bytes;
     }
+    for (const ConsumerStats& s : consumerStats) {
+        endToEnd.merge(s.endToEnd);
+        consumed += s.received;
+        consumedBytes += s.bytes;
+    }
+
+    double seconds = options.durationSeconds;
+    double produceRate = static_cast<double>(acked) / seconds;
+    double consumeRate = static_cast<double>(consumed) / seconds;
+    double produceMb = static_cast<double>(producedBytes) / seconds / (1024 * 1024);
+    double consumeMb = static_cast<double>(consumedBytes) / seconds / (1024 * 1024);
 
-    for (SOCKET s : sockets) {
-        closesocket(s);
+    {
+        std::lock_guard<std::mutex> lock(cout_mutex);
+        std::cout << std::format("[info] {} producers, {} consumers, {} topics x {} partitions, {} B messages, target {} msg/s, {:.0f} s measured\n",
+            options.producers, options.consumers, options.topics, options.partitions, options.messageSize,
+            options.rate ? std::to_string(options.rate) : std::string("unthrottled"), seconds);
+        std::cout << std::format("[info] produced {} msgs ({:.0f} msg/s, {:.2f} MiB/s), acked {}\n", sent, produceRate, produceMb, acked);
+        std::cout << std::format("[info] consumed {} msgs ({:.0f} msg/s, {:.2f} MiB/s)\n", consumed, consumeRate, consumeMb);
+        std::cout << "[info] ack latency        " << latency_line(ack) << "\n";
+        std::cout << "[info] end-to-end latency " << latency_line(endToEnd) << "\n";
+        if (run.errors)
+            std::cout << "[error] " << run.errors << " request errors" << "\n";
+        std::cout << std::flush;
     }
 
+    if (!options.jsonPath.empty()) {
+        std::string json = std::format(
+            "{{\"producers\":{},\"consumers\":{},\"topics\":{},\"partitions\":{},\"message_size\":{},\"target_rate\":{},\"batch\":{},"
+            "\"duration_s\":{},\"sent\":{},\"acked\":{},\"consumed\":{},\"produce_rate\":{:.1f},\"consume_rate\":{:.1f},"
+            "\"produce_mib_s\":{:.3f},\"consume_mib_s\":{:.3f},\"errors\":{},\"ack_latency\":{},\"end_to_end_latency\":{}}}",
+            options.producers, options.consumers, options.topics, options.partitions, options.messageSize, options.rate, options.batch,
+            seconds, sent, acked, consumed, produceRate, consumeRate, produceMb, consumeMb, run.errors.load(),
+            latency_json(ack), latency_json(endToEnd));
+        if (options.jsonPath == "-")
+            std::cout << json << std::endl;
+        else {
+            std::ofstream file(options.jsonPath, std::ios::trunc);
+            file << json << '\n';
+            if (!file)
+                std::cerr << "[error] JSON write failed: " << options.jsonPath << std::endl;
+        }
+    }
+
+#ifdef _WIN32
     WSACleanup();
-    return 0;
-}
\ No newline at end of file
+#endif
+    return run.errors ? 2 : 0;
+}
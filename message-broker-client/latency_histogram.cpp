@@ -0,0 +1,53 @@
+#include "latency_histogram.h"
+
+#include <algorithm>
+#include <bit>
+#include <cmath>
+
+// values below subBuckets have a bucket each; above that, the top subBucketBits bits pick the bucket
+size_t LatencyHistogram::bucket_of(uint64_t value) {
+    if (value < subBuckets)
+        return static_cast<size_t>(value);
+    unsigned shift = static_cast<unsigned>(std::bit_width(value)) - subBucketBits;
+    return shift * halfBuckets + static_cast<size_t>(value >> shift);
+}
+
+uint64_t LatencyHistogram::bucket_high(size_t bucket) {
+    if (bucket < subBuckets)
+        return bucket;
+    unsigned shift = static_cast<unsigned>(bucket / halfBuckets - 1);
+    uint64_t mantissa = bucket - shift * halfBuckets;
+    return ((mantissa + 1) << shift) - 1;
+}
+
+void LatencyHistogram::record(int64_t value) {
+    value = std::max<int64_t>(value, 0);
+    counts[bucket_of(static_cast<uint64_t>(value))]++;
+    total++;
+    sum += static_cast<uint64_t>(value);
+    minValue = std::min(minValue, value);
+    maxValue = std::max(maxValue, value);
+}
+
+void LatencyHistogram::merge(const LatencyHistogram& other) {
+    for (size_t i = 0; i < bucketCount; ++i)
+        counts[i] += other.counts[i];
+    total += other.total;
+    sum += other.sum;
+    minValue = std::min(minValue, other.minValue);
+    maxValue = std::max(maxValue, other.maxValue);
+}
+
+int64_t LatencyHistogram::percentile(double fraction) const {
+    if (total == 0)
+        return 0;
+
+    uint64_t rank = std::max<uint64_t>(1, static_cast<uint64_t>(std::ceil(fraction * static_cast<double>(total))));
+    uint64_t seen = 0;
+    for (size_t i = 0; i < bucketCount; ++i) {
+        seen += counts[i];
+        if (seen >= rank)
+            return std::min(static_cast<int64_t>(bucket_high(i)), maxValue);
+    }
+    return maxValue;
+}
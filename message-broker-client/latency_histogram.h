@@ -0,0 +1,36 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <cstddef>
+
+// HDR-style log-linear histogram of non-negative values (nanoseconds here). Every power of two
+// is split into 64 linear buckets, so a recorded value is off by less than 1.6%. Recording is
+// one increment, so each thread keeps its own histogram and they are merged at the end.
+class LatencyHistogram {
+public:
+    void record(int64_t value);
+    void merge(const LatencyHistogram& other);
+
+    uint64_t count() const { return total; }
+    int64_t min() const { return total ? minValue : 0; }
+    int64_t max() const { return total ? maxValue : 0; }
+    double mean() const { return total ? static_cast<double>(sum) / static_cast<double>(total) : 0.0; }
+    // highest value of the bucket that holds the given fraction (0.5, 0.99, 0.999) of the values
+    int64_t percentile(double fraction) const;
+
+private:
+    static constexpr unsigned subBucketBits = 7;
+    static constexpr size_t subBuckets = size_t(1) << subBucketBits;
+    static constexpr size_t halfBuckets = subBuckets / 2;
+    static constexpr size_t bucketCount = (64 - subBucketBits + 1) * halfBuckets + halfBuckets;
+
+    std::array<uint64_t, bucketCount> counts{};
+    uint64_t total = 0;
+    uint64_t sum = 0;
+    int64_t minValue = INT64_MAX;
+    int64_t maxValue = 0;
+
+    static size_t bucket_of(uint64_t value);
+    static uint64_t bucket_high(size_t bucket);
+};
@@ -0,0 +1,228 @@
+// One log cleaner pass over logs spanning several small segments, checked through FETCH_LOG and
+// on the segment files it leaves: a compacted topic keeps the latest value of every key, a delete
+// topic loses whole segments from its start down to the retention size. Then a commit log is
+// reopened over the files a compaction pass cut short would leave.
+//
+//   cleaner_test [--dir=cleaner-data]
+
+#include <iostream>
+#include <fstream>
+#include <string>
+#include <string_view>
+#include <vector>
+#include <map>
+#include <algorithm>
+#include <mutex>
+#include <format>
+#include <filesystem>
+#include <system_error>
+
+#include "protocol.h"
+#include "topic_manager.h"
+#include "async_logger.h"
+#include "test_connection.h"
+
+std::mutex cout_mutex;
+
+namespace {
+    using protocol::RequestType;
+    using protocol::Status;
+
+    constexpr size_t segmentSize = 4096;
+    // a delete topic keeps about this many segments
+    constexpr uint64_t retainedBytes = 3 * segmentSize;
+    constexpr size_t keyCount = 8;
+    constexpr size_t rounds = 12;
+
+    int failures = 0;
+
+    void check(bool ok, std::string_view what) {
+        if (ok)
+            return;
+        ++failures;
+        std::cout << "FAIL " << what << std::endl;
+    }
+
+    std::string value_of(size_t key, size_t round) {
+        return std::format("k{}@{}:{}", key, round, std::string(160, 'v'));
+    }
+
+    // every record of the partition from offset 0, one segment per FETCH_LOG
+    std::vector<FetchedRecord> fetch_all(Connection& connection, std::string_view topic) {
+        std::vector<FetchedRecord> all;
+        uint64_t offset = 0;
+        while (true) {
+            std::vector<FetchedRecord> got = fetch_log(connection, topic, offset, static_cast<uint32_t>(segmentSize));
+            if (got.empty())
+                return all;
+            offset = got.back().offset + 1;
+            for (FetchedRecord& record : got)
+                all.push_back(std::move(record));
+        }
+    }
+
+    bool has_cleaned_files(const std::string& dir) {
+        std::error_code ec;
+        for (const auto& entry : std::filesystem::directory_iterator(dir, ec)) {
+            if (entry.path().filename().string().find(".cleaned.") != std::string::npos)
+                return true;
+        }
+        return false;
+    }
+
+    uint64_t segment_bytes(const std::string& dir) {
+        uint64_t total = 0;
+        std::error_code ec;
+        for (uint64_t base : list_segment_offsets(dir))
+            total += std::filesystem::file_size(std::format("{}/{:020}.log", dir, base), ec);
+        return total;
+    }
+
+    bool create_topic(Connection& connection, std::string_view topic, CleanupPolicy cleanup) {
+        PooledString payload;
+        protocol::encode_u32(payload, 1);
+        char policy = static_cast<char>(cleanup);
+        payload.append(std::string_view(&policy, 1));
+        return connection.send(RequestType::CreateTopic, topic, payload).status == Status::Ok;
+    }
+
+    // rounds of the same keys: after a pass the sealed segments hold only the latest record of
+    // each key, and the active segment is left as it was
+    void test_compaction(const std::string& dir) {
+        Connection connection;
+        const std::string topic = "compacted";
+        const std::string partitionDir = dir + "/" + topic;
+        check(create_topic(connection, topic, CleanupPolicy::Compact), "create the compacted topic");
+
+        for (size_t round = 0; round < rounds; ++round) {
+            PooledString batch;
+            for (size_t key = 0; key < keyCount; ++key) {
+                protocol::append_record(batch, std::format("k{}", key));
+                protocol::append_record(batch, value_of(key, round));
+            }
+            check(connection.send(RequestType::ProduceKeyed, topic, batch).status == Status::Ok, "produce keyed records");
+        }
+
+        std::vector<uint64_t> before = list_segment_offsets(partitionDir);
+        check(before.size() > 2, "the keyed records span several segments");
+        uint64_t bytesBefore = segment_bytes(partitionDir);
+        const uint64_t activeBase = before.back();
+
+        TopicManager::get_instance().clean_logs();
+
+        std::vector<FetchedRecord> fetched = fetch_all(connection, topic);
+        std::map<std::string, std::string> latest;
+        bool ordered = true;
+        bool sealedLatestOnly = true;
+        for (size_t i = 0; i < fetched.size(); ++i) {
+            const FetchedRecord& record = fetched[i];
+            ordered = ordered && (i == 0 || record.offset > fetched[i - 1].offset);
+            latest[record.key] = record.value;
+
+            // offsets run key by key within a round, so the latest record of key k is at this offset
+            size_t key = std::stoul(record.key.substr(1));
+            uint64_t latestOffset = (rounds - 1) * keyCount + key;
+            if (record.offset < activeBase && record.offset != latestOffset)
+                sealedLatestOnly = false;
+        }
+
+        check(ordered, "compacted records keep their offsets in order");
+        check(fetched.size() < rounds * keyCount, "compaction drops replaced records");
+        check(sealedLatestOnly, "sealed segments keep only the latest record of each key");
+        check(latest.size() == keyCount, "every key is still in the log");
+        for (size_t key = 0; key < keyCount; ++key)
+            check(latest[std::format("k{}", key)] == value_of(key, rounds - 1), std::format("k{} reads its latest value", key));
+        check(fetched.back().offset == rounds * keyCount - 1, "the active segment is untouched");
+
+        check(segment_bytes(partitionDir) < bytesBefore, "compaction shrinks the segment files");
+        check(list_segment_offsets(partitionDir).back() == activeBase, "the active segment stays the last one");
+        check(!has_cleaned_files(partitionDir), "a finished pass leaves no .cleaned files");
+    }
+
+    // retention deletes whole sealed segments from the start of the log; what is left is every
+    // record from the first remaining segment on
+    void test_retention(const std::string& dir) {
+        Connection connection;
+        const std::string topic = "retained";
+        const std::string partitionDir = dir + "/" + topic;
+        check(create_topic(connection, topic, CleanupPolicy::Delete), "create the delete topic");
+
+        const size_t count = rounds * keyCount;
+        for (size_t i = 0; i < count; ++i) {
+            PooledString batch;
+            protocol::append_record(batch, value_of(0, i));
+            check(connection.send(RequestType::ProduceBatch, topic, batch).status == Status::Ok, "produce unkeyed records");
+        }
+
+        std::vector<uint64_t> before = list_segment_offsets(partitionDir);
+        check(segment_bytes(partitionDir) > retainedBytes, "the log is larger than the retention size");
+
+        TopicManager::get_instance().clean_logs();
+
+        std::vector<uint64_t> after = list_segment_offsets(partitionDir);
+        check(!after.empty() && after.size() < before.size(), "retention deletes segments");
+        check(std::equal(after.begin(), after.end(), before.end() - static_cast<ptrdiff_t>(after.size())),
+            "only the oldest segments are deleted");
+        check(after.back() == before.back(), "the active segment is never deleted");
+        check(segment_bytes(partitionDir) <= retainedBytes, "what is left fits in the retention size");
+
+        std::vector<FetchedRecord> fetched = fetch_all(connection, topic);
+        bool contiguous = !fetched.empty() && !after.empty() && fetched.front().offset == after.front();
+        for (size_t i = 0; contiguous && i < fetched.size(); ++i)
+            contiguous = fetched[i].offset == after.front() + i && fetched[i].value == value_of(0, fetched[i].offset);
+        check(contiguous, "the log starts at the first remaining segment and keeps every record after it");
+        check(!fetched.empty() && fetched.back().offset == count - 1, "the newest records are kept");
+    }
+
+    // a pass that crashed before swapping its rewritten segment in leaves <base>.cleaned.* files;
+    // the log opened again removes them and keeps the original segment
+    void test_cleaned_files_on_restart(const std::string& dir) {
+        {
+            CommitLog log(dir, segmentSize);
+            for (size_t round = 0; round < 4; ++round)
+                log.append("k0", value_of(0, round));
+        }
+
+        std::vector<uint64_t> bases = list_segment_offsets(dir);
+        for (const char* extension : { ".log", ".index", ".timeindex" }) {
+            std::ofstream out(std::format("{}/{:020}.cleaned{}", dir, bases.front(), extension), std::ios::binary);
+            out << "half-written";
+        }
+        check(has_cleaned_files(dir), "the crashed pass left .cleaned files");
+
+        CommitLog log(dir, segmentSize);
+        check(!has_cleaned_files(dir), "reopening the log removes the .cleaned files");
+        check(list_segment_offsets(dir) == bases, "reopening keeps the original segments");
+        std::vector<LogRecord> got = log.read(0, 4, segmentSize);
+        check(got.size() == 4 && std::string_view(got.back().value) == value_of(0, 3), "the original segment's records are intact");
+    }
+}
+
+int main(int argc, char* argv[]) {
+    std::string dir = "cleaner-data";
+    for (int i = 1; i < argc; ++i) {
+        std::string_view arg = argv[i];
+        if (arg.starts_with("--dir=")) dir = arg.substr(6);
+        else {
+            std::cerr << "usage: cleaner_test [--dir=cleaner-data]" << std::endl;
+            return 1;
+        }
+    }
+
+    AsyncLogger::get_instance().set_level(LogLevel::Off);
+
+    std::error_code ec;
+    std::filesystem::remove_all(dir, ec);
+    DurabilityPolicy durability;
+    durability.mode = DurabilityPolicy::Mode::None;
+    RetentionPolicy retention;
+    retention.bytes = retainedBytes;
+    TopicManager::get_instance().init_storage(dir + "/broker", segmentSize, durability, 1, Codec::None, retention);
+
+    test_compaction(dir + "/broker");
+    test_retention(dir + "/broker");
+    test_cleaned_files_on_restart(dir + "/restart");
+
+    std::cout << (failures == 0 ? "all passed" : std::format("{} failed", failures)) << std::endl;
+    return failures == 0 ? 0 : 1;
+}
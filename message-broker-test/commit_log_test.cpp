@@ -0,0 +1,161 @@
+// CommitLog opened again over the files an earlier one left behind, the way the broker finds them
+// after a crash.
+//
+//   commit_log_test [--dir=commit-log-data]
+
+#include <iostream>
+#include <fstream>
+#include <iterator>
+#include <string>
+#include <string_view>
+#include <vector>
+#include <mutex>
+#include <format>
+#include <filesystem>
+#include <system_error>
+
+#include "commit_log.h"
+
+std::mutex cout_mutex;
+
+namespace {
+    // a few records per segment, so a handful of appends seals several
+    constexpr size_t segmentSize = 256;
+    constexpr uint64_t recordCount = 20;
+
+    int failures = 0;
+
+    void check(bool ok, std::string_view what) {
+        if (ok)
+            return;
+        ++failures;
+        std::cout << "FAIL " << what << std::endl;
+    }
+
+    std::string value_of(uint64_t offset) {
+        return std::format("value-{:03}", offset);
+    }
+
+    std::string read_file(const std::filesystem::path& path) {
+        std::ifstream in(path, std::ios::binary);
+        return std::string(std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>());
+    }
+
+    std::filesystem::path segment_path(const std::string& dir, uint64_t base) {
+        return std::format("{}/{:020}.log", dir, base);
+    }
+
+    void fill(const std::string& dir) {
+        CommitLog log(dir, segmentSize);
+        for (uint64_t i = 0; i < recordCount; ++i)
+            check(log.append({}, value_of(i)).has_value(), "append before the crash");
+        log.sync();
+    }
+
+    bool holds_every_record(const CommitLog& log) {
+        std::vector<LogRecord> all;
+        while (all.size() < recordCount) {
+            std::vector<LogRecord> got = log.read(all.size(), recordCount, segmentSize * recordCount);
+            if (got.empty())
+                break;
+            for (LogRecord& record : got)
+                all.push_back(std::move(record));
+        }
+        if (all.size() != recordCount)
+            return false;
+        for (uint64_t i = 0; i < recordCount; ++i) {
+            if (all[i].offset != i || std::string_view(all[i].value) != value_of(i))
+                return false;
+        }
+        return true;
+    }
+
+    // a record cut short at the end of the tail segment is dropped on reopen, and appends carry on
+    // from the last whole record
+    void test_torn_tail(const std::string& dir) {
+        fill(dir);
+
+        std::vector<uint64_t> bases = list_segment_offsets(dir);
+        check(bases.size() > 2, "the records span several segments");
+        const std::filesystem::path tail = segment_path(dir, bases.back());
+
+        std::string bytes = read_file(tail);
+        uint64_t next = bases.back();
+        size_t end = CommitLog::scan_segment(bytes.data(), bytes.size(), next);
+        check(next == recordCount, "the tail segment ends at the last appended record");
+
+        // the header and part of the value of a record the crash interrupted
+        LogRecordHeader torn{};
+        torn.length = 64;
+        torn.crc = 0x12345678;
+        torn.offset = recordCount;
+        torn.valueLength = 36;
+        {
+            std::fstream out(tail, std::ios::in | std::ios::out | std::ios::binary);
+            out.seekp(static_cast<std::streamoff>(end));
+            out.write(reinterpret_cast<const char*>(&torn), sizeof(torn));
+            out.write("partial", 7);
+        }
+
+        {
+            CommitLog log(dir, segmentSize);
+            check(log.usable(), "a torn tail does not fail recovery");
+            check(log.next_offset() == recordCount, "next offset is one past the last whole record");
+            check(holds_every_record(log), "every whole record reads back intact after the reopen");
+
+            auto appended = log.append({}, value_of(recordCount));
+            check(appended && appended->firstOffset == recordCount, "the next append takes the torn record's offset");
+        }
+
+        std::string reopened = read_file(tail);
+        check(reopened.compare(0, end, bytes, 0, end) == 0, "the records before the torn one are unchanged on disk");
+
+        CommitLog log(dir, segmentSize);
+        std::vector<LogRecord> got = log.read(recordCount, 1, segmentSize);
+        check(log.next_offset() == recordCount + 1 && got.size() == 1 && got[0].offset == recordCount &&
+            std::string_view(got[0].value) == value_of(recordCount), "the record appended after recovery survives another reopen");
+    }
+
+    // a tail segment that cannot be opened leaves the next offset unknown, so the log refuses
+    // appends instead of starting over at offset 0
+    void test_unopenable_tail(const std::string& dir) {
+        fill(dir);
+
+        std::vector<uint64_t> bases = list_segment_offsets(dir);
+        const std::filesystem::path tail = segment_path(dir, bases.back());
+        std::error_code ec;
+        std::filesystem::remove(tail, ec);
+        std::filesystem::create_directory(tail, ec);
+        check(!ec, "replace the tail segment with a directory");
+
+        const std::string first = read_file(segment_path(dir, bases.front()));
+        {
+            CommitLog log(dir, segmentSize);
+            check(!log.usable(), "recovery fails when the tail segment cannot be opened");
+            check(!log.append({}, "after").has_value(), "append after a failed recovery is refused");
+            check(!log.append_batch({ "a", "b" }).has_value(), "batch append after a failed recovery is refused");
+        }
+        check(read_file(segment_path(dir, bases.front())) == first, "the first segment is not overwritten");
+        check(list_segment_offsets(dir) == bases, "no segment is added");
+    }
+}
+
+int main(int argc, char* argv[]) {
+    std::string dir = "commit-log-data";
+    for (int i = 1; i < argc; ++i) {
+        std::string_view arg = argv[i];
+        if (arg.starts_with("--dir=")) dir = arg.substr(6);
+        else {
+            std::cerr << "usage: commit_log_test [--dir=commit-log-data]" << std::endl;
+            return 1;
+        }
+    }
+
+    std::error_code ec;
+    std::filesystem::remove_all(dir, ec);
+    test_torn_tail(dir + "/torn-tail");
+    test_unopenable_tail(dir + "/unopenable-tail");
+
+    std::cout << (failures == 0 ? "all passed" : std::format("{} failed", failures)) << std::endl;
+    return failures == 0 ? 0 : 1;
+}
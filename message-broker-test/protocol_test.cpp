@@ -0,0 +1,171 @@
+// Binary requests sent as frame bytes through CommandHandler, the way an engine hands them over,
+// and checked on the response frame it would send back. After the memory-only cases the broker
+// gets storage under --dir, with durability none so produces are answered right away.
+//
+//   protocol_test [--dir=protocol-data]
+
+#include <iostream>
+#include <string>
+#include <string_view>
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <optional>
+#include <chrono>
+#include <cstring>
+#include <format>
+#include <filesystem>
+#include <system_error>
+
+#include "protocol.h"
+#include "topic_manager.h"
+#include "async_logger.h"
+#include "test_connection.h"
+
+std::mutex cout_mutex;
+
+namespace {
+    using protocol::RequestType;
+    using protocol::Status;
+
+    constexpr size_t segmentSize = 1024 * 1024;
+    constexpr size_t queueCapacity = 16;
+
+    int failures = 0;
+
+    void check(bool ok, std::string_view what) {
+        if (ok)
+            return;
+        ++failures;
+        std::cout << "FAIL " << what << std::endl;
+    }
+
+    int64_t now_ms() {
+        return std::chrono::duration_cast<std::chrono::milliseconds>(
+            std::chrono::system_clock::now().time_since_epoch()).count();
+    }
+
+    std::optional<uint64_t> offset_for_time(Connection& connection, std::string_view topic, int64_t timestamp, uint32_t partition = 0) {
+        PooledString payload;
+        protocol::encode_offset_for_time(payload, timestamp, partition);
+        Reply reply = connection.send(RequestType::OffsetForTime, topic, payload);
+        uint64_t offset = 0;
+        if (reply.status != Status::Ok || !protocol::parse_u64(reply.payload, offset))
+            return std::nullopt;
+        return offset;
+    }
+
+    // OFFSET_FOR_TIME finds where records produced after a point in time start, and FETCH_LOG
+    // reads them from there
+    void test_offset_for_time() {
+        Connection connection;
+        const std::string topic = "offset-for-time";
+
+        check(connection.send(RequestType::ProduceBatch, topic, records("a", 4)).status == Status::Ok, "produce before");
+        // timestamps have millisecond resolution
+        std::this_thread::sleep_for(std::chrono::milliseconds(5));
+        int64_t between = now_ms();
+        std::this_thread::sleep_for(std::chrono::milliseconds(5));
+        check(connection.send(RequestType::ProduceBatch, topic, records("b", 4)).status == Status::Ok, "produce after");
+
+        check(offset_for_time(connection, topic, 0) == 0u, "timestamp before the log starts at offset 0");
+        check(offset_for_time(connection, topic, between) == 4u, "timestamp between the batches starts at the second");
+        check(offset_for_time(connection, topic, now_ms() + 3600 * 1000) == 8u, "timestamp after every record is the next offset");
+
+        PooledString fetch;
+        protocol::encode_fetch_log(fetch, 4, 4096);
+        Reply reply = connection.send(RequestType::FetchLog, topic, fetch);
+        check(reply.status == Status::Ok && reply.payload.size() >= sizeof(LogRecordHeader), "fetch log from the offset");
+        if (reply.payload.size() >= sizeof(LogRecordHeader)) {
+            LogRecordHeader header;
+            std::memcpy(&header, reply.payload.data(), sizeof(header));
+            std::string_view value(reply.payload.data() + sizeof(header) + header.key_size(), header.valueLength);
+            check(header.offset == 4 && header.timestamp >= between && value == "b0", "first fetched record is the first one after the timestamp");
+        }
+
+        check(!offset_for_time(connection, "no-such-topic", 0), "unknown topic");
+        check(connection.send(RequestType::OffsetForTime, "no-such-topic", std::string(8, '\0')).status == Status::NoTopic, "unknown topic is NO_TOPIC");
+        check(!offset_for_time(connection, topic, 0, 7), "unknown partition");
+        check(connection.send(RequestType::OffsetForTime, topic, "short").status == Status::InvalidRequest, "short payload is INVALID_REQUEST");
+    }
+
+    // a record the commit log cannot take fails the produce, and none of its batch is logged or queued
+    void test_storage_error() {
+        Connection connection;
+        const std::string topic = "storage-error";
+
+        PooledString batch;
+        protocol::append_record(batch, "fits");
+        protocol::append_record(batch, std::string(segmentSize + 1, 'x'));
+        check(connection.send(RequestType::ProduceBatch, topic, batch).status == Status::StorageError, "record larger than a segment is STORAGE_ERROR");
+
+        check(connection.send(RequestType::Publish, topic, std::string(segmentSize + 1, 'x')).status == Status::StorageError, "publish larger than a segment is STORAGE_ERROR");
+
+        protocol::FetchParams params;
+        params.maxRecords = 16;
+        PooledString fetch;
+        protocol::encode_fetch_params(fetch, params);
+        check(connection.send(RequestType::FetchBatch, topic, fetch).status == Status::NoMessages, "failed records are not queued");
+
+        check(connection.send(RequestType::ProduceBatch, topic, records("c", 2)).status == Status::Ok, "produce after a failure");
+        Reply reply = connection.send(RequestType::FetchBatch, topic, fetch);
+        std::vector<std::string_view> fetched;
+        check(reply.status == Status::Ok && protocol::parse_records(reply.payload, fetched) && fetched.size() == 2 && fetched[0] == "c0",
+            "only the records of the successful produce are queued");
+
+        std::vector<FetchedRecord> logged = fetch_log(connection, topic, 0, static_cast<uint32_t>(segmentSize));
+        check(logged.size() == 2 && logged[0].offset == 0 && logged[0].value == "c0" && logged[1].value == "c1",
+            "the log holds only the records of the successful produce");
+    }
+
+    // a memory-only partition refuses records its queue has no room for instead of dropping queued ones
+    void test_queue_full() {
+        Connection connection;
+        const std::string topic = "queue-full";
+
+        check(connection.send(RequestType::ProduceBatch, topic, records("q", queueCapacity)).status == Status::Ok, "produce fills the queue");
+        check(connection.send(RequestType::ProduceBatch, topic, records("r", 1)).status == Status::QueueFull, "produce to a full queue is QUEUE_FULL");
+
+        protocol::FetchParams params;
+        params.maxRecords = static_cast<uint32_t>(queueCapacity + 1);
+        PooledString fetch;
+        protocol::encode_fetch_params(fetch, params);
+        Reply reply = connection.send(RequestType::FetchBatch, topic, fetch);
+        std::vector<std::string_view> fetched;
+        check(reply.status == Status::Ok && protocol::parse_records(reply.payload, fetched) && fetched.size() == queueCapacity &&
+            fetched.front() == "q0" && fetched.back() == std::format("q{}", queueCapacity - 1), "a full queue keeps what it had");
+
+        check(connection.send(RequestType::ProduceBatch, topic, records("r", 1)).status == Status::Ok, "produce once the queue drained");
+    }
+}
+
+int main(int argc, char* argv[]) {
+    std::string dir = "protocol-data";
+    for (int i = 1; i < argc; ++i) {
+        std::string_view arg = argv[i];
+        if (arg.starts_with("--dir=")) dir = arg.substr(6);
+        else {
+            std::cerr << "usage: protocol_test [--dir=protocol-data]" << std::endl;
+            return 1;
+        }
+    }
+
+    AsyncLogger::get_instance().set_level(LogLevel::Off);
+
+    // topics created before init_storage are memory-only
+    TopicManager::get_instance().set_queue_capacity(queueCapacity);
+    test_queue_full();
+    TopicManager::get_instance().set_queue_capacity(TopicQueue::defaultCapacity);
+
+    std::error_code ec;
+    std::filesystem::remove_all(dir, ec);
+    DurabilityPolicy durability;
+    durability.mode = DurabilityPolicy::Mode::None;
+    TopicManager::get_instance().init_storage(dir, segmentSize, durability);
+
+    test_offset_for_time();
+    test_storage_error();
+
+    std::cout << (failures == 0 ? "all passed" : std::format("{} failed", failures)) << std::endl;
+    return failures == 0 ? 0 : 1;
+}
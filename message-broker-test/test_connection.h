@@ -0,0 +1,110 @@
+#pragma once
+
+// A binary client connection without a socket: requests are sent as frame bytes through
+// CommandHandler, the way an engine hands them over, and answered with the frame it would send back.
+
+#include <string>
+#include <string_view>
+#include <vector>
+#include <memory>
+#include <cstring>
+#include <format>
+
+#include "protocol.h"
+#include "buffer_pool.h"
+#include "client_context.h"
+#include "command_handler.h"
+#include "commit_log.h"
+#include "segment_cache.h"
+
+// the response frame as a client would read it
+struct Reply {
+    protocol::Status status = protocol::Status::Ok;
+    bool deferred = false;
+    std::string payload;
+};
+
+class Connection {
+public:
+    Connection() : context(BufferPool::get_instance(), nullptr) {
+        context.mode = protocol::Mode::Binary;
+        context.command_handler = std::make_unique<CommandHandler>();
+    }
+
+    Reply send(protocol::RequestType type, std::string_view topic, std::string_view payload) {
+        protocol::Request request;
+        request.type = type;
+        request.correlationId = ++correlation;
+        request.topic = topic;
+        request.payload = payload;
+        PooledString frame;
+        protocol::encode_request(frame, request);
+
+        protocol::Request parsed;
+        size_t consumed = 0;
+        Reply reply;
+        if (protocol::parse_frame(frame, parsed, consumed) != protocol::ParseResult::Ok) {
+            reply.status = protocol::Status::InvalidRequest;
+            return reply;
+        }
+        protocol::Response response = context.command_handler->handle_command(parsed, &context);
+        reply.deferred = response.deferred;
+        if (response.deferred)
+            return reply;
+
+        PooledString out;
+        protocol::encode_response(out, parsed, response);
+        // shared records and a FETCH_LOG's file range go out right behind the frame's own bytes
+        for (const SharedMessage& record : response.records)
+            out.append(record.record());
+        if (response.file)
+            out.append(std::string_view(response.file->segment->file->data() + response.file->offset, response.file->length));
+        protocol::Request answer;
+        if (protocol::parse_frame(out, answer, consumed) != protocol::ParseResult::Ok || answer.correlationId != correlation) {
+            reply.status = protocol::Status::InvalidRequest;
+            return reply;
+        }
+        reply.status = protocol::frame_status(out);
+        reply.payload.assign(answer.payload);
+        return reply;
+    }
+
+private:
+    ClientContext context;
+    uint32_t correlation = 0;
+};
+
+inline PooledString records(std::string_view prefix, size_t count) {
+    PooledString batch;
+    for (size_t i = 0; i < count; ++i)
+        protocol::append_record(batch, std::format("{}{}", prefix, i));
+    return batch;
+}
+
+struct FetchedRecord {
+    uint64_t offset;
+    std::string key;
+    std::string value;
+};
+
+// uncompressed records of a FETCH_LOG response
+inline std::vector<FetchedRecord> log_records(std::string_view payload) {
+    std::vector<FetchedRecord> fetched;
+    size_t position = 0;
+    while (position + sizeof(LogRecordHeader) <= payload.size()) {
+        LogRecordHeader header;
+        std::memcpy(&header, payload.data() + position, sizeof(header));
+        const char* key = payload.data() + position + sizeof(header);
+        fetched.push_back({ header.offset, std::string(key, header.key_size()), std::string(key + header.key_size(), header.valueLength) });
+        position += sizeof(uint32_t) + header.length;
+    }
+    return fetched;
+}
+
+// the records of one segment from offset on; empty on an error or past the end of the log
+inline std::vector<FetchedRecord> fetch_log(Connection& connection, std::string_view topic, uint64_t offset, uint32_t maxBytes, uint32_t partition = 0) {
+    PooledString fetch;
+    protocol::encode_fetch_log(fetch, offset, maxBytes, partition);
+    Reply reply = connection.send(protocol::RequestType::FetchLog, topic, fetch);
+    return reply.status == protocol::Status::Ok ? log_records(reply.payload) : std::vector<FetchedRecord>();
+}
@@ -0,0 +1,354 @@
+#include "async_logger.h"
+#include "disk_handler.h"
+
+#include <chrono>
+#include <charconv>
+#include <algorithm>
+#include <cstring>
+#include <ctime>
+
+namespace {
+    // u32 size | u8 level | format pointer | i64 time ns
+    constexpr size_t sizeField = 0;
+    constexpr size_t levelField = 4;
+    constexpr size_t formatField = 5;
+    constexpr size_t timeField = formatField + sizeof(const char*);
+    constexpr size_t entryHeaderSize = timeField + sizeof(int64_t);
+
+    // strings that do not fit in the entry are cut and end in "..."
+    constexpr size_t truncationMark = 3;
+}
+
+// single producer (the owning thread), single consumer (the drain thread)
+struct LogThreadBuffer {
+    static constexpr size_t capacity = 256 * 1024;
+
+    std::unique_ptr<char[]> data{ new char[capacity] };
+    alignas(64) std::atomic<size_t> head{ 0 };
+    alignas(64) std::atomic<size_t> tail{ 0 };
+    std::atomic<uint64_t> dropped{ 0 };
+    std::atomic<uint64_t> suppressed{ 0 };
+    std::atomic<bool> retired{ false };
+    // set when the producer woke the drain thread early, cleared by the drain
+    std::atomic<bool> nudged{ false };
+
+    // sampling window, owning thread only
+    int64_t windowSecond = -1;
+    uint32_t windowCount = 0;
+
+    // false when the ring has no room for the entry
+    bool push(const char* bytes, size_t size) {
+        size_t h = head.load(std::memory_order_relaxed);
+        if (capacity - (h - tail.load(std::memory_order_acquire)) < size)
+            return false;
+
+        size_t at = h % capacity;
+        size_t first = std::min(size, capacity - at);
+        std::memcpy(data.get() + at, bytes, first);
+        std::memcpy(data.get(), bytes + first, size - first);
+        head.store(h + size, std::memory_order_release);
+        return true;
+    }
+
+    void copy_out(size_t position, char* out, size_t size) const {
+        size_t at = position % capacity;
+        size_t first = std::min(size, capacity - at);
+        std::memcpy(out, data.get() + at, first);
+        std::memcpy(out + first, data.get(), size - first);
+    }
+};
+
+namespace {
+    // marks the thread's buffer retired at thread exit so the drain thread can drop it once empty
+    struct LocalBuffer {
+        std::shared_ptr<LogThreadBuffer> buffer;
+        ~LocalBuffer() {
+            if (buffer)
+                buffer->retired.store(true, std::memory_order_release);
+        }
+    };
+
+    struct PendingEntry {
+        int64_t timeNs;
+        LogLevel level;
+        const char* format;
+        std::string args;
+    };
+
+    void append_arg(std::string& out, std::string_view& args) {
+        if (args.empty())
+            return;
+
+        char tag = args[0];
+        args.remove_prefix(1);
+        char digits[32];
+
+        if (tag == 's') {
+            uint32_t length;
+            std::memcpy(&length, args.data(), sizeof(length));
+            out.append(args.substr(sizeof(length), length));
+            args.remove_prefix(sizeof(length) + length);
+            return;
+        }
+
+        std::to_chars_result result{};
+        if (tag == 'i') {
+            int64_t value;
+            std::memcpy(&value, args.data(), sizeof(value));
+            result = std::to_chars(digits, digits + sizeof(digits), value);
+        }
+        else if (tag == 'u') {
+            uint64_t value;
+            std::memcpy(&value, args.data(), sizeof(value));
+            result = std::to_chars(digits, digits + sizeof(digits), value);
+        }
+        else {
+            double value;
+            std::memcpy(&value, args.data(), sizeof(value));
+            result = std::to_chars(digits, digits + sizeof(digits), value);
+        }
+        out.append(digits, result.ptr);
+        args.remove_prefix(8);
+    }
+
+    // "{}" takes the next argument, "{{" and "}}" are literal braces
+    void format_entry(std::string& out, const char* format, std::string_view args) {
+        for (const char* p = format; *p; ++p) {
+            if (p[0] == '{' && p[1] == '}') {
+                append_arg(out, args);
+                ++p;
+            }
+            else if ((p[0] == '{' && p[1] == '{') || (p[0] == '}' && p[1] == '}')) {
+                out.push_back(*p);
+                ++p;
+            }
+            else
+                out.push_back(*p);
+        }
+    }
+}
+
+LogEntryWriter::LogEntryWriter(LogLevel level, const char* format)
+    : length(entryHeaderSize), entryLevel(level) {
+    timeNs = std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::system_clock::now().time_since_epoch()).count();
+    buffer[levelField] = static_cast<char>(level);
+    std::memcpy(buffer + formatField, &format, sizeof(format));
+    std::memcpy(buffer + timeField, &timeNs, sizeof(timeNs));
+}
+
+const char* LogEntryWriter::finish() {
+    uint32_t size = static_cast<uint32_t>(length);
+    std::memcpy(buffer + sizeField, &size, sizeof(size));
+    return buffer;
+}
+
+void LogEntryWriter::add(std::string_view value) {
+    constexpr size_t overhead = 1 + sizeof(uint32_t);
+    if (length + overhead > maxSize)
+        return;
+
+    size_t room = maxSize - length - overhead;
+    if (room < truncationMark)
+        return;
+    bool truncated = value.size() > room;
+    if (truncated)
+        value = value.substr(0, room - truncationMark);
+
+    uint32_t size = static_cast<uint32_t>(value.size() + (truncated ? truncationMark : 0));
+    buffer[length] = 's';
+    std::memcpy(buffer + length + 1, &size, sizeof(size));
+    std::memcpy(buffer + length + overhead, value.data(), value.size());
+    length += overhead + value.size();
+    if (truncated) {
+        std::memcpy(buffer + length, "...", truncationMark);
+        length += truncationMark;
+    }
+}
+
+AsyncLogger& AsyncLogger::get_instance() {
+    static AsyncLogger instance;
+    return instance;
+}
+
+AsyncLogger::~AsyncLogger() {
+    stop();
+}
+
+void AsyncLogger::start(std::shared_ptr<DiskHandler> diskHandler) {
+    disk_handler = std::move(diskHandler);
+    drainThread = std::jthread([this] { drain_loop(); });
+}
+
+void AsyncLogger::stop() {
+    if (!drainThread.joinable())
+        return;
+    {
+        std::lock_guard<std::mutex> lock(drainMutex);
+        stopDrain = true;
+    }
+    drainCv.notify_all();
+    drainThread.join();
+}
+
+std::optional<LogLevel> AsyncLogger::parse_level(std::string_view name) {
+    if (name == "debug") return LogLevel::Debug;
+    if (name == "info") return LogLevel::Info;
+    if (name == "warn") return LogLevel::Warn;
+    if (name == "error") return LogLevel::Error;
+    if (name == "off") return LogLevel::Off;
+    return std::nullopt;
+}
+
+const char* AsyncLogger::level_name(LogLevel level) {
+    switch (level) {
+    case LogLevel::Debug: return "debug";
+    case LogLevel::Info: return "info";
+    case LogLevel::Warn: return "warn";
+    case LogLevel::Error: return "error";
+    default: return "off";
+    }
+}
+
+LogThreadBuffer& AsyncLogger::local_buffer() {
+    thread_local LocalBuffer local;
+    if (!local.buffer) {
+        local.buffer = std::make_shared<LogThreadBuffer>();
+        std::lock_guard<std::mutex> lock(buffersMutex);
+        buffers.push_back(local.buffer);
+    }
+    return *local.buffer;
+}
+
+void AsyncLogger::submit(LogEntryWriter& entry) {
+    LogThreadBuffer& buffer = local_buffer();
+
+    uint32_t limit = rateLimit.load(std::memory_order_relaxed);
+    if (limit > 0 && entry.level() < LogLevel::Warn) {
+        int64_t second = entry.time_ns() / 1000000000;
+        if (second != buffer.windowSecond) {
+            buffer.windowSecond = second;
+            buffer.windowCount = 0;
+        }
+        if (++buffer.windowCount > limit) {
+            buffer.suppressed.fetch_add(1, std::memory_order_relaxed);
+            return;
+        }
+    }
+
+    if (!buffer.push(entry.finish(), entry.size())) {
+        buffer.dropped.fetch_add(1, std::memory_order_relaxed);
+        return;
+    }
+
+    // a burst fills the ring faster than the drain interval, so wake the drain thread once it is half full
+    size_t used = buffer.head.load(std::memory_order_relaxed) - buffer.tail.load(std::memory_order_relaxed);
+    if (used > LogThreadBuffer::capacity / 2 && !buffer.nudged.exchange(true, std::memory_order_relaxed))
+        drainCv.notify_one();
+}
+
+void AsyncLogger::drain_loop() {
+    std::unique_lock<std::mutex> lock(drainMutex);
+    while (!stopDrain) {
+        drainCv.wait_for(lock, std::chrono::milliseconds(10));
+        lock.unlock();
+        drain();
+        lock.lock();
+    }
+    lock.unlock();
+    drain();
+}
+
+// collects every queued entry, orders them by time across threads and appends them to the log
+void AsyncLogger::drain() {
+    std::vector<std::shared_ptr<LogThreadBuffer>> snapshot;
+    {
+        std::lock_guard<std::mutex> lock(buffersMutex);
+        snapshot = buffers;
+    }
+
+    std::vector<PendingEntry> pending;
+    uint64_t dropped = 0;
+    uint64_t suppressed = 0;
+
+    for (const auto& buffer : snapshot) {
+        size_t tail = buffer->tail.load(std::memory_order_relaxed);
+        size_t head = buffer->head.load(std::memory_order_acquire);
+        char header[entryHeaderSize];
+
+        while (tail < head) {
+            buffer->copy_out(tail, header, entryHeaderSize);
+            uint32_t size;
+            std::memcpy(&size, header + sizeField, sizeof(size));
+
+            PendingEntry entry;
+            entry.level = static_cast<LogLevel>(header[levelField]);
+            std::memcpy(&entry.format, header + formatField, sizeof(entry.format));
+            std::memcpy(&entry.timeNs, header + timeField, sizeof(entry.timeNs));
+            entry.args.resize(size - entryHeaderSize);
+            buffer->copy_out(tail + entryHeaderSize, entry.args.data(), entry.args.size());
+            pending.push_back(std::move(entry));
+            tail += size;
+        }
+        buffer->tail.store(tail, std::memory_order_release);
+        buffer->nudged.store(false, std::memory_order_relaxed);
+
+        dropped += buffer->dropped.exchange(0, std::memory_order_relaxed);
+        suppressed += buffer->suppressed.exchange(0, std::memory_order_relaxed);
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(buffersMutex);
+        std::erase_if(buffers, [](const std::shared_ptr<LogThreadBuffer>& buffer) {
+            return buffer->retired.load(std::memory_order_acquire) &&
+                buffer->tail.load(std::memory_order_relaxed) == buffer->head.load(std::memory_order_acquire);
+        });
+    }
+
+    if (!disk_handler || (pending.empty() && dropped == 0 && suppressed == 0))
+        return;
+
+    std::stable_sort(pending.begin(), pending.end(), [](const PendingEntry& a, const PendingEntry& b) {
+        return a.timeNs < b.timeNs;
+    });
+
+    std::string line;
+    for (const PendingEntry& entry : pending) {
+        line.clear();
+        line.append("[").append(level_name(entry.level)).append("] timestamp: ");
+        line.append(timestamp(entry.timeNs)).append(", message: ");
+        format_entry(line, entry.format, entry.args);
+        line.push_back('\n');
+        disk_handler->append(line);
+    }
+
+    if (dropped > 0 || suppressed > 0) {
+        int64_t now = std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::system_clock::now().time_since_epoch()).count();
+        line.clear();
+        line.append("[warn] timestamp: ").append(timestamp(now)).append(", message: log entries dropped: ");
+        line.append(std::to_string(dropped)).append(", sampled out: ").append(std::to_string(suppressed)).push_back('\n');
+        disk_handler->append(line);
+    }
+}
+
+// localtime and strftime only run when the second changes
+const std::string& AsyncLogger::timestamp(int64_t timeNs) {
+    int64_t second = timeNs / 1000000000;
+    if (second == cachedSecond)
+        return cachedTimestamp;
+
+    std::time_t seconds = static_cast<std::time_t>(second);
+    std::tm local_tm;
+#ifdef _WIN32
+    localtime_s(&local_tm, &seconds);
+#else
+    localtime_r(&seconds, &local_tm);
+#endif
+
+    char time_buf[32];
+    std::strftime(time_buf, sizeof(time_buf), "%Y-%m-%d %H:%M:%S", &local_tm);
+    cachedSecond = second;
+    cachedTimestamp = time_buf;
+    return cachedTimestamp;
+}
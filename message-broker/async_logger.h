@@ -0,0 +1,134 @@
+#pragma once
+
+#include <string>
+#include <string_view>
+#include <memory>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <thread>
+#include <vector>
+#include <optional>
+#include <concepts>
+#include <cstdint>
+#include <cstddef>
+#include <cstring>
+
+class DiskHandler;
+struct LogThreadBuffer;
+
+enum class LogLevel : uint8_t { Debug, Info, Warn, Error, Off };
+
+// format string of a log call, "{}" per argument. Only literals qualify (consteval) because the
+// drain thread formats the entry long after the call returned.
+struct LogFormat {
+    consteval LogFormat(const char* text) : text(text) {}
+    const char* text;
+};
+
+// binary entry built on the caller's stack: header, then tagged arguments
+class LogEntryWriter {
+public:
+    static constexpr size_t maxSize = 1024;
+
+    LogEntryWriter(LogLevel level, const char* format);
+
+    template <std::integral T>
+    void add(T value) {
+        if constexpr (std::is_signed_v<T>)
+            put('i', static_cast<int64_t>(value));
+        else
+            put('u', static_cast<uint64_t>(value));
+    }
+    void add(double value) { put('f', value); }
+    void add(std::string_view value);
+
+    // stamps the entry size into the header
+    const char* finish();
+    size_t size() const { return length; }
+    LogLevel level() const { return entryLevel; }
+    int64_t time_ns() const { return timeNs; }
+
+private:
+    char buffer[maxSize];
+    size_t length = 0;
+    LogLevel entryLevel;
+    int64_t timeNs;
+
+    template <typename T>
+    void put(char tag, T value) {
+        if (length + 1 + sizeof(value) > maxSize)
+            return;
+        buffer[length] = tag;
+        std::memcpy(buffer + length + 1, &value, sizeof(value));
+        length += 1 + sizeof(value);
+    }
+};
+
+// Diagnostic logger kept off the request path: callers encode the format pointer and binary
+// arguments into a per-thread lock-free ring, one drain thread formats the entries and appends
+// them to the DiskHandler log. Entries below Warn are sampled per thread when a rate limit is
+// set; a full ring drops the entry. Both are counted and reported in the log.
+class AsyncLogger {
+public:
+    static AsyncLogger& get_instance();
+
+    // entries logged before start wait in their thread's ring
+    void start(std::shared_ptr<DiskHandler> diskHandler);
+    // drains what is queued and joins the drain thread
+    void stop();
+
+    void set_level(LogLevel level) { minLevel.store(level, std::memory_order_relaxed); }
+    bool enabled(LogLevel level) const { return level >= minLevel.load(std::memory_order_relaxed); }
+    // entries per second and thread below Warn, 0 for no limit
+    void set_rate_limit(uint32_t perSecond) { rateLimit.store(perSecond, std::memory_order_relaxed); }
+
+    template <typename... Args>
+    void log(LogLevel level, LogFormat format, const Args&... args) {
+        if (!enabled(level))
+            return;
+        LogEntryWriter entry(level, format.text);
+        (entry.add(args), ...);
+        submit(entry);
+    }
+
+    static std::optional<LogLevel> parse_level(std::string_view name);
+    static const char* level_name(LogLevel level);
+
+private:
+    AsyncLogger() = default;
+    ~AsyncLogger();
+    AsyncLogger(const AsyncLogger&) = delete;
+    AsyncLogger& operator=(const AsyncLogger&) = delete;
+
+    std::atomic<LogLevel> minLevel{ LogLevel::Info };
+    std::atomic<uint32_t> rateLimit{ 1000 };
+
+    std::mutex buffersMutex;
+    std::vector<std::shared_ptr<LogThreadBuffer>> buffers;
+
+    std::shared_ptr<DiskHandler> disk_handler;
+    std::mutex drainMutex;
+    std::condition_variable drainCv;
+    bool stopDrain = false;
+    std::jthread drainThread;
+
+    // drain thread only
+    int64_t cachedSecond = -1;
+    std::string cachedTimestamp;
+
+    void submit(LogEntryWriter& entry);
+    LogThreadBuffer& local_buffer();
+    void drain_loop();
+    void drain();
+    const std::string& timestamp(int64_t timeNs);
+};
+
+template <typename... Args>
+void log_debug(LogFormat format, const Args&... args) { AsyncLogger::get_instance().log(LogLevel::Debug, format, args...); }
+template <typename... Args>
+void log_info(LogFormat format, const Args&... args) { AsyncLogger::get_instance().log(LogLevel::Info, format, args...); }
+template <typename... Args>
+void log_warn(LogFormat format, const Args&... args) { AsyncLogger::get_instance().log(LogLevel::Warn, format, args...); }
+template <typename... Args>
+void log_error(LogFormat format, const Args&... args) { AsyncLogger::get_instance().log(LogLevel::Error, format, args...); }
@@ -1,148 +1,32 @@
 #include <iostream>
 #include <string>
+#include <string_view>
 #include <thread>
-#include <winsock2.h>
 #include <memory>
 #include <map>
 #include <atomic>
 #include <mutex>
 #include <random>
+#include <charconv>
+#include <vector>
+#include <future>
+#include <algorithm>
 
+#include "platform.h"
 #include "topic_manager.h"
 #include "buffer_pool.h"
 #include "command_handler.h"
+#include "net_engine.h"
+#include "consumer_group.h"
+#include "async_logger.h"
+#include "shard_runtime.h"
+#include "compression.h"
+#include "crc32c.h"
+#include "line_scan.h"
 
-
-#pragma comment(lib, "Ws2_32.lib")
-
-HANDLE hCompletionPort = NULL;
-std::atomic<bool> running(true);
 std::mutex cout_mutex;
 
 
-void iocp_worker(HANDLE hCompletionPort) {
-    DWORD bytesTransferred;
-    ULONG_PTR completionKey;
-    LPOVERLAPPED overlapped;
-    ClientContext* context;
-
-    while (running) {
-        if (!GetQueuedCompletionStatus(hCompletionPort, &bytesTransferred, &completionKey, &overlapped, INFINITE)) {
-            std::lock_guard<std::mutex> lock(cout_mutex);
-            std::cerr << "[error] GetQueuedCompletionStatus: " << GetLastError() << std::endl;
-            continue;
-        }
-
-        context = reinterpret_cast<ClientContext*>(completionKey);
-
-        if (overlapped == &context->recv_overlapped) {
-            if (bytesTransferred == 0) {
-                std::lock_guard<std::mutex> lock(cout_mutex);
-                std::cerr << "[" << context->sock << "] connection closed." << std::endl;
-                closesocket(context->sock);
-                continue;
-            }
-
-            std::string receivedData(context->buffer, bytesTransferred);
-            std::string response = context->command_handler->handle_command(receivedData, context);
-
-            if (!response.empty()) {
-                WSABUF wsabuf;
-                wsabuf.buf = const_cast<char*>(response.c_str());
-                wsabuf.len = static_cast<ULONG>(response.size());
-
-                DWORD bytesSent = 0;
-                DWORD flags = 0;
-
-                ZeroMemory(&context->send_overlapped, sizeof(OVERLAPPED));
-                int sendResult = WSASend(context->sock, &wsabuf, 1, &bytesSent, flags, &context->send_overlapped, NULL);
-
-                if (sendResult == SOCKET_ERROR && WSAGetLastError() != WSA_IO_PENDING) {
-                    std::lock_guard<std::mutex> lock(cout_mutex);
-                    std::cerr << "[" << context->sock << " error] WSASend: " << WSAGetLastError() << std::endl;
-                    closesocket(context->sock);
-                    continue;
-                }
-
-                if (response != "NO_MESSAGES") {
-                    std::lock_guard<std::mutex> lock(cout_mutex);
-                    std::cout << "[" << context->sock << "] sent: " << response << std::endl;
-                }
-            }
-
-            ZeroMemory(&context->recv_overlapped, sizeof(OVERLAPPED));
-            WSABUF wsabuf;
-            wsabuf.buf = context->buffer;
-            wsabuf.len = sizeof(context->buffer);
-
-            DWORD flags = 0;
-            DWORD recvBytes = 0;
-            int result = WSARecv(context->sock, &wsabuf, 1, &recvBytes, &flags, &context->recv_overlapped, NULL);
-            if (result == SOCKET_ERROR && WSAGetLastError() != WSA_IO_PENDING) {
-                std::lock_guard<std::mutex> lock(cout_mutex);
-                std::cerr << "[" << context->sock << "] WSARecv failed: " << WSAGetLastError() << std::endl;
-                closesocket(context->sock);
-            }
-        }
-        else if (overlapped == &context->send_overlapped) {
-            // std::cout << "[" << context->sock << "] send complete." << std::endl;
-        }
-        else {
-            std::lock_guard<std::mutex> lock(cout_mutex);
-            std::cerr << "[" << context->sock << "] unknown" << std::endl;
-        }
-    }
-}
-
-
-bool init_iocp(SOCKET& listenSocket) {
-    hCompletionPort = CreateIoCompletionPort(INVALID_HANDLE_VALUE, NULL, 0, 0);
-    if (hCompletionPort == NULL) {
-        std::lock_guard<std::mutex> lock(cout_mutex);
-        std::cerr << "[error] hCompletionPort: " << GetLastError() << std::endl;
-        return false;
-    }
-
-    return true;
-}
-
-void client_connection_handler(SOCKET clientSocket, BufferPool& bufferPool, std::shared_ptr<DiskHandler> sharedDiskHandler) {
-    std::lock_guard<std::mutex> lock(cout_mutex);
-    std::cout << "[info] client_connection_handler: " << clientSocket << std::endl;
-
-    ClientContext* context = new ClientContext(bufferPool, sharedDiskHandler);
-    context->sock = clientSocket;
-    context->command_handler = std::make_unique<CommandHandler>(context->disk_handler);
-
-    if (CreateIoCompletionPort((HANDLE)clientSocket, hCompletionPort, (ULONG_PTR)context, 0) == NULL) {
-        std::lock_guard<std::mutex> lock(cout_mutex);
-        std::cerr << "[error] CreateIoCompletionPort: " << GetLastError() << std::endl;
-        closesocket(clientSocket);
-        delete context;
-        return;
-    }
-
-    ZeroMemory(&context->recv_overlapped, sizeof(OVERLAPPED));
-
-    WSABUF wsabuf;
-    wsabuf.buf = context->buffer;
-    wsabuf.len = sizeof(context->buffer);
-    DWORD recvBytes = 0;
-    DWORD flags = 0;
-
-    int result = WSARecv(clientSocket, &wsabuf, 1, &recvBytes, &flags, &context->recv_overlapped, NULL);
-    if (result == SOCKET_ERROR) {
-        int error = WSAGetLastError();
-        if (error != WSA_IO_PENDING) {
-            std::lock_guard<std::mutex> lock(cout_mutex);
-            std::cerr << "[error] WSARecv: " << error << std::endl;
-            closesocket(clientSocket);
-            delete context;
-            return;
-        }
-    }
-}
-
 std::string random_string(size_t length) {
     static const char charset[] =
         "0123456789"
@@ -159,37 +43,214 @@ std::string random_string(size_t length) {
     return result;
 }
 
-int main() {
+// allocation counters of the buffer pool, one line per size class in use
+void log_buffer_pool_stats() {
+    BufferPoolStats stats = BufferPool::get_instance().stats();
+    log_info("buffer pool: reserved {} bytes, large allocations {}, large frees {}",
+        stats.reservedBytes, stats.largeAllocations, stats.largeFrees);
+
+    for (const BufferClassStats& c : stats.classes) {
+        if (c.allocations == 0)
+            continue;
+        log_info("buffer pool: class {} allocations {} frees {} refills {} spills {} central {}",
+            c.blockSize, c.allocations, c.frees, c.refills, c.spills, c.centralBlocks);
+    }
+}
+
+int main(int argc, char* argv[]) {
+#ifdef _WIN32
     WSADATA wsaData;
     WSAStartup(MAKEWORD(2, 2), &wsaData);
+#endif
+
+    std::string_view engineKind = "auto";
+    DurabilityPolicy durability;
+    RetentionPolicy retention;
+    uint64_t compactionRate = 32 * 1024 * 1024;
+    Codec codec = Codec::None;
+    uint32_t partitions = 1;
+    size_t queueCapacity = TopicQueue::defaultCapacity;
+    size_t shards = 1;
+    for (int i = 1; i < argc; ++i) {
+        std::string_view arg = argv[i];
+        if (arg.starts_with("--engine="))
+            engineKind = arg.substr(9);
+        else if (arg.starts_with("--durability=")) {
+            auto parsed = DurabilityPolicy::parse(arg.substr(13));
+            if (!parsed) {
+                std::cerr << "[error] --durability expects none, interval:<ms>, bytes:<n> or always" << std::endl;
+#ifdef _WIN32
+                WSACleanup();
+#endif
+                return 1;
+            }
+            durability = *parsed;
+        }
+        else if (arg.starts_with("--retention=")) {
+            auto parsed = RetentionPolicy::parse(arg.substr(12));
+            if (!parsed) {
+                std::cerr << "[error] --retention expects none, time:<ms>, bytes:<n> or time:<ms>,bytes:<n>" << std::endl;
+#ifdef _WIN32
+                WSACleanup();
+#endif
+                return 1;
+            }
+            retention = *parsed;
+        }
+        else if (arg.starts_with("--compaction-rate=")) {
+            // bytes per second the log cleaner reads and writes while compacting, 0 for no limit
+            std::string_view value = arg.substr(18);
+            auto [end, ec] = std::from_chars(value.data(), value.data() + value.size(), compactionRate);
+            if (ec != std::errc() || end != value.data() + value.size()) {
+                std::cerr << "[error] --compaction-rate expects a number" << std::endl;
+#ifdef _WIN32
+                WSACleanup();
+#endif
+                return 1;
+            }
+        }
+        else if (arg.starts_with("--compression=")) {
+            // codec the logs compress appended records with; producer-compressed batches are kept as sent
+            std::string_view name = arg.substr(14);
+            const CompressionCodec* found = find_codec(name);
+            if (!found && name != "none") {
+                std::cerr << "[error] --compression expects none or lz" << std::endl;
+#ifdef _WIN32
+                WSACleanup();
+#endif
+                return 1;
+            }
+            codec = found ? found->id() : Codec::None;
+        }
+        else if (arg.starts_with("--log-level=")) {
+            auto level = AsyncLogger::parse_level(arg.substr(12));
+            if (!level) {
+                std::cerr << "[error] --log-level expects debug, info, warn, error or off" << std::endl;
+#ifdef _WIN32
+                WSACleanup();
+#endif
+                return 1;
+            }
+            AsyncLogger::get_instance().set_level(*level);
+        }
+        else if (arg.starts_with("--log-rate=")) {
+            // info/debug entries per second and thread, 0 keeps them all
+            uint32_t rate = 0;
+            std::string_view value = arg.substr(11);
+            auto [end, ec] = std::from_chars(value.data(), value.data() + value.size(), rate);
+            if (ec != std::errc() || end != value.data() + value.size()) {
+                std::cerr << "[error] --log-rate expects a number" << std::endl;
+#ifdef _WIN32
+                WSACleanup();
+#endif
+                return 1;
+            }
+            AsyncLogger::get_instance().set_rate_limit(rate);
+        }
+        else if (arg.starts_with("--shards=")) {
+            // one event loop per shard, "auto" runs one per core
+            std::string_view value = arg.substr(9);
+            auto [end, ec] = std::from_chars(value.data(), value.data() + value.size(), shards);
+            if (value == "auto")
+                shards = std::max(std::thread::hardware_concurrency(), 1u);
+            else if (ec != std::errc() || end != value.data() + value.size() || shards == 0) {
+                std::cerr << "[error] --shards expects a positive number or auto" << std::endl;
+#ifdef _WIN32
+                WSACleanup();
+#endif
+                return 1;
+            }
+        }
+        else if (arg.starts_with("--queue-capacity=")) {
+            // messages each partition's queue holds, rounded up to a power of two
+            std::string_view value = arg.substr(17);
+            auto [end, ec] = std::from_chars(value.data(), value.data() + value.size(), queueCapacity);
+            if (ec != std::errc() || end != value.data() + value.size() || queueCapacity == 0) {
+                std::cerr << "[error] --queue-capacity expects a positive number" << std::endl;
+#ifdef _WIN32
+                WSACleanup();
+#endif
+                return 1;
+            }
+        }
+        else if (arg.starts_with("--partitions=")) {
+            // partitions of topics created without CREATE_TOPIC
+            std::string_view value = arg.substr(13);
+            auto [end, ec] = std::from_chars(value.data(), value.data() + value.size(), partitions);
+            if (ec != std::errc() || end != value.data() + value.size() || partitions == 0) {
+                std::cerr << "[error] --partitions expects a positive number" << std::endl;
+#ifdef _WIN32
+                WSACleanup();
+#endif
+                return 1;
+            }
+        }
+    }
 
-    SOCKET listenSocket = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
-    sockaddr_in service;
-    service.sin_family = AF_INET;
-    service.sin_addr.s_addr = INADDR_ANY;
-    service.sin_port = htons(12345);
-    bind(listenSocket, (SOCKADDR*)&service, sizeof(service));
-    listen(listenSocket, SOMAXCONN);
-
-    BufferPool bufferPool(10, 1024);
+    BufferPool& bufferPool = BufferPool::get_instance();
 
     std::string baseFilename = "broker_log";
     size_t segmentSize = 1024 * 1024;
-    std::shared_ptr<DiskHandler> sharedDiskHandler = std::make_shared<DiskHandler>(baseFilename, segmentSize);
-    
+    size_t maxLogSegments = 64;
+    std::shared_ptr<DiskHandler> sharedDiskHandler = std::make_shared<DiskHandler>(baseFilename, segmentSize, maxLogSegments);
+    AsyncLogger::get_instance().start(sharedDiskHandler);
+
+    TopicManager::get_instance().set_queue_capacity(queueCapacity);
+    TopicManager::get_instance().init_storage("data", 16 * 1024 * 1024, durability, partitions, codec, retention, compactionRate);
+    // '@' is always escaped in topic directory names, so this can never collide with a topic
+    GroupCoordinator::get_instance().init_storage("data/@groups");
+
+    std::vector<std::unique_ptr<NetEngine>> engines;
+    std::vector<NetEngine*> shardEngines;
+    for (size_t i = 0; i < shards; ++i) {
+        std::unique_ptr<NetEngine> engine = create_net_engine(engineKind, bufferPool, sharedDiskHandler);
+        if (!engine) {
+#ifdef _WIN32
+            WSACleanup();
+#endif
+            return 1;
+        }
+        engine->set_shard(i, shards);
+        shardEngines.push_back(engine.get());
+        engines.push_back(std::move(engine));
+    }
+    ShardRuntime::get_instance().assign(shardEngines);
+
+    // every shard initializes its engine on its own thread: an io_uring ring only accepts
+    // submissions from the thread that created it
+    std::vector<std::promise<bool>> initialized(shards);
+    std::vector<std::thread> shardThreads;
+    for (size_t i = 1; i < shards; ++i) {
+        shardThreads.emplace_back([&engines, &initialized, i] {
+            bool ok = engines[i]->init(12345);
+            initialized[i].set_value(ok);
+            if (ok)
+                engines[i]->run();
+        });
+    }
+
+    bool ok = engines[0]->init(12345);
+    for (size_t i = 1; i < shards; ++i)
+        ok = initialized[i].get_future().get() && ok;
+    if (!ok) {
+        for (auto& engine : engines)
+            engine->stop();
+        for (auto& thread : shardThreads)
+            thread.join();
 
-    if (!init_iocp(listenSocket)) {
         std::lock_guard<std::mutex> lock(cout_mutex);
-        std::cerr << "[error] init failed IOCP" << std::endl;
-        closesocket(listenSocket);
+        std::cerr << "[error] init failed net engine" << std::endl;
+#ifdef _WIN32
         WSACleanup();
+#endif
         return 1;
     }
 
-    std::thread iocpThread(iocp_worker, hCompletionPort);
-    iocpThread.detach();
-
-    TopicManager::get_instance().init_logger(sharedDiskHandler);
+    {
+        std::lock_guard<std::mutex> lock(cout_mutex);
+        std::cout << "[info] net engine: " << engines[0]->name() << ", shards: " << shards << std::endl;
+        std::cout << "[info] crc32c: " << crc32c_implementation() << ", line scan: " << line_scan_implementation() << std::endl;
+    }
 
     // test topic
     std::thread([]() {
@@ -208,14 +269,22 @@ int main() {
         }
         }).detach();
 
+    std::thread([]() {
         while (true) {
-            SOCKET clientSocket = accept(listenSocket, NULL, NULL);
-            if (clientSocket != INVALID_SOCKET) {
-                client_connection_handler(clientSocket, bufferPool, sharedDiskHandler);
-            }
+            std::this_thread::sleep_for(std::chrono::seconds(60));
+            log_buffer_pool_stats();
+            TopicManager::get_instance().log_queue_stats();
         }
+        }).detach();
 
-        closesocket(listenSocket);
-        WSACleanup();
-        return 0;
-}
\ No newline at end of file
+    engines[0]->run();
+    for (size_t i = 1; i < shards; ++i)
+        engines[i]->stop();
+    for (auto& thread : shardThreads)
+        thread.join();
+
+#ifdef _WIN32
+    WSACleanup();
+#endif
+    return 0;
+}
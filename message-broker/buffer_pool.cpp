@@ -0,0 +1,240 @@
+#include "buffer_pool.h"
+
+#include <algorithm>
+#include <bit>
+#include <new>
+
+namespace {
+    constexpr size_t spanSize = 1024 * 1024;
+
+    // free blocks are linked through their first bytes
+    void*& next_of(void* block) {
+        return *static_cast<void**>(block);
+    }
+
+    // counters are written by the owning thread only and read by stats()
+    void bump(std::atomic<uint64_t>& counter) {
+        counter.store(counter.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+    }
+}
+
+struct ThreadBufferCache {
+    struct List {
+        void* head = nullptr;
+        size_t count = 0;
+    };
+
+    BufferPool& pool;
+    std::array<List, BufferPool::classCount> lists{};
+    std::array<std::atomic<uint64_t>, BufferPool::classCount> allocations{};
+    std::array<std::atomic<uint64_t>, BufferPool::classCount> frees{};
+    std::array<std::atomic<uint64_t>, BufferPool::classCount> refills{};
+    std::array<std::atomic<uint64_t>, BufferPool::classCount> spills{};
+
+    explicit ThreadBufferCache(BufferPool& pool) : pool(pool) {
+        pool.attach(this);
+    }
+
+    ~ThreadBufferCache() {
+        for (size_t i = 0; i < BufferPool::classCount; ++i) {
+            List& list = lists[i];
+            if (!list.head)
+                continue;
+            void* last = list.head;
+            while (next_of(last))
+                last = next_of(last);
+            pool.spill(i, list.head, last, list.count);
+            list = List{};
+        }
+        pool.detach(this);
+    }
+};
+
+namespace {
+    // thread_local objects of other files can still free buffers after this thread's cache is gone
+    thread_local bool cacheDestroyed = false;
+
+    struct LocalCache {
+        ThreadBufferCache cache{ BufferPool::get_instance() };
+        ~LocalCache() { cacheDestroyed = true; }
+    };
+
+    ThreadBufferCache* local_cache() {
+        if (cacheDestroyed)
+            return nullptr;
+        thread_local LocalCache local;
+        return &local.cache;
+    }
+}
+
+// never destroyed: buffers held by other singletons and by thread caches are freed during exit
+BufferPool& BufferPool::get_instance() {
+    static BufferPool* instance = new BufferPool();
+    return *instance;
+}
+
+size_t BufferPool::class_index(size_t size) {
+    if (size <= minBlockSize)
+        return 0;
+    return std::bit_width(size - 1) - std::bit_width(minBlockSize - 1);
+}
+
+size_t BufferPool::block_size(size_t index) {
+    return minBlockSize << index;
+}
+
+// blocks moved per refill or spill; a thread caches up to two batches per class
+size_t BufferPool::batch_size(size_t index) {
+    return std::clamp<size_t>(32 * 1024 / block_size(index), 4, 64);
+}
+
+void* BufferPool::allocate(size_t size) {
+    if (size > maxBlockSize) {
+        largeAllocations.fetch_add(1, std::memory_order_relaxed);
+        return ::operator new(size);
+    }
+
+    size_t index = class_index(std::max<size_t>(size, 1));
+    ThreadBufferCache* cache = local_cache();
+    if (!cache) {
+        void* block = nullptr;
+        refill(index, block, 1);
+        std::lock_guard<std::mutex> lock(cachesMutex);
+        retired[index].allocations++;
+        return block;
+    }
+
+    ThreadBufferCache::List& list = cache->lists[index];
+    if (!list.head) {
+        list.count = refill(index, list.head, batch_size(index));
+        bump(cache->refills[index]);
+    }
+
+    void* block = list.head;
+    list.head = next_of(block);
+    list.count--;
+    bump(cache->allocations[index]);
+    return block;
+}
+
+void BufferPool::deallocate(void* block, size_t size) {
+    if (!block)
+        return;
+    if (size > maxBlockSize) {
+        largeFrees.fetch_add(1, std::memory_order_relaxed);
+        ::operator delete(block);
+        return;
+    }
+
+    size_t index = class_index(std::max<size_t>(size, 1));
+    ThreadBufferCache* cache = local_cache();
+    if (!cache) {
+        next_of(block) = nullptr;
+        spill(index, block, block, 1);
+        std::lock_guard<std::mutex> lock(cachesMutex);
+        retired[index].frees++;
+        return;
+    }
+
+    ThreadBufferCache::List& list = cache->lists[index];
+    next_of(block) = list.head;
+    list.head = block;
+    list.count++;
+    bump(cache->frees[index]);
+
+    // hand a batch back so a thread that only frees (a consumer of another thread's buffers)
+    // does not hoard them
+    size_t batch = batch_size(index);
+    if (list.count < 2 * batch)
+        return;
+
+    void* first = list.head;
+    void* last = first;
+    for (size_t i = 1; i < batch; ++i)
+        last = next_of(last);
+    list.head = next_of(last);
+    list.count -= batch;
+    spill(index, first, last, batch);
+    bump(cache->spills[index]);
+}
+
+size_t BufferPool::refill(size_t index, void*& list, size_t batch) {
+    Central& c = central[index];
+    size_t size = block_size(index);
+    std::lock_guard<std::mutex> lock(c.mtx);
+
+    size_t moved = 0;
+    while (moved < batch && c.freeList) {
+        void* block = c.freeList;
+        c.freeList = next_of(block);
+        next_of(block) = list;
+        list = block;
+        ++moved;
+    }
+    c.count -= moved;
+
+    while (moved < batch) {
+        if (c.spanLeft < size) {
+            c.span = static_cast<char*>(::operator new(spanSize));
+            c.spanLeft = spanSize;
+            reservedBytes.fetch_add(spanSize, std::memory_order_relaxed);
+        }
+        void* block = c.span;
+        c.span += size;
+        c.spanLeft -= size;
+        next_of(block) = list;
+        list = block;
+        ++moved;
+    }
+    return moved;
+}
+
+void BufferPool::spill(size_t index, void* first, void* last, size_t count) {
+    Central& c = central[index];
+    std::lock_guard<std::mutex> lock(c.mtx);
+    next_of(last) = c.freeList;
+    c.freeList = first;
+    c.count += count;
+}
+
+void BufferPool::attach(ThreadBufferCache* cache) {
+    std::lock_guard<std::mutex> lock(cachesMutex);
+    caches.push_back(cache);
+}
+
+void BufferPool::detach(ThreadBufferCache* cache) {
+    std::lock_guard<std::mutex> lock(cachesMutex);
+    for (size_t i = 0; i < classCount; ++i) {
+        retired[i].allocations += cache->allocations[i].load(std::memory_order_relaxed);
+        retired[i].frees += cache->frees[i].load(std::memory_order_relaxed);
+        retired[i].refills += cache->refills[i].load(std::memory_order_relaxed);
+        retired[i].spills += cache->spills[i].load(std::memory_order_relaxed);
+    }
+    std::erase(caches, cache);
+}
+
+BufferPoolStats BufferPool::stats() const {
+    BufferPoolStats result;
+    {
+        std::lock_guard<std::mutex> lock(cachesMutex);
+        result.classes.assign(retired.begin(), retired.end());
+        for (const ThreadBufferCache* cache : caches) {
+            for (size_t i = 0; i < classCount; ++i) {
+                result.classes[i].allocations += cache->allocations[i].load(std::memory_order_relaxed);
+                result.classes[i].frees += cache->frees[i].load(std::memory_order_relaxed);
+                result.classes[i].refills += cache->refills[i].load(std::memory_order_relaxed);
+                result.classes[i].spills += cache->spills[i].load(std::memory_order_relaxed);
+            }
+        }
+    }
+
+    for (size_t i = 0; i < classCount; ++i) {
+        result.classes[i].blockSize = block_size(i);
+        std::lock_guard<std::mutex> lock(central[i].mtx);
+        result.classes[i].centralBlocks = central[i].count;
+    }
+    result.largeAllocations = largeAllocations.load(std::memory_order_relaxed);
+    result.largeFrees = largeFrees.load(std::memory_order_relaxed);
+    result.reservedBytes = reservedBytes.load(std::memory_order_relaxed);
+    return result;
+}
@@ -1,33 +1,103 @@
 #pragma once
 
-#include <vector>
+#include <array>
+#include <atomic>
+#include <memory>
 #include <mutex>
+#include <string>
+#include <vector>
+#include <cstddef>
+#include <cstdint>
+
+struct ThreadBufferCache;
+
+struct BufferClassStats {
+    size_t blockSize = 0;
+    uint64_t allocations = 0;
+    uint64_t frees = 0;
+    // batches moved between the thread caches and the central list
+    uint64_t refills = 0;
+    uint64_t spills = 0;
+    size_t centralBlocks = 0;
+};
+
+struct BufferPoolStats {
+    std::vector<BufferClassStats> classes;
+    uint64_t largeAllocations = 0;
+    uint64_t largeFrees = 0;
+    // bytes of all spans taken from the heap so far
+    size_t reservedBytes = 0;
+};
 
+// Size-classed allocator for the broker's byte buffers: receive buffers, response frames and
+// message payloads. Classes are powers of two from 64 B to 64 KiB. Every thread keeps a free list
+// per class and moves whole batches to and from a central list, so the common path takes no lock.
+// Blocks are carved from 1 MiB spans per class that are never given back, which keeps buffers of
+// one size together instead of scattering them over the heap. Bigger requests go to operator new.
 class BufferPool {
 public:
-    BufferPool(size_t count, size_t size) : bufSize(size) {
-        for (size_t i = 0; i < count; ++i)
-            pool.push_back(new char[size]);
-    }
-
-    ~BufferPool() {
-        for (auto b : pool) delete[] b;
-    }
-
-    char* acquire() {
-        std::lock_guard<std::mutex> l(mtx);
-        if (pool.empty()) return new char[bufSize];
-        char* b = pool.back(); pool.pop_back();
-        return b;
-    }
-
-    void release(char* b) {
-        std::lock_guard<std::mutex> l(mtx);
-        pool.push_back(b);
-    }
+    static constexpr size_t minBlockSize = 64;
+    static constexpr size_t maxBlockSize = 64 * 1024;
+    static constexpr size_t classCount = 11;
+
+    static BufferPool& get_instance();
+
+    void* allocate(size_t size);
+    // size must be the one passed to allocate
+    void deallocate(void* block, size_t size);
+
+    BufferPoolStats stats() const;
 
 private:
-    std::mutex mtx;
-    std::vector<char*> pool;
-    size_t bufSize;
-};
\ No newline at end of file
+    friend struct ThreadBufferCache;
+
+    struct Central {
+        mutable std::mutex mtx;
+        void* freeList = nullptr;
+        size_t count = 0;
+        char* span = nullptr;
+        size_t spanLeft = 0;
+    };
+
+    std::array<Central, classCount> central;
+    std::atomic<size_t> reservedBytes{ 0 };
+    std::atomic<uint64_t> largeAllocations{ 0 };
+    std::atomic<uint64_t> largeFrees{ 0 };
+
+    mutable std::mutex cachesMutex;
+    std::vector<ThreadBufferCache*> caches;
+    // counters of threads that already exited
+    std::array<BufferClassStats, classCount> retired{};
+
+    BufferPool() = default;
+    BufferPool(const BufferPool&) = delete;
+    BufferPool& operator=(const BufferPool&) = delete;
+
+    static size_t class_index(size_t size);
+    static size_t block_size(size_t index);
+    static size_t batch_size(size_t index);
+
+    // moves up to batch blocks of the class into list, returns how many
+    size_t refill(size_t index, void*& list, size_t batch);
+    void spill(size_t index, void* first, void* last, size_t count);
+    void attach(ThreadBufferCache* cache);
+    void detach(ThreadBufferCache* cache);
+};
+
+// std allocator over BufferPool::get_instance()
+template <typename T>
+struct PoolAllocator {
+    using value_type = T;
+
+    PoolAllocator() noexcept = default;
+    template <typename U>
+    PoolAllocator(const PoolAllocator<U>&) noexcept {}
+
+    T* allocate(size_t n) { return static_cast<T*>(BufferPool::get_instance().allocate(n * sizeof(T))); }
+    void deallocate(T* p, size_t n) noexcept { BufferPool::get_instance().deallocate(p, n * sizeof(T)); }
+
+    template <typename U>
+    bool operator==(const PoolAllocator<U>&) const noexcept { return true; }
+};
+
+using PooledString = std::basic_string<char, std::char_traits<char>, PoolAllocator<char>>;
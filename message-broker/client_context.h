@@ -2,30 +2,90 @@
 
 #include <string>
 #include <thread>
-#include <winsock2.h>
 #include <memory>
 #include <unordered_set>
+#include <vector>
+#include <chrono>
+#include <cstdint>
 
+#include "platform.h"
 #include "disk_handler.h"
+#include "protocol.h"
+#include "waiter.h"
+#include "outbound_queue.h"
 
 class CommandHandler;
 class BufferPool;
+class ConsumerGroup;
+
+// FETCH_BATCH with max_wait_ms that found nothing, answered when records arrive or at the deadline
+struct ParkedFetch {
+    uint32_t correlationId;
+    std::string topic;
+    protocol::FetchParams params;
+    std::chrono::steady_clock::time_point deadline;
+};
+
+// PUBLISH / PRODUCE_BATCH / PRODUCE_KEYED answered once the partition's log is durable up to endOffset
+// (0 when nothing has to be waited for); a keyed produce parks one entry per partition it wrote to
+// and is answered after the last
+struct ParkedProduce {
+    uint32_t correlationId;
+    protocol::RequestType type;
+    std::string topic;
+    uint32_t partition;
+    uint64_t endOffset;
+    // records handed to the shard that owns the partition, until it reports the append
+    bool appending = false;
+    // not Ok when the owner could not append them; the produce is answered with it
+    protocol::Status failure = protocol::Status::Ok;
+};
+
+// topic streamed to the connection as PUSH frames
+struct PushSubscription {
+    uint32_t correlationId;
+    std::string topic;
+    protocol::FetchParams params;
+};
 
 struct ClientContext {
+#ifdef _WIN32
     OVERLAPPED recv_overlapped{};
     OVERLAPPED send_overlapped{};
+#endif
 
-    SOCKET sock;
+    socket_t sock;
     BufferPool& pool;
     std::shared_ptr<DiskHandler> disk_handler;
     std::unique_ptr<CommandHandler> command_handler;
     LogCursor cursor;
     std::unordered_set<std::string> currentTopics;
-    char buffer[1024];
+    std::vector<ParkedFetch> parked;
+    std::vector<PushSubscription> pushes;
+    std::vector<ParkedProduce> acks;
+    std::shared_ptr<Waiter> waiter;
+    // set once the connection joins a consumer group; fetches then read the commit log
+    ConsumerGroup* group = nullptr;
+    uint64_t memberId = 0;
+    size_t groupTurn = 0;
+    protocol::Mode mode = protocol::Mode::Unknown;
+    PooledString inbound;
+    OutboundQueue send_queue;
+    bool send_pending = false;
+    // receive buffer from the pool, sized so one recv carries many pipelined frames
+    static constexpr size_t bufferSize = 64 * 1024;
+    char* buffer;
 
     ClientContext(BufferPool& p, std::shared_ptr<DiskHandler> d)
-        : sock(INVALID_SOCKET), pool(p), disk_handler(std::move(d)), command_handler(nullptr) {
+        : sock(invalid_socket), pool(p), disk_handler(std::move(d)), command_handler(nullptr),
+        buffer(static_cast<char*>(p.allocate(bufferSize))) {
+#ifdef _WIN32
         ZeroMemory(&recv_overlapped, sizeof(recv_overlapped));
         ZeroMemory(&send_overlapped, sizeof(send_overlapped));
+#endif
+    }
+
+    ~ClientContext() {
+        pool.deallocate(buffer, bufferSize);
     }
-};
\ No newline at end of file
+};
@@ -1,67 +1,622 @@
 #include "command_handler.h"
 #include "topic_manager.h"
+#include "consumer_group.h"
+#include "async_logger.h"
+#include "shard_runtime.h"
+#include "compression.h"
 
 #include <algorithm>
 
-std::string CommandHandler::handle_command(const std::string& rawCmd, ClientContext* context) {
-    std::string cmd = trim(rawCmd);
-    disk_handler->log("info", "Received command: " + cmd);
+using protocol::RequestType;
+using protocol::Status;
 
-    if (starts_with(cmd, "SUBSCRIBE ")) {
-        std::string newTopic = cmd.substr(10);
-        context->currentTopics.insert(newTopic);
-        disk_handler->log("info", "Subscribed to topic: " + newTopic);
-        return "OK";
+namespace {
+    // push subscriptions pause while this much is waiting to be sent and resume once it drains
+    constexpr size_t pushBacklogBytes = 1024 * 1024;
+    constexpr uint32_t pushDefaultRecords = 512;
+
+    Status append_failure(AppendStatus status) {
+        switch (status) {
+        case AppendStatus::StorageError: return Status::StorageError;
+        case AppendStatus::QueueFull: return Status::QueueFull;
+        default: return Status::Ok;
+        }
     }
+}
 
-    if (starts_with(cmd, "PULL")) {
+protocol::Response CommandHandler::handle_command(const protocol::Request& request, ClientContext* context) {
+    protocol::Response response;
+    log_info("Received command: {} {}", protocol::type_name(request.type), request.topic);
+
+    switch (request.type) {
+    case RequestType::Subscribe: {
+        if (request.topic.empty())
+            break;
+        context->currentTopics.emplace(request.topic);
+        log_info("Subscribed to topic: {}", request.topic);
+        return response;
+    }
+
+    case RequestType::Pull: {
         if (context->currentTopics.empty()) {
-            disk_handler->log("error", "No topic subscribed yet.");
-            return "NO_TOPIC";
+            log_error("No topic subscribed yet.");
+            response.status = Status::NoTopic;
+            return response;
         }
 
         for (const auto& topic : context->currentTopics) {
-            if (!TopicManager::get_instance().has_topic(topic)) {
-                disk_handler->log("error", "No such topic: " + topic);
+            Topic* t = TopicManager::get_instance().find(topic);
+            if (!t) {
+                log_error("No such topic: {}", topic);
                 continue;
             }
 
-            auto msg = TopicManager::get_instance().pull(topic);
+            auto msg = TopicManager::get_instance().pull(*t);
             if (msg) {
-                disk_handler->log("info", "Pulled message from topic: " + topic);
-                return msg.value();
+                log_info("Pulled message from topic: {}", topic);
+                response.payload.assign(msg->body());
+                return response;
             }
             else {
-                disk_handler->log("info", "Topic " + topic + " is empty.");
+                log_info("Topic {} is empty.", topic);
             }
         }
 
-        return "NO_MESSAGES";
+        response.status = Status::NoMessages;
+        return response;
+    }
+
+    case RequestType::Publish: {
+        if (request.topic.empty()) {
+            log_error("Invalid PUBLISH command format.");
+            break;
+        }
+        response = produce(request, context, { request.payload });
+        log_info("Published message to topic: {}", request.topic);
+        return response;
+    }
+
+    case RequestType::ProduceBatch:
+        return produce_batch(request, context);
+
+    case RequestType::ProduceKeyed:
+        return produce_keyed(request, context);
+
+    case RequestType::ProduceCompressed:
+        return produce_compressed(request, context);
+
+    case RequestType::CreateTopic:
+        return create_topic(request);
+
+    case RequestType::FetchBatch:
+        return fetch_batch(request, context);
+
+    case RequestType::SubscribePush:
+        return subscribe_push(request, context);
+
+    case RequestType::JoinGroup:
+        return join_group(request, context);
+
+    case RequestType::CommitOffset:
+        return commit_offset(request, context);
+
+    case RequestType::FetchLog:
+        return fetch_log(request);
+
+    case RequestType::OffsetForTime:
+        return offset_for_time(request);
+
+    default:
+        break;
+    }
+
+    log_info("Invalid command: {}", request.payload);
+    response.status = Status::InvalidRequest;
+    response.payload = std::string(request.payload);
+    return response;
+}
+
+protocol::Response CommandHandler::produce_batch(const protocol::Request& request, ClientContext* context) {
+    protocol::Response response;
+    std::vector<std::string_view> records;
+
+    if (request.topic.empty() || !protocol::parse_records(request.payload, records)) {
+        log_error("Invalid PRODUCE_BATCH request.");
+        response.status = Status::InvalidRequest;
+        return response;
+    }
+
+    if (records.empty())
+        return response;
+    return produce(request, context, records);
+}
+
+// payload is a record set of key, value pairs
+protocol::Response CommandHandler::produce_keyed(const protocol::Request& request, ClientContext* context) {
+    protocol::Response response;
+    std::vector<std::string_view> records;
+
+    if (request.topic.empty() || !protocol::parse_records(request.payload, records) || records.size() % 2 != 0) {
+        log_error("Invalid PRODUCE_KEYED request.");
+        response.status = Status::InvalidRequest;
+        return response;
+    }
+
+    if (records.empty())
+        return response;
+
+    std::vector<std::string_view> keys;
+    std::vector<std::string_view> values;
+    keys.reserve(records.size() / 2);
+    values.reserve(records.size() / 2);
+    for (size_t i = 0; i < records.size(); i += 2) {
+        keys.push_back(records[i]);
+        values.push_back(records[i + 1]);
+    }
+    return produce(request, context, values, keys);
+}
+
+// The batch is validated by expanding it, since the queue needs the plain records anyway, and is
+// logged as the producer compressed it
+protocol::Response CommandHandler::produce_compressed(const protocol::Request& request, ClientContext* context) {
+    protocol::Response response;
+    const CompressionCodec* codec = request.payload.empty() ? nullptr : find_codec(static_cast<Codec>(request.payload[0]));
+    std::string_view block = request.payload.substr(std::min<size_t>(request.payload.size(), 1));
+    PooledString raw;
+    std::vector<std::string_view> keys;
+    std::vector<std::string_view> values;
+
+    if (request.topic.empty() || !codec || !decode_batch(*codec, block, raw, keys, values)) {
+        log_error("Invalid PRODUCE_COMPRESSED request.");
+        response.status = Status::InvalidRequest;
+        return response;
     }
 
-    if (starts_with(cmd, "PUBLISH ")) { // PUBLISH <topic> <message>
-        size_t firstSpace = cmd.find(' ', 8);
-        if (firstSpace == std::string::npos) {
-            disk_handler->log("error", "Invalid PUBLISH command format.");
-            return "INVALID_CMD: " + cmd;
+    TopicManager& manager = TopicManager::get_instance();
+    Topic& t = manager.get_or_create(request.topic);
+    std::vector<PartitionBatch> batches = manager.partition_records(t, values);
+    batches.front().codec = codec->id();
+    batches.front().compressed = SharedMessage::create(block);
+    return produce(request, context, t, std::move(batches));
+}
+
+protocol::Response CommandHandler::produce(const protocol::Request& request, ClientContext* context,
+    const std::vector<std::string_view>& values, const std::vector<std::string_view>& keys) {
+    TopicManager& manager = TopicManager::get_instance();
+    Topic& t = manager.get_or_create(request.topic);
+    return produce(request, context, t, manager.partition_records(t, values, keys));
+}
+
+// Partitions owned by this shard (or any partition outside the shard threads) are appended right
+// here; records for another shard's partition are handed to it and the produce is answered when
+// it reports back. Text clients are answered in order, so their records are always appended here,
+// whichever shard owns the partition: a forwarded PUBLISH could only be answered after the owner's
+// round trip, holding back every later line of the connection, and a text client has no
+// correlation id to take the answers out of order.
+protocol::Response CommandHandler::produce(const protocol::Request& request, ClientContext* context, Topic& t,
+    std::vector<PartitionBatch> batches) {
+    TopicManager& manager = TopicManager::get_instance();
+    ShardRuntime& shards = ShardRuntime::get_instance();
+    size_t self = ShardRuntime::current();
+    bool forward = self != ShardRuntime::noShard && shards.count() > 1 && context->mode == protocol::Mode::Binary;
+
+    std::vector<PartitionAppend> appended;
+    size_t parked = context->acks.size();
+    size_t forwarded = 0;
+    for (PartitionBatch& batch : batches) {
+        size_t owner = forward ? shards.owner(request.topic, batch.partition) : self;
+        if (owner != self) {
+            ShardTask task;
+            task.source = self;
+            task.topic = &t;
+            task.batch = std::move(batch);
+            task.waiter = context->waiter;
+            task.correlationId = request.correlationId;
+            context->acks.push_back({ request.correlationId, request.type, std::string(request.topic), task.batch.partition, 0, true });
+            // even when the owner's queue is full: appending here could overtake this
+            // connection's earlier records for the partition still waiting to reach the owner
+            shards.send(owner, std::move(task));
+            ++forwarded;
+            continue;
+        }
+
+        AppendOutcome outcome = manager.append(t, batch);
+        if (outcome.status != AppendStatus::Ok) {
+            // nothing of the request is acked: batches already handed to other shards are not waited for
+            if (outcome.status == AppendStatus::QueueFull)
+                log_info("Queue of {} partition {} is full.", request.topic, batch.partition);
+            else
+                log_error("Append to {} partition {} failed.", request.topic, batch.partition);
+            context->acks.erase(context->acks.begin() + parked, context->acks.end());
+            protocol::Response response;
+            response.status = append_failure(outcome.status);
+            return response;
         }
-        std::string topic = cmd.substr(8, firstSpace - 8);
-        std::string message = cmd.substr(firstSpace + 1);
-        TopicManager::get_instance().publish(topic, message);
-        disk_handler->log("info", "Published message to topic: " + topic);
-        return "OK";
+        appended.push_back({ batch.partition, outcome.offsets });
     }
 
-    disk_handler->log("info", "Invalid command: " + cmd);
-    return "INVALID_CMD: " + cmd;
+    protocol::Response response = acknowledge(request, context, appended);
+    response.deferred |= forwarded > 0;
+    return response;
 }
 
-bool CommandHandler::starts_with(const std::string& str, const std::string& prefix) {
-    return str.size() >= prefix.size() && std::equal(prefix.begin(), prefix.end(), str.begin());
+void CommandHandler::forward_completed(ClientContext* context, uint32_t correlationId, uint32_t partition,
+    const AppendOutcome& appended) {
+    auto it = std::find_if(context->acks.begin(), context->acks.end(), [&](const ParkedProduce& ack) {
+        return ack.appending && ack.correlationId == correlationId && ack.partition == partition;
+    });
+    if (it == context->acks.end())
+        return;
+
+    it->appending = false;
+    it->failure = append_failure(appended.status);
+    if (it->failure == Status::Ok && TopicManager::get_instance().durability().mode != DurabilityPolicy::Mode::None)
+        it->endOffset = appended.offsets.endOffset;
+    context->waiter->notify();
 }
 
-std::string CommandHandler::trim(const std::string& str) {
-    size_t start = str.find_first_not_of(" \r\n\t");
-    size_t end = str.find_last_not_of(" \r\n\t");
-    return (start == std::string::npos) ? "" : str.substr(start, end - start + 1);
+protocol::Response CommandHandler::create_topic(const protocol::Request& request) {
+    protocol::Response response;
+    uint32_t partitions = 0;
+    uint8_t cleanup = 0;
+    if (request.payload.size() == 5)
+        cleanup = static_cast<uint8_t>(request.payload[4]);
+
+    if (request.topic.empty() || !protocol::parse_u32(request.payload, partitions) || partitions == 0 ||
+        request.payload.size() > 5 || cleanup > static_cast<uint8_t>(CleanupPolicy::CompactDelete) ||
+        !TopicManager::get_instance().create(request.topic, partitions, static_cast<CleanupPolicy>(cleanup))) {
+        log_error("Invalid CREATE_TOPIC request.");
+        response.status = Status::InvalidRequest;
+    }
+    return response;
+}
+
+// Under a durability policy a binary producer is answered once its records are on disk.
+// Text clients have no correlation ids to match a late answer, so they are acked right away.
+protocol::Response CommandHandler::acknowledge(const protocol::Request& request, ClientContext* context,
+    const std::vector<PartitionAppend>& appended) {
+    protocol::Response response;
+    TopicManager& manager = TopicManager::get_instance();
+    if (appended.empty() || context->mode != protocol::Mode::Binary || manager.durability().mode == DurabilityPolicy::Mode::None)
+        return response;
+
+    Topic* t = manager.find(request.topic);
+    size_t parked = context->acks.size();
+    for (const PartitionAppend& append : appended) {
+        // a memory-only partition has nothing to wait for
+        if (!t->partition(append.partition)->log)
+            continue;
+        CommitLog& log = *t->partition(append.partition)->log;
+        // watch before the check so a sync in between is not missed
+        log.watch_durable(context->waiter);
+        if (log.durable_offset() < append.offsets.endOffset)
+            context->acks.push_back({ request.correlationId, request.type, std::string(request.topic), append.partition, append.offsets.endOffset });
+    }
+
+    response.deferred = context->acks.size() > parked;
+    return response;
 }
+
+protocol::Response CommandHandler::fetch_batch(const protocol::Request& request, ClientContext* context) {
+    protocol::Response response;
+    protocol::FetchParams params;
+
+    if (!protocol::parse_fetch_params(request.payload, params)) {
+        log_error("Invalid FETCH_BATCH request.");
+        response.status = Status::InvalidRequest;
+        return response;
+    }
+
+    if (request.topic.empty() && context->currentTopics.empty() && !context->group) {
+        response.status = Status::NoTopic;
+        return response;
+    }
+
+    size_t records = collect(context, request.topic, params, response);
+    if (records == 0 && params.maxWaitMs > 0 && context->waiter) {
+        // watch before the second look so a publish in between is not missed
+        watch(context, request.topic, params.partition);
+        records = collect(context, request.topic, params, response);
+        if (records == 0) {
+            auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(params.maxWaitMs);
+            context->parked.push_back({ request.correlationId, std::string(request.topic), params, deadline });
+            response.deferred = true;
+            return response;
+        }
+    }
+
+    if (records == 0)
+        response.status = Status::NoMessages;
+    return response;
+}
+
+// payload is optional FetchParams bounding each PUSH frame
+protocol::Response CommandHandler::subscribe_push(const protocol::Request& request, ClientContext* context) {
+    protocol::Response response;
+    protocol::FetchParams params;
+    params.maxRecords = pushDefaultRecords;
+
+    if (request.topic.empty() || !context->waiter ||
+        (!request.payload.empty() && !protocol::parse_fetch_params(request.payload, params))) {
+        log_error("Invalid SUBSCRIBE_PUSH request.");
+        response.status = Status::InvalidRequest;
+        return response;
+    }
+
+    auto it = std::find_if(context->pushes.begin(), context->pushes.end(),
+        [&](const PushSubscription& push) { return push.topic == request.topic; });
+    if (it != context->pushes.end())
+        *it = { request.correlationId, std::string(request.topic), params };
+    else
+        context->pushes.push_back({ request.correlationId, std::string(request.topic), params });
+
+    log_info("Push subscribed to topic: {}", request.topic);
+    // anything already queued goes out on the engine's next pass
+    context->waiter->notify();
+    return response;
+}
+
+void CommandHandler::write_response(ClientContext* context, const protocol::Request& request, protocol::Response& response, PooledString& out) {
+    protocol::encode_response(out, request, response);
+    if (response.records.empty() && !response.file)
+        return;
+
+    context->send_queue.append(std::move(out));
+    out.clear();
+    for (SharedMessage& record : response.records)
+        context->send_queue.append_message(std::move(record));
+    if (response.file)
+        context->send_queue.append_file(std::move(response.file->segment), response.file->offset, response.file->length);
+}
+
+void CommandHandler::service(ClientContext* context, std::chrono::steady_clock::time_point now, PooledString& out) {
+    for (auto it = context->acks.begin(); it != context->acks.end();) {
+        if (it->appending) {
+            ++it;
+            continue;
+        }
+        if (it->endOffset > 0) {
+            CommitLog& log = *TopicManager::get_instance().find(it->topic)->partition(it->partition)->log;
+            log.watch_durable(context->waiter);
+            if (log.durable_offset() < it->endOffset) {
+                ++it;
+                continue;
+            }
+        }
+
+        ParkedProduce done = std::move(*it);
+        it = context->acks.erase(it);
+        auto same = [&](const ParkedProduce& ack) { return ack.correlationId == done.correlationId; };
+        protocol::Response response;
+        if (done.failure != Status::Ok) {
+            // the first failed partition answers the produce, its other partitions are not waited for
+            std::erase_if(context->acks, same);
+            it = context->acks.begin();
+            response.status = done.failure;
+        }
+        else if (std::any_of(context->acks.begin(), context->acks.end(), same)) {
+            continue;
+        }
+
+        protocol::Request request;
+        request.type = done.type;
+        request.correlationId = done.correlationId;
+        request.topic = done.topic;
+        protocol::encode_response(out, request, response);
+    }
+
+    for (auto it = context->parked.begin(); it != context->parked.end();) {
+        protocol::Request request;
+        request.type = RequestType::FetchBatch;
+        request.correlationId = it->correlationId;
+        request.topic = it->topic;
+
+        protocol::Response response;
+        watch(context, it->topic, it->params.partition);
+        size_t records = collect(context, it->topic, it->params, response);
+        if (records == 0 && now < it->deadline) {
+            ++it;
+            continue;
+        }
+        if (records == 0 && it->params.minBytes > 0) {
+            // min_bytes is only waited for until the deadline, then whatever is queued is returned
+            protocol::FetchParams params = it->params;
+            params.minBytes = 0;
+            records = collect(context, it->topic, params, response);
+        }
+
+        if (records == 0)
+            response.status = Status::NoMessages;
+        write_response(context, request, response, out);
+        it = context->parked.erase(it);
+    }
+
+    bool more = false;
+    for (const PushSubscription& push : context->pushes) {
+        if (context->send_queue.size() + out.size() >= pushBacklogBytes)
+            break;
+
+        protocol::Request request;
+        request.type = RequestType::Push;
+        request.correlationId = push.correlationId;
+        request.topic = push.topic;
+
+        protocol::Response response;
+        watch(context, push.topic, push.params.partition);
+        size_t records = collect(context, push.topic, push.params, response);
+        if (records == 0)
+            continue;
+
+        write_response(context, request, response, out);
+        more |= records >= push.params.maxRecords;
+    }
+
+    if (more)
+        context->waiter->notify();
+}
+
+// payload is the record set of topic names to consume; joining again moves the connection to the new group
+protocol::Response CommandHandler::join_group(const protocol::Request& request, ClientContext* context) {
+    protocol::Response response;
+    std::vector<std::string_view> records;
+
+    if (request.topic.empty() || !protocol::parse_records(request.payload, records) || records.empty() ||
+        !TopicManager::get_instance().has_storage()) {
+        log_error("Invalid JOIN_GROUP request.");
+        response.status = Status::InvalidRequest;
+        return response;
+    }
+
+    if (context->group)
+        context->group->leave(context->memberId);
+
+    context->group = &GroupCoordinator::get_instance().get_or_create(request.topic);
+    context->memberId = GroupCoordinator::get_instance().next_member_id();
+    context->group->join(context->memberId, std::vector<std::string>(records.begin(), records.end()));
+
+    log_info("Joined group: {}", request.topic);
+    return response;
+}
+
+protocol::Response CommandHandler::commit_offset(const protocol::Request& request, ClientContext* context) {
+    protocol::Response response;
+    uint64_t offset = 0;
+    uint32_t partition = 0;
+
+    if (!context->group || !protocol::parse_commit_offset(request.payload, offset, partition) ||
+        !context->group->commit(context->memberId, { std::string(request.topic), partition }, offset)) {
+        response.status = Status::InvalidRequest;
+    }
+    return response;
+}
+
+// topic selects one topic, otherwise subscribed topics are drained in turn, each from the
+// requested partition or from all of them; returns the record count
+size_t CommandHandler::collect(ClientContext* context, std::string_view topic, const protocol::FetchParams& params, protocol::Response& response) {
+    if (context->group)
+        return collect_group(context, topic, params, response);
+
+    size_t records = 0;
+    size_t bytes = 0;
+    auto drain = [&](std::string_view name) {
+        if (records >= params.maxRecords || bytes >= params.maxBytes)
+            return;
+
+        records += TopicManager::get_instance().pull_batch(name, params.partition, params.maxRecords - records,
+            params.maxBytes - bytes, params.minBytes, [&](SharedMessage&& msg) {
+                bytes += msg.size();
+                response.records.push_back(std::move(msg));
+            });
+    };
+
+    if (!topic.empty()) {
+        drain(topic);
+    }
+    else {
+        for (const auto& name : context->currentTopics)
+            drain(name);
+    }
+    return records;
+}
+
+// reads one assigned partition from the group's position, rotating between partitions across calls
+size_t CommandHandler::collect_group(ClientContext* context, std::string_view topic, const protocol::FetchParams& params, protocol::Response& response) {
+    std::vector<TopicPartition> partitions = context->group->assignment(context->memberId);
+    std::erase_if(partitions, [&](const TopicPartition& p) {
+        return (!topic.empty() && p.topic != topic) ||
+            (params.partition != protocol::FetchParams::anyPartition && p.partition != params.partition);
+    });
+
+    for (size_t i = 0; i < partitions.size(); ++i) {
+        const TopicPartition& partition = partitions[(context->groupTurn + i) % partitions.size()];
+        std::optional<uint64_t> position = context->group->position(context->memberId, partition);
+        if (!position)
+            continue;
+
+        auto records = TopicManager::get_instance().read(partition.topic, partition.partition, *position, params.maxRecords, params.maxBytes);
+        size_t bytes = 0;
+        for (const LogRecord& record : records)
+            bytes += record.value.size();
+        if (records.empty() || bytes < params.minBytes)
+            continue;
+
+        protocol::encode_u32(response.payload, partition.partition);
+        for (const LogRecord& record : records)
+            protocol::append_log_record(response.payload, record.offset, record.value);
+        context->group->advance(context->memberId, partition, records.back().offset + 1);
+        context->groupTurn += i + 1;
+        response.topic = partition.topic;
+        return records.size();
+    }
+    return 0;
+}
+
+void CommandHandler::watch(ClientContext* context, std::string_view topic, uint32_t partition) {
+    if (!topic.empty()) {
+        TopicManager::get_instance().watch(topic, context->waiter, partition);
+        return;
+    }
+
+    if (context->group) {
+        for (const auto& assigned : context->group->assignment(context->memberId))
+            TopicManager::get_instance().watch(assigned.topic, context->waiter, assigned.partition);
+        return;
+    }
+    for (const auto& name : context->currentTopics)
+        TopicManager::get_instance().watch(name, context->waiter, partition);
+}
+
+// raw records from an offset; the record bytes are queued as a range of the segment file and
+// never pass through a broker buffer
+protocol::Response CommandHandler::fetch_log(const protocol::Request& request) {
+    protocol::Response response;
+    uint64_t offset = 0;
+    uint32_t maxBytes = 0;
+    uint32_t partition = 0;
+
+    if (request.topic.empty() || !protocol::parse_fetch_log(request.payload, offset, maxBytes, partition)) {
+        log_error("Invalid FETCH_LOG request.");
+        response.status = Status::InvalidRequest;
+        return response;
+    }
+
+    Topic* t = TopicManager::get_instance().find(request.topic);
+    Partition* p = t ? t->partition(partition) : nullptr;
+    if (!p || !p->log) {
+        response.status = Status::NoTopic;
+        return response;
+    }
+
+    // the whole frame has to stay under the frame limit
+    size_t limit = std::min<size_t>(maxBytes, protocol::maxFrameSize - protocol::headerSize - request.topic.size());
+    std::optional<LogSlice> slice = p->log->slice(offset, limit);
+    if (!slice) {
+        response.status = Status::NoMessages;
+        return response;
+    }
+
+    response.file = protocol::Response::FileRange{ std::move(slice->segment), slice->position, slice->length };
+    return response;
+}
+
+// where a FETCH_LOG has to start to read what was produced since a point in time
+protocol::Response CommandHandler::offset_for_time(const protocol::Request& request) {
+    protocol::Response response;
+    int64_t timestamp = 0;
+    uint32_t partition = 0;
+
+    if (request.topic.empty() || !protocol::parse_offset_for_time(request.payload, timestamp, partition)) {
+        log_error("Invalid OFFSET_FOR_TIME request.");
+        response.status = Status::InvalidRequest;
+        return response;
+    }
+
+    std::optional<uint64_t> offset = TopicManager::get_instance().offset_for_time(request.topic, partition, timestamp);
+    if (!offset) {
+        response.status = Status::NoTopic;
+        return response;
+    }
+
+    protocol::encode_u64(response.payload, *offset);
+    return response;
+}
\ No newline at end of file
@@ -3,17 +3,43 @@
 #include <string>
 #include <memory>
 #include <unordered_set>
+#include <chrono>
+#include <optional>
+#include <vector>
 
 #include "client_context.h"
-#include "disk_handler.h"
+#include "protocol.h"
+#include "commit_log.h"
+#include "topic_manager.h"
 
 class CommandHandler {
 public:
-    CommandHandler(std::shared_ptr<DiskHandler> disk_handler): disk_handler(std::move(disk_handler)) {}
-    std::string handle_command(const std::string& rawCmd, ClientContext* context);
+    protocol::Response handle_command(const protocol::Request& request, ClientContext* context);
+    // answers durable produces and parked fetches that have records or expired and streams push subscriptions; appends frames to out
+    void service(ClientContext* context, std::chrono::steady_clock::time_point now, PooledString& out);
+    // encodes a binary response into out; shared records and file ranges are queued on the
+    // connection behind it, together with what out held so far
+    static void write_response(ClientContext* context, const protocol::Request& request, protocol::Response& response, PooledString& out);
+    // the owning shard appended records this connection forwarded; the produce then waits for
+    // durability like a local one, or fails when the append did
+    static void forward_completed(ClientContext* context, uint32_t correlationId, uint32_t partition, const AppendOutcome& appended);
 
 private:
-    std::shared_ptr<DiskHandler> disk_handler;
-    static bool starts_with(const std::string& str, const std::string& prefix);
-    static std::string trim(const std::string& str);
-};
\ No newline at end of file
+    protocol::Response produce_batch(const protocol::Request& request, ClientContext* context);
+    protocol::Response produce_keyed(const protocol::Request& request, ClientContext* context);
+    protocol::Response produce_compressed(const protocol::Request& request, ClientContext* context);
+    protocol::Response produce(const protocol::Request& request, ClientContext* context,
+        const std::vector<std::string_view>& values, const std::vector<std::string_view>& keys = {});
+    protocol::Response produce(const protocol::Request& request, ClientContext* context, Topic& t, std::vector<PartitionBatch> batches);
+    protocol::Response create_topic(const protocol::Request& request);
+    protocol::Response acknowledge(const protocol::Request& request, ClientContext* context, const std::vector<PartitionAppend>& appended);
+    protocol::Response fetch_batch(const protocol::Request& request, ClientContext* context);
+    protocol::Response subscribe_push(const protocol::Request& request, ClientContext* context);
+    protocol::Response join_group(const protocol::Request& request, ClientContext* context);
+    protocol::Response commit_offset(const protocol::Request& request, ClientContext* context);
+    protocol::Response fetch_log(const protocol::Request& request);
+    protocol::Response offset_for_time(const protocol::Request& request);
+    size_t collect(ClientContext* context, std::string_view topic, const protocol::FetchParams& params, protocol::Response& response);
+    size_t collect_group(ClientContext* context, std::string_view topic, const protocol::FetchParams& params, protocol::Response& response);
+    void watch(ClientContext* context, std::string_view topic, uint32_t partition);
+};
@@ -0,0 +1,1041 @@
+#include "commit_log.h"
+#include "crc32c.h"
+
+#include <iostream>
+#include <chrono>
+#include <format>
+#include <filesystem>
+#include <algorithm>
+#include <cstring>
+#include <cstddef>
+#include <charconv>
+#include <thread>
+#include <unordered_map>
+
+namespace {
+    int64_t now_ms() {
+        return std::chrono::duration_cast<std::chrono::milliseconds>(
+            std::chrono::system_clock::now().time_since_epoch()).count();
+    }
+
+    // lets compaction look up keys by string_view
+    struct KeyHash {
+        using is_transparent = void;
+        size_t operator()(std::string_view key) const { return std::hash<std::string_view>{}(key); }
+    };
+
+    // clears the non-zero 4 KiB blocks of data; returns how many bytes it cleared
+    size_t zero_tail(char* data, size_t size) {
+        static const char zeros[4096] = {};
+        size_t cleared = 0;
+        for (size_t position = 0; position < size; position += sizeof(zeros)) {
+            size_t length = std::min(sizeof(zeros), size - position);
+            if (std::memcmp(data + position, zeros, length) != 0) {
+                std::memset(data + position, 0, length);
+                cleared += length;
+            }
+        }
+        return cleared;
+    }
+}
+
+std::vector<uint64_t> list_segment_offsets(const std::string& directory) {
+    std::vector<uint64_t> offsets;
+    std::error_code ec;
+    for (const auto& entry : std::filesystem::directory_iterator(directory, ec)) {
+        const auto& path = entry.path();
+        if (path.extension() != ".log")
+            continue;
+
+        std::string stem = path.stem().string();
+        if (stem.empty() || !std::all_of(stem.begin(), stem.end(), [](char c) { return c >= '0' && c <= '9'; }))
+            continue;
+        offsets.push_back(std::stoull(stem));
+    }
+    std::sort(offsets.begin(), offsets.end());
+    return offsets;
+}
+
+std::optional<DurabilityPolicy> DurabilityPolicy::parse(std::string_view spec) {
+    DurabilityPolicy policy;
+    std::string_view name = spec.substr(0, spec.find(':'));
+    std::string_view value = name.size() < spec.size() ? spec.substr(name.size() + 1) : std::string_view();
+
+    uint64_t number = 0;
+    if (!value.empty()) {
+        auto [end, ec] = std::from_chars(value.data(), value.data() + value.size(), number);
+        if (ec != std::errc() || end != value.data() + value.size() || number == 0)
+            return std::nullopt;
+    }
+
+    if (name == "none" && value.empty())
+        policy.mode = Mode::None;
+    else if (name == "always" && value.empty())
+        policy.mode = Mode::Always;
+    else if (name == "interval") {
+        policy.mode = Mode::Interval;
+        if (number)
+            policy.interval = std::chrono::milliseconds(number);
+    }
+    else if (name == "bytes") {
+        policy.mode = Mode::Bytes;
+        if (number)
+            policy.bytes = static_cast<size_t>(number);
+    }
+    else
+        return std::nullopt;
+    return policy;
+}
+
+std::optional<RetentionPolicy> RetentionPolicy::parse(std::string_view spec) {
+    RetentionPolicy policy;
+    if (spec == "none")
+        return policy;
+
+    while (!spec.empty()) {
+        std::string_view item = spec.substr(0, spec.find(','));
+        spec.remove_prefix(std::min(spec.size(), item.size() + 1));
+
+        size_t colon = item.find(':');
+        if (colon == std::string_view::npos)
+            return std::nullopt;
+        std::string_view name = item.substr(0, colon);
+        std::string_view value = item.substr(colon + 1);
+
+        uint64_t number = 0;
+        auto [end, ec] = std::from_chars(value.data(), value.data() + value.size(), number);
+        if (ec != std::errc() || end != value.data() + value.size() || number == 0)
+            return std::nullopt;
+
+        if (name == "time")
+            policy.time = std::chrono::milliseconds(number);
+        else if (name == "bytes")
+            policy.bytes = number;
+        else
+            return std::nullopt;
+    }
+
+    if (!policy.enabled())
+        return std::nullopt;
+    return policy;
+}
+
+CommitLog::CommitLog(std::string directory, size_t segmentSize, Codec codec, size_t indexIntervalBytes)
+    : dir(std::move(directory)),
+    segmentSize(segmentSize),
+    indexIntervalBytes(indexIntervalBytes),
+    compressor(find_codec(codec)) {
+    std::error_code ec;
+    std::filesystem::create_directories(dir, ec);
+    if (ec) {
+        std::cerr << "[disk error] create_directories " << dir << ": " << ec.message() << std::endl;
+        recoveryFailed = true;
+        return;
+    }
+
+    if (!recover()) {
+        // without the tail segment the next offset is unknown: an append would start over at 0
+        // and overwrite the first segment, so the log takes none until it is opened again
+        std::cerr << "[disk error] commit log recovery failed, appends are refused: " << dir << std::endl;
+        recoveryFailed = true;
+    }
+}
+
+CommitLog::~CommitLog() {
+    std::lock_guard<std::mutex> lock(mtx);
+    if (active) {
+        active->file->flush();
+        if (active->index)
+            active->index->flush();
+    }
+}
+
+std::optional<AppendResult> CommitLog::append(std::string_view key, std::string_view value) {
+    size_t bytes = sizeof(LogRecordHeader) + key.size() + value.size();
+    if (bytes > segmentSize) {
+        std::cerr << "[disk error] record too large to fit in segment" << std::endl;
+        return std::nullopt;
+    }
+
+    std::optional<uint64_t> offset = write_run(&key, &value, 1, bytes);
+    if (!offset)
+        return std::nullopt;
+    return AppendResult{ *offset, *offset + 1 };
+}
+
+std::optional<AppendResult> CommitLog::append_batch(const std::vector<std::string_view>& values, const std::vector<std::string_view>& keys) {
+    std::optional<AppendResult> result;
+    size_t start = 0;
+    auto key_size = [&](size_t i) { return keys.empty() ? 0 : keys[i].size(); };
+
+    // a record no segment can hold fails the batch before any of it is written
+    for (size_t i = 0; i < values.size(); ++i) {
+        if (sizeof(LogRecordHeader) + key_size(i) + values[i].size() > segmentSize) {
+            std::cerr << "[disk error] record too large to fit in segment" << std::endl;
+            return std::nullopt;
+        }
+    }
+
+    // one reservation per run of records that fits in a segment
+    while (start < values.size()) {
+        size_t end = start;
+        size_t bytes = 0;
+        while (end < values.size() && bytes + sizeof(LogRecordHeader) + key_size(end) + values[end].size() <= segmentSize) {
+            bytes += sizeof(LogRecordHeader) + key_size(end) + values[end].size();
+            ++end;
+        }
+
+        std::optional<uint64_t> first = write_run(keys.empty() ? nullptr : keys.data() + start, values.data() + start, end - start, bytes);
+        if (!first)
+            break;
+
+        if (!result)
+            result = AppendResult{ *first, *first };
+        result->endOffset = *first + (end - start);
+        start = end;
+    }
+
+    // a write or roll that failed part way leaves the runs before it in the log, but the batch as
+    // a whole was not appended
+    if (start < values.size())
+        return std::nullopt;
+    return result;
+}
+
+std::optional<AppendResult> CommitLog::append_compressed(Codec codec, std::string_view block) {
+    std::optional<CompressedBatch> batch = CompressedBatch::parse(block);
+    if (!batch || codec == Codec::None)
+        return std::nullopt;
+    if (sizeof(LogRecordHeader) + block.size() > segmentSize) {
+        std::cerr << "[disk error] compressed batch too large to fit in segment" << std::endl;
+        return std::nullopt;
+    }
+
+    std::optional<uint64_t> first = write_batch(codec, batch->count, block);
+    if (!first)
+        return std::nullopt;
+    return AppendResult{ *first, *first + batch->count };
+}
+
+bool CommitLog::sync() {
+    std::lock_guard<std::mutex> lock(syncMutex);
+    // taken before the snapshot, so bytes published meanwhile are at worst counted twice
+    unsyncedBytes.store(0, std::memory_order_relaxed);
+
+    std::shared_ptr<ActiveSegment> seg;
+    uint64_t end;
+    size_t published;
+    {
+        // while active is unchanged, nextOffset belongs to it; it is stored after published,
+        // so every record below end lies below published
+        std::shared_lock<std::shared_mutex> state(stateMutex);
+        seg = active;
+        if (!seg)
+            return false;
+        end = nextOffset.load(std::memory_order_acquire);
+        published = seg->published.load(std::memory_order_acquire);
+    }
+
+    size_t synced = std::min(seg->syncedPosition, published);
+    if (published > synced && !seg->file->flush_range(synced, published - synced))
+        return false;
+
+    seg->syncedPosition = published;
+    mark_durable(end);
+    return true;
+}
+
+void CommitLog::mark_durable(uint64_t offset) {
+    uint64_t durable = durableOffset.load(std::memory_order_relaxed);
+    while (durable < offset && !durableOffset.compare_exchange_weak(durable, offset, std::memory_order_acq_rel))
+        ;
+    if (durable < offset)
+        durableWaiters.notify_all();
+}
+
+uint64_t CommitLog::next_offset() const {
+    return nextOffset.load(std::memory_order_acquire);
+}
+
+uint32_t CommitLog::record_crc(const LogRecordHeader& header, std::string_view key, std::string_view value) {
+    constexpr size_t covered = sizeof(LogRecordHeader) - offsetof(LogRecordHeader, offset);
+    uint32_t crc = crc32c(0, &header.offset, covered);
+    crc = crc32c(crc, key.data(), key.size());
+    return crc32c(crc, value.data(), value.size());
+}
+
+uint64_t CommitLog::first_offset(const LogRecordHeader& header, const char* record) {
+    if (header.codec() == Codec::None)
+        return header.offset;
+
+    std::optional<CompressedBatch> batch = CompressedBatch::parse(
+        std::string_view(record + sizeof(LogRecordHeader) + header.key_size(), header.valueLength));
+    if (!batch || batch->count > header.offset + 1)
+        return header.offset;
+    return header.offset + 1 - batch->count;
+}
+
+size_t CommitLog::scan_segment(const char* data, size_t size, uint64_t& nextOffset, const RecordVisitor& visit) {
+    size_t position = 0;
+
+    while (position + sizeof(LogRecordHeader) <= size) {
+        LogRecordHeader header;
+        std::memcpy(&header, data + position, sizeof(header));
+
+        size_t recordSize = sizeof(uint32_t) + static_cast<size_t>(header.length);
+        if (header.length == 0 || position + recordSize > size ||
+            header.length != sizeof(LogRecordHeader) - sizeof(uint32_t) + header.key_size() + header.valueLength)
+            break;
+
+        const char* body = data + position + sizeof(LogRecordHeader);
+        std::string_view key(body, header.key_size());
+        std::string_view value(body + header.key_size(), header.valueLength);
+        if (record_crc(header, key, value) != header.crc)
+            break;
+
+        if (visit)
+            visit(header, position);
+
+        nextOffset = header.offset + 1;
+        position += recordSize;
+    }
+
+    return position;
+}
+
+bool CommitLog::recover() {
+    std::unique_lock<std::shared_mutex> state(stateMutex);
+
+    // a compaction pass cut short before swapping a rewritten segment in leaves its files behind
+    std::error_code ec;
+    for (const auto& entry : std::filesystem::directory_iterator(dir, ec)) {
+        if (entry.path().filename().string().find(".cleaned.") != std::string::npos)
+            std::filesystem::remove(entry.path(), ec);
+    }
+
+    segments = list_segment_offsets(dir);
+    if (segments.empty())
+        segments.push_back(0);
+    baseOffset = segments.back();
+
+    auto seg = std::make_shared<ActiveSegment>();
+    seg->base = baseOffset;
+    seg->file = create_segment_file();
+    if (!seg->file->open(get_segment_filename(baseOffset), segmentSize, true))
+        return false;
+
+    // the tail segment's index may be behind or ahead of the log after a crash, so rebuild it
+    seg->index = open_index(baseOffset);
+    if (seg->index)
+        seg->index->reset();
+
+    uint64_t recovered = baseOffset;
+    size_t end = scan_segment(seg->file->data(), seg->file->size(), recovered,
+        [&](const LogRecordHeader& header, size_t position) {
+            if (seg->index)
+                seg->index->on_append(first_offset(header, seg->file->data() + position), header.timestamp,
+                    position, sizeof(uint32_t) + header.length);
+        });
+
+    // zero whatever follows the last valid record so a torn write is not mistaken for data later;
+    // blocks that are already zero are only read, so the preallocated tail is not dirtied
+    if (size_t torn = zero_tail(seg->file->data() + end, seg->file->size() - end))
+        std::cerr << "[disk warn] cleared " << torn << " bytes of torn writes after the last valid record in " << get_segment_filename(baseOffset) << std::endl;
+
+    seg->reserved.store(((recovered - baseOffset) << positionBits) | end, std::memory_order_relaxed);
+    seg->published.store(end, std::memory_order_relaxed);
+    seg->syncedPosition = end;
+    active = std::move(seg);
+
+    nextOffset.store(recovered, std::memory_order_release);
+    durableOffset.store(recovered, std::memory_order_release);
+    return true;
+}
+
+std::shared_ptr<CommitLog::ActiveSegment> CommitLog::current_segment() const {
+    std::shared_lock<std::shared_mutex> state(stateMutex);
+    return active;
+}
+
+std::shared_ptr<CommitLog::ActiveSegment> CommitLog::open_active(uint64_t base) const {
+    auto seg = std::make_shared<ActiveSegment>();
+    seg->base = base;
+    seg->file = create_segment_file();
+    if (!seg->file->open(get_segment_filename(base), segmentSize, true)) {
+        std::cerr << "[disk error] commit log roll failed: " << dir << std::endl;
+        return nullptr;
+    }
+
+    seg->index = open_index(base);
+    if (seg->index)
+        seg->index->reset();
+    return seg;
+}
+
+bool CommitLog::roll_segment(const std::shared_ptr<ActiveSegment>& sealed) {
+    std::lock_guard<std::mutex> lock(mtx);
+    if (current_segment() != sealed)
+        return true;
+
+    uint64_t newBase = nextOffset.load(std::memory_order_acquire);
+    if (sealed) {
+        // every reservation before the sealing one fit, wait until the last of them is published
+        size_t end = static_cast<size_t>(sealed->sealedPosition.load(std::memory_order_acquire));
+        while (sealed->published.load(std::memory_order_acquire) != end)
+            std::this_thread::yield();
+
+        newBase = sealed->sealedBase;
+        sealed->file->flush();
+        if (sealed->index)
+            sealed->index->flush();
+    }
+
+    std::shared_ptr<ActiveSegment> next = open_active(newBase);
+    if (!next)
+        return false;
+
+    {
+        std::unique_lock<std::shared_mutex> state(stateMutex);
+        active = std::move(next);
+        baseOffset = newBase;
+        if (segments.empty() || segments.back() != newBase)
+            segments.push_back(newBase);
+    }
+
+    if (sealed) {
+        // the plain mapping of the old active segment is replaced by an indexed one on the next read
+        SegmentCache::get_instance().invalidate(get_segment_filename(sealed->base));
+        mark_durable(newBase);
+    }
+    return true;
+}
+
+std::shared_ptr<SegmentIndex> CommitLog::open_index(uint64_t base) const {
+    auto opened = std::make_shared<SegmentIndex>(base, indexIntervalBytes);
+    if (!opened->open(get_segment_base_path(base), segmentSize, true)) {
+        std::cerr << "[disk error] segment index open failed: " << get_segment_base_path(base) << std::endl;
+        return nullptr;
+    }
+    return opened;
+}
+
+template <typename Fill>
+std::optional<uint64_t> CommitLog::write_records(size_t count, size_t bytes, Fill&& fill) {
+    if (recoveryFailed)
+        return std::nullopt;
+    int64_t timestamp = now_ms();
+
+    while (true) {
+        std::shared_ptr<ActiveSegment> seg = current_segment();
+        if (!seg) {
+            if (!roll_segment(nullptr))
+                return std::nullopt;
+            continue;
+        }
+
+        // a sealed segment only takes more overflowing reservations, wait for its roll instead
+        uint64_t word = seg->reserved.load(std::memory_order_relaxed);
+        if ((word & positionMask) <= segmentSize)
+            word = seg->reserved.fetch_add((uint64_t(count) << positionBits) | bytes, std::memory_order_relaxed);
+
+        size_t position = static_cast<size_t>(word & positionMask);
+        uint64_t first = seg->base + (word >> positionBits);
+
+        if (position + bytes <= segmentSize) {
+            fill(seg->file->data() + position, first, timestamp);
+            publish(*seg, position, bytes, first, count);
+            return first;
+        }
+
+        if (position <= segmentSize) {
+            seg->sealedBase = first;
+            seg->sealedPosition.store(position, std::memory_order_release);
+        }
+        else {
+            while (seg->sealedPosition.load(std::memory_order_acquire) == unsealed)
+                std::this_thread::yield();
+        }
+
+        if (!roll_segment(seg))
+            return std::nullopt;
+    }
+}
+
+std::optional<uint64_t> CommitLog::write_run(const std::string_view* keys, const std::string_view* values, size_t count, size_t bytes) {
+    if (compressor && bytes <= CompressedBatch::maxRawSize) {
+        PooledString block;
+        encode_batch(block, *compressor, keys, values, count);
+        if (sizeof(LogRecordHeader) + block.size() < bytes)
+            return write_batch(compressor->id(), count, block);
+    }
+
+    return write_records(count, bytes, [&](char* dest, uint64_t first, int64_t timestamp) {
+        for (size_t i = 0; i < count; ++i) {
+            std::string_view key = keys ? keys[i] : std::string_view();
+            std::string_view value = values[i];
+            LogRecordHeader header{};
+            header.length = static_cast<uint32_t>(sizeof(LogRecordHeader) - sizeof(uint32_t) + key.size() + value.size());
+            header.offset = first + i;
+            header.timestamp = timestamp;
+            header.keyLength = static_cast<uint32_t>(key.size());
+            header.valueLength = static_cast<uint32_t>(value.size());
+            header.crc = record_crc(header, key, value);
+
+            if (!key.empty())
+                std::memcpy(dest + sizeof(header), key.data(), key.size());
+            if (!value.empty())
+                std::memcpy(dest + sizeof(header) + key.size(), value.data(), value.size());
+            std::memcpy(dest, &header, sizeof(header));
+            dest += sizeof(header) + key.size() + value.size();
+        }
+    });
+}
+
+std::optional<uint64_t> CommitLog::write_batch(Codec codec, size_t count, std::string_view block) {
+    return write_records(count, sizeof(LogRecordHeader) + block.size(), [&](char* dest, uint64_t first, int64_t timestamp) {
+        LogRecordHeader header{};
+        header.length = static_cast<uint32_t>(sizeof(LogRecordHeader) - sizeof(uint32_t) + block.size());
+        header.offset = first + count - 1;
+        header.timestamp = timestamp;
+        header.keyLength = static_cast<uint32_t>(codec) << 24;
+        header.valueLength = static_cast<uint32_t>(block.size());
+        header.crc = record_crc(header, {}, block);
+
+        std::memcpy(dest + sizeof(header), block.data(), block.size());
+        std::memcpy(dest, &header, sizeof(header));
+    });
+}
+
+void CommitLog::publish(ActiveSegment& seg, size_t position, size_t bytes, uint64_t first, size_t count) {
+    // records become visible in reservation order, so wait for the reservations before ours
+    while (seg.published.load(std::memory_order_acquire) != position)
+        std::this_thread::yield();
+
+    if (seg.index) {
+        const char* data = seg.file->data();
+        for (size_t recordPosition = position; recordPosition < position + bytes;) {
+            LogRecordHeader header;
+            std::memcpy(&header, data + recordPosition, sizeof(header));
+            size_t recordSize = sizeof(uint32_t) + static_cast<size_t>(header.length);
+            seg.index->on_append(first_offset(header, data + recordPosition), header.timestamp, recordPosition, recordSize);
+            recordPosition += recordSize;
+        }
+    }
+
+    // publish the bytes before the offset: a reader that sees offset N also sees record N
+    seg.published.store(position + bytes, std::memory_order_release);
+    nextOffset.store(first + count, std::memory_order_release);
+    unsyncedBytes.fetch_add(bytes, std::memory_order_relaxed);
+}
+
+std::optional<CommitLog::ReadTarget> CommitLog::locate(uint64_t offset) const {
+    std::shared_lock<std::shared_mutex> state(stateMutex);
+    if (offset >= nextOffset.load(std::memory_order_acquire) || segments.empty())
+        return std::nullopt;
+
+    auto it = std::upper_bound(segments.begin(), segments.end(), offset);
+    if (it != segments.begin())
+        --it;
+
+    ReadTarget target{};
+    target.base = *it;
+    target.active = active && target.base == active->base;
+    target.end = target.active ? active->published.load(std::memory_order_acquire) : segmentSize;
+    if (target.active)
+        target.activeIndex = active->index;
+    if (std::next(it) != segments.end())
+        target.nextBase = *std::next(it);
+    return target;
+}
+
+std::shared_ptr<const MappedSegment> CommitLog::map_segment(uint64_t base, bool active) const {
+    std::shared_lock<std::shared_mutex> swap(swapMutex);
+    SegmentCache& cache = SegmentCache::get_instance();
+    return active ? cache.acquire(get_segment_filename(base))
+        : cache.acquire_indexed(get_segment_base_path(base), base);
+}
+
+std::vector<LogRecord> CommitLog::read(uint64_t offset, size_t maxRecords, size_t maxBytes) const {
+    std::vector<LogRecord> records;
+    size_t bytes = 0;
+    PooledString raw;
+    std::vector<std::string_view> batchKeys;
+    std::vector<std::string_view> batchValues;
+
+    // false once the read is full, the record is then left out if it did not fit
+    auto add = [&](uint64_t recordOffset, int64_t timestamp, std::string_view key, std::string_view value) {
+        if (!records.empty() && bytes + value.size() > maxBytes)
+            return false;
+        records.push_back({ recordOffset, timestamp, PooledString(key), PooledString(value) });
+        bytes += value.size();
+        offset = recordOffset + 1;
+        return records.size() < maxRecords;
+    };
+
+    while (records.size() < maxRecords) {
+        std::optional<ReadTarget> target = locate(offset);
+        if (!target)
+            break;
+
+        std::shared_ptr<const MappedSegment> mapped = map_segment(target->base, target->active);
+        if (!mapped)
+            break;
+
+        size_t position = 0;
+        if (target->activeIndex)
+            position = target->activeIndex->lookup_offset(offset);
+        else if (mapped->index)
+            position = mapped->index->lookup_offset(offset);
+
+        size_t end = std::min(target->end, mapped->file->size());
+        const char* data = mapped->file->data();
+        bool full = false;
+
+        while (position + sizeof(LogRecordHeader) <= end) {
+            LogRecordHeader header;
+            std::memcpy(&header, data + position, sizeof(header));
+            size_t recordSize = sizeof(uint32_t) + static_cast<size_t>(header.length);
+            if (header.length == 0 || position + recordSize > end ||
+                recordSize != sizeof(LogRecordHeader) + size_t(header.key_size()) + header.valueLength)
+                break;
+
+            if (header.offset >= offset) {
+                const char* body = data + position + sizeof(LogRecordHeader);
+                std::string_view key(body, header.key_size());
+                std::string_view value(body + header.key_size(), header.valueLength);
+
+                if (header.codec() == Codec::None)
+                    full = !add(header.offset, header.timestamp, key, value);
+                else {
+                    const CompressionCodec* codec = find_codec(header.codec());
+                    batchKeys.clear();
+                    batchValues.clear();
+                    if (!codec || !decode_batch(*codec, value, raw, batchKeys, batchValues) || batchValues.size() > header.offset + 1) {
+                        // skipped rather than read again and again
+                        std::cerr << "[disk error] unreadable compressed batch ending at offset " << header.offset << " in " << dir << std::endl;
+                        offset = header.offset + 1;
+                    }
+                    else {
+                        uint64_t batchFirst = header.offset + 1 - batchValues.size();
+                        for (size_t i = 0; i < batchValues.size() && !full; ++i) {
+                            if (batchFirst + i >= offset)
+                                full = !add(batchFirst + i, header.timestamp, batchKeys[i], batchValues[i]);
+                        }
+                    }
+                }
+                if (full)
+                    break;
+            }
+            position += recordSize;
+        }
+
+        if (full || target->active || !target->nextBase)
+            break;
+        offset = std::max(offset, *target->nextBase);
+    }
+
+    return records;
+}
+
+std::optional<LogSlice> CommitLog::slice(uint64_t offset, size_t maxBytes) const {
+    while (true) {
+        std::optional<ReadTarget> target = locate(offset);
+        if (!target)
+            return std::nullopt;
+
+        std::shared_ptr<const MappedSegment> mapped = map_segment(target->base, target->active);
+        if (!mapped)
+            return std::nullopt;
+
+        size_t position = 0;
+        if (target->activeIndex)
+            position = target->activeIndex->lookup_offset(offset);
+        else if (mapped->index)
+            position = mapped->index->lookup_offset(offset);
+
+        // only the headers are read here, the record bodies go from the file to the socket
+        size_t end = std::min(target->end, mapped->file->size());
+        const char* data = mapped->file->data();
+        std::optional<LogSlice> slice;
+
+        while (position + sizeof(LogRecordHeader) <= end) {
+            LogRecordHeader header;
+            std::memcpy(&header, data + position, sizeof(header));
+            size_t recordSize = sizeof(uint32_t) + static_cast<size_t>(header.length);
+            if (header.length == 0 || position + recordSize > end ||
+                recordSize != sizeof(LogRecordHeader) + size_t(header.key_size()) + header.valueLength)
+                break;
+
+            if (header.offset >= offset) {
+                if (!slice) {
+                    uint64_t first = first_offset(header, data + position);
+                    slice = LogSlice{ mapped, position, 0, first, first };
+                }
+                else if (slice->length + recordSize > maxBytes)
+                    break;
+                slice->length += recordSize;
+                slice->endOffset = header.offset + 1;
+            }
+            position += recordSize;
+        }
+
+        if (slice || target->active || !target->nextBase)
+            return slice;
+        offset = std::max(offset, *target->nextBase);
+    }
+}
+
+std::optional<uint64_t> CommitLog::offset_for_time(int64_t timestamp) const {
+    std::vector<uint64_t> snapshot;
+    {
+        std::shared_lock<std::shared_mutex> state(stateMutex);
+        snapshot = segments;
+    }
+    if (snapshot.empty())
+        return std::nullopt;
+
+    auto first_timestamp = [&](size_t i) -> std::optional<int64_t> {
+        auto mapped = map_segment(snapshot[i], i + 1 == snapshot.size());
+        if (!mapped || mapped->file->size() < sizeof(LogRecordHeader))
+            return std::nullopt;
+        LogRecordHeader header;
+        std::memcpy(&header, mapped->file->data(), sizeof(header));
+        if (header.length == 0)
+            return std::nullopt;
+        return header.timestamp;
+    };
+
+    // last segment that starts strictly before the timestamp; earlier ones end before it starts
+    size_t lo = 0;
+    size_t hi = snapshot.size();
+    while (hi - lo > 1) {
+        size_t mid = lo + (hi - lo) / 2;
+        std::optional<int64_t> ts = first_timestamp(mid);
+        if (ts && *ts < timestamp)
+            lo = mid;
+        else
+            hi = mid;
+    }
+
+    for (size_t i = lo; i < snapshot.size(); ++i) {
+        std::optional<ReadTarget> target = locate(snapshot[i]);
+        if (!target)
+            break;
+
+        std::shared_ptr<const MappedSegment> mapped = map_segment(target->base, target->active);
+        if (!mapped)
+            continue;
+
+        size_t position = 0;
+        if (target->activeIndex)
+            position = target->activeIndex->lookup_time(timestamp);
+        else if (mapped->index)
+            position = mapped->index->lookup_time(timestamp);
+
+        size_t end = std::min(target->end, mapped->file->size());
+        const char* data = mapped->file->data();
+        while (position + sizeof(LogRecordHeader) <= end) {
+            LogRecordHeader header;
+            std::memcpy(&header, data + position, sizeof(header));
+            if (header.length == 0 || position + sizeof(uint32_t) + header.length > end)
+                break;
+            if (header.timestamp >= timestamp)
+                return first_offset(header, data + position);
+            position += sizeof(uint32_t) + header.length;
+        }
+    }
+
+    return std::nullopt;
+}
+
+uint64_t CommitLog::apply_retention(const RetentionPolicy& policy) {
+    if (!policy.enabled())
+        return 0;
+
+    std::vector<uint64_t> snapshot;
+    uint64_t activeBase;
+    {
+        std::shared_lock<std::shared_mutex> state(stateMutex);
+        if (!active)
+            return 0;
+        snapshot = segments;
+        activeBase = active->base;
+    }
+
+    auto file_bytes = [&](uint64_t base) -> uint64_t {
+        std::error_code ec;
+        uintmax_t size = std::filesystem::file_size(get_segment_filename(base), ec);
+        return ec ? 0 : size;
+    };
+
+    uint64_t total = 0;
+    for (uint64_t base : snapshot)
+        total += file_bytes(base);
+
+    int64_t cutoff = now_ms() - policy.time.count();
+    uint64_t freed = 0;
+    // only a prefix of the log is deleted, so the remaining offsets stay contiguous with the active segment
+    for (uint64_t base : snapshot) {
+        if (base >= activeBase)
+            break;
+
+        bool expired = policy.bytes > 0 && total > policy.bytes;
+        if (!expired && policy.time.count() > 0) {
+            std::optional<int64_t> newest = newest_timestamp(base);
+            expired = !newest || *newest < cutoff;
+        }
+        if (!expired)
+            break;
+
+        uint64_t size = file_bytes(base);
+        remove_segment(base);
+        total -= size;
+        freed += size;
+    }
+    return freed;
+}
+
+uint64_t CommitLog::compact(const CompactionThrottle& throttle) {
+    std::vector<uint64_t> snapshot;
+    uint64_t activeBase;
+    size_t activeEnd;
+    {
+        std::shared_lock<std::shared_mutex> state(stateMutex);
+        if (!active)
+            return 0;
+        snapshot = segments;
+        activeBase = active->base;
+        activeEnd = active->published.load(std::memory_order_acquire);
+    }
+    if (activeBase == compactedBase)
+        return 0;
+    compactedBase = activeBase;
+    if (snapshot.size() < 2)
+        return 0;
+
+    // latest offset of every key up to the snapshot. The keys are copied, so no mapping is held
+    // across the pass: Windows refuses to replace a file while a view of it is mapped.
+    std::unordered_map<std::string, uint64_t, KeyHash, std::equal_to<>> latest;
+    PooledString raw;
+    std::vector<std::string_view> keys;
+    std::vector<std::string_view> values;
+
+    // a batch's records, or nothing when it cannot be decoded; such a batch is always kept
+    auto decode = [&](const LogRecordHeader& header, const char* record) {
+        keys.clear();
+        values.clear();
+        const CompressionCodec* codec = find_codec(header.codec());
+        std::string_view block(record + sizeof(LogRecordHeader) + header.key_size(), header.valueLength);
+        if (!codec || !decode_batch(*codec, block, raw, keys, values) || values.size() > header.offset + 1) {
+            keys.clear();
+            values.clear();
+        }
+        return header.offset + 1 - values.size();
+    };
+
+    auto set_latest = [&](std::string_view key, uint64_t offset) {
+        auto it = latest.find(key);
+        if (it == latest.end())
+            latest.emplace(std::string(key), offset);
+        else
+            it->second = offset;
+    };
+
+    for (uint64_t base : snapshot) {
+        bool isActive = base == activeBase;
+        std::shared_ptr<const MappedSegment> segment = map_segment(base, isActive);
+        if (!segment)
+            continue;
+
+        const char* data = segment->file->data();
+        size_t end = isActive ? std::min(activeEnd, segment->file->size()) : segment->file->size();
+        uint64_t next = base;
+        scan_segment(data, end, next, [&](const LogRecordHeader& header, size_t position) {
+            if (header.codec() == Codec::None) {
+                if (header.key_size() > 0)
+                    set_latest(std::string_view(data + position + sizeof(LogRecordHeader), header.key_size()), header.offset);
+                return;
+            }
+
+            uint64_t first = decode(header, data + position);
+            for (size_t i = 0; i < keys.size(); ++i) {
+                if (!keys[i].empty())
+                    set_latest(keys[i], first + i);
+            }
+        });
+        if (!throttle(end))
+            return 0;
+    }
+
+    auto is_latest = [&](std::string_view key, uint64_t offset) {
+        auto it = latest.find(key);
+        return key.empty() || it == latest.end() || it->second == offset;
+    };
+
+    uint64_t freed = 0;
+    for (size_t s = 0; s < snapshot.size() && snapshot[s] < activeBase; ++s) {
+        std::shared_ptr<const MappedSegment> segment = map_segment(snapshot[s], false);
+        if (!segment)
+            continue;
+
+        const char* data = segment->file->data();
+        std::vector<std::pair<size_t, size_t>> kept;
+        size_t keptBytes = 0;
+        size_t totalBytes = 0;
+        uint64_t next = snapshot[s];
+        scan_segment(data, segment->file->size(), next, [&](const LogRecordHeader& header, size_t position) {
+            size_t recordSize = sizeof(uint32_t) + static_cast<size_t>(header.length);
+            totalBytes += recordSize;
+
+            bool keep;
+            if (header.codec() == Codec::None)
+                keep = is_latest(std::string_view(data + position + sizeof(LogRecordHeader), header.key_size()), header.offset);
+            else {
+                uint64_t first = decode(header, data + position);
+                keep = values.empty();
+                for (size_t i = 0; i < keys.size() && !keep; ++i)
+                    keep = is_latest(keys[i], first + i);
+            }
+
+            if (keep) {
+                kept.emplace_back(position, recordSize);
+                keptBytes += recordSize;
+            }
+        });
+
+        if (keptBytes == totalBytes)
+            continue;
+
+        size_t before = segment->file->size();
+        if (rewrite_segment(snapshot[s], std::move(segment), kept, keptBytes))
+            freed += before - keptBytes;
+        if (!throttle(keptBytes))
+            break;
+    }
+    return freed;
+}
+
+std::optional<int64_t> CommitLog::newest_timestamp(uint64_t base) const {
+    std::shared_ptr<const MappedSegment> mapped = map_segment(base, false);
+    if (!mapped)
+        return std::nullopt;
+
+    std::optional<int64_t> newest;
+    const char* data = mapped->file->data();
+    size_t end = mapped->file->size();
+    for (size_t position = 0; position + sizeof(LogRecordHeader) <= end;) {
+        LogRecordHeader header;
+        std::memcpy(&header, data + position, sizeof(header));
+        if (header.length == 0 || position + sizeof(uint32_t) + header.length > end)
+            break;
+        newest = std::max(newest.value_or(header.timestamp), header.timestamp);
+        position += sizeof(uint32_t) + header.length;
+    }
+    return newest;
+}
+
+void CommitLog::remove_segment(uint64_t base) {
+    {
+        std::unique_lock<std::shared_mutex> state(stateMutex);
+        std::erase(segments, base);
+    }
+
+    // on POSIX readers still holding the mapping keep reading it; Windows refuses while one is
+    // mapped, and the files left behind are listed again and expire after a restart
+    std::unique_lock<std::shared_mutex> swap(swapMutex);
+    std::string basePath = get_segment_base_path(base);
+    SegmentCache::get_instance().invalidate(basePath);
+    for (const char* extension : { ".log", ".index", ".timeindex" }) {
+        std::error_code ec;
+        std::filesystem::remove(basePath + extension, ec);
+        if (ec)
+            std::cerr << "[disk error] remove " << basePath << extension << ": " << ec.message() << std::endl;
+    }
+}
+
+// The records are written to <base>.cleaned.* and swapped in: the old index goes first, then the
+// log is replaced in one rename, then the new index follows. A crash in between leaves a log
+// without an index, which is read from its start, never a log with another log's index.
+bool CommitLog::rewrite_segment(uint64_t base, std::shared_ptr<const MappedSegment> source,
+    const std::vector<std::pair<size_t, size_t>>& records, size_t bytes) {
+    const char* data = source->file->data();
+    if (bytes == 0) {
+        source.reset();
+        remove_segment(base);
+        return true;
+    }
+
+    std::string basePath = get_segment_base_path(base);
+    std::string cleanedPath = basePath + ".cleaned";
+    auto remove_cleaned = [&] {
+        std::error_code ec;
+        for (const char* extension : { ".log", ".index", ".timeindex" })
+            std::filesystem::remove(cleanedPath + extension, ec);
+    };
+
+    bool indexed;
+    {
+        std::unique_ptr<SegmentFile> file = create_segment_file();
+        if (!file->open(cleanedPath + ".log", bytes, true)) {
+            remove_cleaned();
+            return false;
+        }
+
+        SegmentIndex index(base, indexIntervalBytes);
+        indexed = index.open(cleanedPath, segmentSize, true);
+        if (indexed)
+            index.reset();
+
+        size_t position = 0;
+        for (auto [from, size] : records) {
+            std::memcpy(file->data() + position, data + from, size);
+            if (indexed) {
+                LogRecordHeader header;
+                std::memcpy(&header, data + from, sizeof(header));
+                index.on_append(first_offset(header, data + from), header.timestamp, position, size);
+            }
+            position += size;
+        }
+
+        source.reset();
+        if (indexed)
+            index.flush();
+        if (!file->flush()) {
+            std::cerr << "[disk error] compacted segment flush failed: " << cleanedPath << ".log" << std::endl;
+            file->close();
+            index.close();
+            remove_cleaned();
+            return false;
+        }
+    }
+
+    std::unique_lock<std::shared_mutex> swap(swapMutex);
+    SegmentCache::get_instance().invalidate(basePath);
+    std::error_code ec;
+    std::filesystem::remove(basePath + ".index", ec);
+    std::filesystem::remove(basePath + ".timeindex", ec);
+    std::filesystem::rename(cleanedPath + ".log", basePath + ".log", ec);
+    if (ec) {
+        std::cerr << "[disk error] compacted segment rename " << basePath << ".log: " << ec.message() << std::endl;
+        remove_cleaned();
+        return false;
+    }
+    if (indexed) {
+        std::filesystem::rename(cleanedPath + ".index", basePath + ".index", ec);
+        if (!ec)
+            std::filesystem::rename(cleanedPath + ".timeindex", basePath + ".timeindex", ec);
+        if (ec) {
+            std::filesystem::remove(basePath + ".index", ec);
+            remove_cleaned();
+        }
+    }
+    return true;
+}
+
+std::string CommitLog::get_segment_base_path(uint64_t base) const {
+    return std::format("{}/{:020}", dir, base);
+}
+
+std::string CommitLog::get_segment_filename(uint64_t base) const {
+    return get_segment_base_path(base) + ".log";
+}
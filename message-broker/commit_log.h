@@ -0,0 +1,238 @@
+#pragma once
+
+#include <string>
+#include <string_view>
+#include <mutex>
+#include <shared_mutex>
+#include <atomic>
+#include <memory>
+#include <optional>
+#include <vector>
+#include <cstdint>
+#include <functional>
+#include <chrono>
+
+#include "segment_file.h"
+#include "segment_index.h"
+#include "segment_cache.h"
+#include "buffer_pool.h"
+#include "waiter.h"
+#include "compression.h"
+
+// On-disk record, native (little-endian) byte order. crc covers everything after the crc field.
+// A record whose codec is not None is a compressed batch: its value is a CompressedBatch holding
+// the records up to and including offset, and it has no key of its own.
+struct LogRecordHeader {
+    static constexpr uint32_t keyLengthMask = 0x00ffffff;
+
+    uint32_t length;        // bytes after this field
+    uint32_t crc;
+    uint64_t offset;
+    int64_t timestamp;      // ms since epoch
+    uint32_t keyLength;     // codec in the top byte
+    uint32_t valueLength;
+
+    uint32_t key_size() const { return keyLength & keyLengthMask; }
+    Codec codec() const { return static_cast<Codec>(keyLength >> 24); }
+};
+static_assert(sizeof(LogRecordHeader) == 32);
+
+struct LogRecord {
+    uint64_t offset;
+    int64_t timestamp;
+    PooledString key;
+    PooledString value;
+};
+
+// When appended records are forced to disk and acknowledged:
+//   none      never forced by the broker (segment rolls and shutdown still flush), acks are immediate
+//   interval  forced every interval
+//   bytes     forced once a log has `bytes` unsynced bytes, and at least every interval
+//   always    forced after every append
+struct DurabilityPolicy {
+    enum class Mode { None, Interval, Bytes, Always };
+
+    Mode mode = Mode::Interval;
+    std::chrono::milliseconds interval{ 1000 };
+    size_t bytes = 1024 * 1024;
+
+    // "none", "interval:<ms>", "bytes:<n>" or "always"
+    static std::optional<DurabilityPolicy> parse(std::string_view spec);
+};
+
+// Sealed segments the log cleaner deletes from the start of a log: a segment goes once all its
+// records are older than time, or while the log's segment files are larger than bytes. Zero
+// disables either limit; the active segment is never deleted.
+struct RetentionPolicy {
+    std::chrono::milliseconds time{ 0 };
+    uint64_t bytes = 0;
+
+    bool enabled() const { return time.count() > 0 || bytes > 0; }
+
+    // "none", or "time:<ms>", "bytes:<n>" or both separated by a comma
+    static std::optional<RetentionPolicy> parse(std::string_view spec);
+};
+
+// told the bytes compaction read or wrote since the last call, and may sleep to pace it;
+// false stops the compaction pass
+using CompactionThrottle = std::function<bool(size_t bytes)>;
+
+// offsets taken by one append; a batch larger than a segment is split and may interleave with other producers
+struct AppendResult {
+    uint64_t firstOffset;
+    uint64_t endOffset;     // one past the last appended record
+};
+
+// whole on-disk records of one segment, sent to consumers straight from the file
+struct LogSlice {
+    std::shared_ptr<const MappedSegment> segment;
+    size_t position;
+    size_t length;
+    uint64_t firstOffset;
+    uint64_t endOffset;     // one past the last record in the slice
+};
+
+// Append-only per-topic log: <directory>/<base offset>.log segments of binary records.
+// Producers reserve (offset, position) ranges of the active segment with one atomic add and
+// copy their records without a lock; records are then published in reservation order. The
+// producer whose reservation no longer fits seals the segment and rolls it under mtx.
+// Readers snapshot the segment list under stateMutex, bound the active segment by its
+// published position and read through the shared SegmentCache mappings. sync() forces the
+// published records to disk and advances durable_offset().
+class CommitLog {
+public:
+    // with a codec, appended runs of records are stored as compressed batches when that saves space
+    CommitLog(std::string directory, size_t segmentSize, Codec codec = Codec::None, size_t indexIntervalBytes = 4096);
+    ~CommitLog();
+
+    CommitLog(const CommitLog&) = delete;
+    CommitLog& operator=(const CommitLog&) = delete;
+
+    std::optional<AppendResult> append(std::string_view key, std::string_view value);
+    // keys is empty or holds one key per value. nullopt without writing anything when a record does
+    // not fit in a segment; a write or segment roll that fails part way leaves the runs before it.
+    std::optional<AppendResult> append_batch(const std::vector<std::string_view>& values, const std::vector<std::string_view>& keys = {});
+    // stores a batch compressed by the producer as it is
+    std::optional<AppendResult> append_compressed(Codec codec, std::string_view block);
+    // forces published records to disk; called by the group-commit thread
+    bool sync();
+
+    // reads from offset (or the log start if offset is older), at least one record if any;
+    // compressed batches are expanded
+    std::vector<LogRecord> read(uint64_t offset, size_t maxRecords, size_t maxBytes) const;
+    // the records from offset (or the log start) on, as raw bytes of one segment; at least one record if any.
+    // A compressed batch is sent whole, so the slice may start before offset.
+    std::optional<LogSlice> slice(uint64_t offset, size_t maxBytes) const;
+    // first offset whose timestamp is >= timestamp
+    std::optional<uint64_t> offset_for_time(int64_t timestamp) const;
+
+    // deletes the sealed segments the policy expires, oldest first; returns the bytes freed.
+    // Reads from an offset before the new log start begin at the start.
+    uint64_t apply_retention(const RetentionPolicy& policy);
+    // Rewrites the sealed segments without the records that a later record with the same key
+    // replaces. Keyless records are kept, and a compressed batch is kept whole while any of its
+    // records is the latest of its key. Runs only when a segment was sealed since the last pass;
+    // returns the bytes freed. One caller at a time (the log cleaner).
+    uint64_t compact(const CompactionThrottle& throttle);
+
+    uint64_t next_offset() const;
+    // every offset below this one is on disk
+    uint64_t durable_offset() const { return durableOffset.load(std::memory_order_acquire); }
+    size_t unsynced_bytes() const { return unsyncedBytes.load(std::memory_order_relaxed); }
+    // one-shot wakeup the next time durable_offset advances
+    void watch_durable(const std::shared_ptr<Waiter>& waiter) { durableWaiters.watch(waiter); }
+    const std::string& directory() const { return dir; }
+    // false when the directory or the tail segment could not be opened; such a log refuses
+    // appends until it is opened again
+    bool usable() const { return !recoveryFailed; }
+
+    using RecordVisitor = std::function<void(const LogRecordHeader&, size_t position)>;
+
+    static uint32_t record_crc(const LogRecordHeader& header, std::string_view key, std::string_view value);
+    // offset of the record, or of the first record of a compressed batch
+    static uint64_t first_offset(const LogRecordHeader& header, const char* record);
+    // returns the byte position just past the last valid record
+    static size_t scan_segment(const char* data, size_t size, uint64_t& nextOffset, const RecordVisitor& visit = {});
+
+private:
+    // reservation word of the active segment: relative offset << positionBits | byte position.
+    // Reservations that overflow the segment keep adding, so positions get headroom past segmentSize.
+    static constexpr unsigned positionBits = 36;
+    static constexpr uint64_t positionMask = (uint64_t(1) << positionBits) - 1;
+    static constexpr uint64_t unsealed = UINT64_MAX;
+
+    struct ActiveSegment {
+        uint64_t base = 0;
+        std::unique_ptr<SegmentFile> file;
+        std::shared_ptr<SegmentIndex> index;
+        std::atomic<uint64_t> reserved{ 0 };
+        // end of the records visible to readers, advanced in reservation order
+        std::atomic<size_t> published{ 0 };
+        // set by the first reservation that did not fit: where the segment ends and the next one starts
+        std::atomic<uint64_t> sealedPosition{ unsealed };
+        uint64_t sealedBase = 0;
+        size_t syncedPosition = 0;
+    };
+
+    // serializes segment rolls
+    mutable std::mutex mtx;
+    // guards active, segments and baseOffset
+    mutable std::shared_mutex stateMutex;
+    // held shared while a reader maps a sealed segment, and exclusively while the log cleaner
+    // replaces or deletes segment files, so a reader never pairs a log with another one's index
+    mutable std::shared_mutex swapMutex;
+    std::mutex syncMutex;
+    std::string dir;
+    size_t segmentSize;
+    size_t indexIntervalBytes;
+    const CompressionCodec* compressor;
+    std::atomic<uint64_t> nextOffset{ 0 };
+    std::atomic<uint64_t> durableOffset{ 0 };
+    std::atomic<size_t> unsyncedBytes{ 0 };
+    uint64_t baseOffset = 0;
+    std::vector<uint64_t> segments;
+    std::shared_ptr<ActiveSegment> active;
+    // set by the constructor only
+    bool recoveryFailed = false;
+    WaiterList durableWaiters;
+    // base of the active segment at the last compaction pass; only the log cleaner touches it
+    uint64_t compactedBase = UINT64_MAX;
+
+    struct ReadTarget {
+        uint64_t base;
+        size_t end;
+        bool active;
+        std::shared_ptr<SegmentIndex> activeIndex;
+        std::optional<uint64_t> nextBase;
+    };
+
+    bool recover();
+    std::shared_ptr<ActiveSegment> current_segment() const;
+    std::shared_ptr<ActiveSegment> open_active(uint64_t base) const;
+    // replaces sealed (or the active segment a failed roll left missing) with a new one; false if that failed
+    bool roll_segment(const std::shared_ptr<ActiveSegment>& sealed);
+    std::shared_ptr<SegmentIndex> open_index(uint64_t base) const;
+    // reserves count offsets and bytes of the active segment, rolling it when they do not fit, and
+    // has fill(dest, first offset, timestamp) write the records; returns the first offset
+    template <typename Fill>
+    std::optional<uint64_t> write_records(size_t count, size_t bytes, Fill&& fill);
+    // appends records that fit in one segment, as one compressed batch if that is smaller;
+    // keys is null for keyless records
+    std::optional<uint64_t> write_run(const std::string_view* keys, const std::string_view* values, size_t count, size_t bytes);
+    std::optional<uint64_t> write_batch(Codec codec, size_t count, std::string_view block);
+    void publish(ActiveSegment& seg, size_t position, size_t bytes, uint64_t first, size_t count);
+    void mark_durable(uint64_t offset);
+    std::optional<ReadTarget> locate(uint64_t offset) const;
+    std::shared_ptr<const MappedSegment> map_segment(uint64_t base, bool active) const;
+    std::optional<int64_t> newest_timestamp(uint64_t base) const;
+    // removes a sealed segment from the log and deletes its files
+    void remove_segment(uint64_t base);
+    // replaces a sealed segment with the records at the given (position, size) ranges of source,
+    // and releases the source mapping before swapping the files
+    bool rewrite_segment(uint64_t base, std::shared_ptr<const MappedSegment> source,
+        const std::vector<std::pair<size_t, size_t>>& records, size_t bytes);
+    std::string get_segment_base_path(uint64_t base) const;
+    std::string get_segment_filename(uint64_t base) const;
+};
+
+std::vector<uint64_t> list_segment_offsets(const std::string& directory);
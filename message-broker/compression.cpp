@@ -0,0 +1,245 @@
+#include "compression.h"
+#include "protocol.h"
+
+#include <algorithm>
+#include <array>
+#include <cstring>
+
+namespace {
+    uint32_t load_u32(const uint8_t* p) {
+        uint32_t value;
+        std::memcpy(&value, p, sizeof(value));
+        return value;
+    }
+
+    uint32_t get_u32(const char* p) {
+        const auto* b = reinterpret_cast<const unsigned char*>(p);
+        return (static_cast<uint32_t>(b[0]) << 24) | (static_cast<uint32_t>(b[1]) << 16) |
+            (static_cast<uint32_t>(b[2]) << 8) | static_cast<uint32_t>(b[3]);
+    }
+
+    // Greedy single-pass LZ77 writing the LZ4 block format, so any LZ4 library decompresses it.
+    // Matches are found through a hash of the next 4 bytes; runs without matches are skipped faster
+    // the longer they get, which keeps incompressible input cheap.
+    class LzCodec final : public CompressionCodec {
+    public:
+        Codec id() const override { return Codec::Lz; }
+        std::string_view name() const override { return "lz"; }
+
+        size_t max_compressed_size(size_t size) const override {
+            return size + size / 255 + 16;
+        }
+
+        size_t compress(std::string_view input, char* dest) const override {
+            const auto* src = reinterpret_cast<const uint8_t*>(input.data());
+            auto* out = reinterpret_cast<uint8_t*>(dest);
+            size_t size = input.size();
+            size_t anchor = 0;
+
+            if (size > matchFindLimit) {
+                std::array<uint32_t, size_t(1) << hashBits> table{};
+                size_t limit = size - matchFindLimit;
+                size_t matchEnd = size - lastLiterals;
+                size_t pos = 0;
+
+                while (pos < limit) {
+                    uint32_t sequence = load_u32(src + pos);
+                    uint32_t& slot = table[(sequence * 2654435761u) >> (32 - hashBits)];
+                    size_t candidate = slot;
+                    slot = static_cast<uint32_t>(pos);
+
+                    if (candidate >= pos || pos - candidate > maxDistance || load_u32(src + candidate) != sequence) {
+                        pos += 1 + ((pos - anchor) >> 6);
+                        continue;
+                    }
+
+                    while (pos > anchor && candidate > 0 && src[pos - 1] == src[candidate - 1]) {
+                        --pos;
+                        --candidate;
+                    }
+                    size_t length = minMatch;
+                    while (pos + length < matchEnd && src[pos + length] == src[candidate + length])
+                        ++length;
+
+                    out = write_token(out, pos - anchor, length - minMatch);
+                    out = write_length(out, pos - anchor);
+                    std::memcpy(out, src + anchor, pos - anchor);
+                    out += pos - anchor;
+                    *out++ = static_cast<uint8_t>(pos - candidate);
+                    *out++ = static_cast<uint8_t>((pos - candidate) >> 8);
+                    out = write_length(out, length - minMatch);
+
+                    pos += length;
+                    anchor = pos;
+                }
+            }
+
+            // the block always ends with a literal-only sequence
+            out = write_token(out, size - anchor, 0);
+            out = write_length(out, size - anchor);
+            std::memcpy(out, src + anchor, size - anchor);
+            out += size - anchor;
+            return static_cast<size_t>(out - reinterpret_cast<uint8_t*>(dest));
+        }
+
+        bool decompress(std::string_view input, char* dest, size_t size) const override {
+            const auto* src = reinterpret_cast<const uint8_t*>(input.data());
+            auto* out = reinterpret_cast<uint8_t*>(dest);
+            size_t in = 0;
+            size_t written = 0;
+
+            while (in < input.size()) {
+                uint8_t token = src[in++];
+
+                size_t literals = token >> 4;
+                if (!read_length(src, input.size(), in, literals) ||
+                    literals > input.size() - in || literals > size - written)
+                    return false;
+                std::memcpy(out + written, src + in, literals);
+                in += literals;
+                written += literals;
+
+                if (in == input.size())
+                    return written == size;
+
+                if (input.size() - in < 2)
+                    return false;
+                size_t distance = src[in] | (size_t(src[in + 1]) << 8);
+                in += 2;
+
+                size_t length = token & 0x0f;
+                if (!read_length(src, input.size(), in, length))
+                    return false;
+                length += minMatch;
+                if (distance == 0 || distance > written || length > size - written)
+                    return false;
+
+                // an overlapping match repeats the bytes it is copying, so it goes byte by byte
+                const uint8_t* match = out + written - distance;
+                if (distance >= length)
+                    std::memcpy(out + written, match, length);
+                else {
+                    for (size_t i = 0; i < length; ++i)
+                        out[written + i] = match[i];
+                }
+                written += length;
+            }
+            return false;
+        }
+
+    private:
+        static constexpr size_t minMatch = 4;
+        // no match starts in the last 12 bytes and the last 5 bytes are always literals
+        static constexpr size_t matchFindLimit = 12;
+        static constexpr size_t lastLiterals = 5;
+        static constexpr size_t maxDistance = 65535;
+        static constexpr unsigned hashBits = 12;
+
+        static uint8_t* write_token(uint8_t* out, size_t literals, size_t matchCode) {
+            *out++ = static_cast<uint8_t>((std::min<size_t>(literals, 15) << 4) | std::min<size_t>(matchCode, 15));
+            return out;
+        }
+
+        // lengths of 15 and more continue in bytes of 255 and a final smaller byte
+        static uint8_t* write_length(uint8_t* out, size_t length) {
+            if (length < 15)
+                return out;
+            for (length -= 15; length >= 255; length -= 255)
+                *out++ = 255;
+            *out++ = static_cast<uint8_t>(length);
+            return out;
+        }
+
+        static bool read_length(const uint8_t* src, size_t size, size_t& in, size_t& length) {
+            if (length != 15)
+                return true;
+            uint8_t byte;
+            do {
+                if (in >= size)
+                    return false;
+                byte = src[in++];
+                length += byte;
+            } while (byte == 255);
+            return true;
+        }
+    };
+
+    std::array<std::unique_ptr<CompressionCodec>, 256>& registry() {
+        static std::array<std::unique_ptr<CompressionCodec>, 256> codecs = [] {
+            std::array<std::unique_ptr<CompressionCodec>, 256> builtin;
+            builtin[static_cast<size_t>(Codec::Lz)] = std::make_unique<LzCodec>();
+            return builtin;
+        }();
+        return codecs;
+    }
+}
+
+void register_codec(std::unique_ptr<CompressionCodec> codec) {
+    if (codec && codec->id() != Codec::None)
+        registry()[static_cast<size_t>(codec->id())] = std::move(codec);
+}
+
+const CompressionCodec* find_codec(Codec id) {
+    return registry()[static_cast<size_t>(id)].get();
+}
+
+const CompressionCodec* find_codec(std::string_view name) {
+    for (const auto& codec : registry()) {
+        if (codec && codec->name() == name)
+            return codec.get();
+    }
+    return nullptr;
+}
+
+std::optional<CompressedBatch> CompressedBatch::parse(std::string_view block) {
+    if (block.size() < headerSize)
+        return std::nullopt;
+
+    CompressedBatch batch{ get_u32(block.data()), get_u32(block.data() + 4), block.substr(headerSize) };
+    if (batch.count == 0 || batch.rawSize > maxRawSize)
+        return std::nullopt;
+    return batch;
+}
+
+void encode_batch(PooledString& out, const CompressionCodec& codec, const std::string_view* keys, const std::string_view* values, size_t count) {
+    size_t rawSize = 0;
+    for (size_t i = 0; i < count; ++i)
+        rawSize += 8 + (keys ? keys[i].size() : 0) + values[i].size();
+
+    PooledString raw;
+    raw.reserve(rawSize);
+    for (size_t i = 0; i < count; ++i) {
+        protocol::append_record(raw, keys ? keys[i] : std::string_view());
+        protocol::append_record(raw, values[i]);
+    }
+
+    size_t start = out.size();
+    protocol::encode_u32(out, static_cast<uint32_t>(count));
+    protocol::encode_u32(out, static_cast<uint32_t>(raw.size()));
+    out.resize(start + CompressedBatch::headerSize + codec.max_compressed_size(raw.size()));
+    size_t compressed = codec.compress(raw, out.data() + start + CompressedBatch::headerSize);
+    out.resize(start + CompressedBatch::headerSize + compressed);
+}
+
+bool decode_batch(const CompressionCodec& codec, std::string_view block, PooledString& raw,
+    std::vector<std::string_view>& keys, std::vector<std::string_view>& values) {
+    std::optional<CompressedBatch> batch = CompressedBatch::parse(block);
+    if (!batch)
+        return false;
+
+    raw.resize(batch->rawSize);
+    if (!codec.decompress(batch->data, raw.data(), raw.size()))
+        return false;
+
+    std::vector<std::string_view> records;
+    if (!protocol::parse_records(raw, records) || records.size() != size_t(batch->count) * 2)
+        return false;
+
+    keys.reserve(keys.size() + batch->count);
+    values.reserve(values.size() + batch->count);
+    for (size_t i = 0; i < records.size(); i += 2) {
+        keys.push_back(records[i]);
+        values.push_back(records[i + 1]);
+    }
+    return true;
+}
@@ -0,0 +1,61 @@
+#pragma once
+
+#include <memory>
+#include <optional>
+#include <string_view>
+#include <vector>
+#include <cstddef>
+#include <cstdint>
+
+#include "buffer_pool.h"
+
+// Codec ids are written to the commit log and sent to clients, so an id never changes meaning.
+enum class Codec : uint8_t {
+    None = 0,
+    // LZ4 block format
+    Lz = 1,
+};
+
+// One compression algorithm. The built-in codecs are always registered; others are added with
+// register_codec before the engines start.
+class CompressionCodec {
+public:
+    virtual ~CompressionCodec() = default;
+
+    virtual Codec id() const = 0;
+    virtual std::string_view name() const = 0;
+    // most bytes compress writes for size input bytes
+    virtual size_t max_compressed_size(size_t size) const = 0;
+    // dest holds max_compressed_size(input.size()) bytes; returns the compressed size
+    virtual size_t compress(std::string_view input, char* dest) const = 0;
+    // fills exactly size bytes of dest; false if input is corrupt or expands to another size
+    virtual bool decompress(std::string_view input, char* dest, size_t size) const = 0;
+};
+
+// replaces a codec registered under the same id; not thread-safe against lookups
+void register_codec(std::unique_ptr<CompressionCodec> codec);
+// nullptr for Codec::None and ids nobody registered
+const CompressionCodec* find_codec(Codec id);
+const CompressionCodec* find_codec(std::string_view name);
+
+// Compressed batch: the same bytes in a PRODUCE_COMPRESSED request, in the commit log and in
+// FETCH_LOG responses (big-endian):
+//   u32 record_count | u32 raw_size | compressed bytes
+// The raw bytes are a record set of key, value pairs, as PRODUCE_KEYED sends them.
+struct CompressedBatch {
+    static constexpr size_t headerSize = 8;
+    // larger raw sizes are rejected before anything is allocated for them
+    static constexpr size_t maxRawSize = 64 * 1024 * 1024;
+
+    uint32_t count;
+    uint32_t rawSize;
+    std::string_view data;
+
+    static std::optional<CompressedBatch> parse(std::string_view block);
+};
+
+// appends the batch of count records to out; keys is null for keyless records
+void encode_batch(PooledString& out, const CompressionCodec& codec, const std::string_view* keys, const std::string_view* values, size_t count);
+// raw receives the record set, keys and values point into it; false if the batch is corrupt
+bool decode_batch(const CompressionCodec& codec, std::string_view block, PooledString& raw,
+    std::vector<std::string_view>& keys, std::vector<std::string_view>& values);
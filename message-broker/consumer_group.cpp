@@ -0,0 +1,259 @@
+#include "consumer_group.h"
+
+#include <iostream>
+#include <fstream>
+#include <filesystem>
+#include <algorithm>
+#include <set>
+#include <chrono>
+#include <charconv>
+#include <sstream>
+
+#include "platform.h"
+
+namespace {
+    // writes contents to a new file and waits for it to reach the device
+    bool write_synced(const std::string& filename, const std::string& contents) {
+#ifdef _WIN32
+        HANDLE file = CreateFileA(filename.c_str(), GENERIC_WRITE, 0, nullptr, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, nullptr);
+        if (file == INVALID_HANDLE_VALUE)
+            return false;
+        DWORD written = 0;
+        bool ok = WriteFile(file, contents.data(), static_cast<DWORD>(contents.size()), &written, nullptr) &&
+            written == contents.size() && FlushFileBuffers(file);
+        CloseHandle(file);
+        return ok;
+#else
+        int fd = ::open(filename.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+        if (fd == -1)
+            return false;
+        size_t written = 0;
+        while (written < contents.size()) {
+            ssize_t n = ::write(fd, contents.data() + written, contents.size() - written);
+            if (n < 0 && errno == EINTR)
+                continue;
+            if (n <= 0)
+                break;
+            written += static_cast<size_t>(n);
+        }
+        bool ok = written == contents.size() && ::fsync(fd) == 0;
+        ok = ::close(fd) == 0 && ok;
+        return ok;
+#endif
+    }
+}
+
+void ConsumerGroup::join(uint64_t member, std::vector<std::string> topics) {
+    std::vector<uint32_t> counts;
+    for (const std::string& topic : topics)
+        counts.push_back(TopicManager::get_instance().partition_count(topic));
+
+    std::scoped_lock lock(mtx);
+    for (size_t i = 0; i < topics.size(); ++i)
+        partitionCounts[topics[i]] = counts[i];
+    members[member] = std::move(topics);
+    rebalance();
+}
+
+void ConsumerGroup::leave(uint64_t member) {
+    std::scoped_lock lock(mtx);
+    if (members.erase(member))
+        rebalance();
+}
+
+std::vector<TopicPartition> ConsumerGroup::assignment(uint64_t member) const {
+    std::scoped_lock lock(mtx);
+    std::vector<TopicPartition> partitions;
+    for (const auto& [partition, owner] : owners) {
+        if (owner == member)
+            partitions.push_back(partition);
+    }
+    return partitions;
+}
+
+std::optional<uint64_t> ConsumerGroup::position(uint64_t member, const TopicPartition& partition) const {
+    std::scoped_lock lock(mtx);
+    auto owner = owners.find(partition);
+    if (owner == owners.end() || owner->second != member)
+        return std::nullopt;
+
+    if (auto it = positions.find(partition); it != positions.end())
+        return it->second;
+    if (auto it = committed.find(partition); it != committed.end())
+        return it->second;
+    return 0;
+}
+
+void ConsumerGroup::advance(uint64_t member, const TopicPartition& partition, uint64_t next) {
+    std::scoped_lock lock(mtx);
+    auto owner = owners.find(partition);
+    if (owner == owners.end() || owner->second != member)
+        return;
+    positions[partition] = next;
+}
+
+bool ConsumerGroup::commit(uint64_t member, const TopicPartition& partition, uint64_t offset) {
+    std::scoped_lock lock(mtx);
+    auto owner = owners.find(partition);
+    if (owner == owners.end() || owner->second != member)
+        return false;
+
+    committed[partition] = offset;
+    dirty = true;
+    return true;
+}
+
+// the partitions of each topic go round-robin to the members subscribed to it, in member id order,
+// so a topic with more partitions than members is read by all of them. a partition that changes
+// owner restarts from the committed offset.
+void ConsumerGroup::rebalance() {
+    std::set<std::string> topics;
+    for (const auto& [_, subscribed] : members)
+        topics.insert(subscribed.begin(), subscribed.end());
+
+    decltype(owners) next;
+    size_t turn = 0;
+    for (const std::string& topic : topics) {
+        std::vector<uint64_t> candidates;
+        for (const auto& [member, subscribed] : members) {
+            if (std::find(subscribed.begin(), subscribed.end(), topic) != subscribed.end())
+                candidates.push_back(member);
+        }
+        uint32_t count = partitionCounts.find(topic)->second;
+        for (uint32_t partition = 0; partition < count; ++partition)
+            next.emplace(TopicPartition{ topic, partition }, candidates[turn++ % candidates.size()]);
+    }
+
+    for (const auto& [partition, owner] : owners) {
+        auto it = next.find(partition);
+        if (it == next.end() || it->second != owner)
+            positions.erase(partition);
+    }
+    owners = std::move(next);
+}
+
+// one line per partition: <offset> <topic length> <topic> <partition>; files written before topics
+// had partitions end the line after the topic, which reads as partition 0
+bool ConsumerGroup::load(const std::string& filename) {
+    std::ifstream file(filename);
+    if (!file)
+        return false;
+
+    std::scoped_lock lock(mtx);
+    uint64_t offset;
+    size_t length;
+    while (file >> offset >> length) {
+        file.get();
+        TopicPartition partition;
+        partition.topic.assign(length, '\0');
+        if (!file.read(partition.topic.data(), static_cast<std::streamsize>(length)))
+            break;
+
+        std::string rest;
+        std::getline(file, rest);
+        if (!rest.empty() && std::from_chars(rest.data() + 1, rest.data() + rest.size(), partition.partition).ec != std::errc())
+            break;
+        committed[std::move(partition)] = offset;
+    }
+    return true;
+}
+
+bool ConsumerGroup::save(const std::string& filename) {
+    std::vector<std::pair<TopicPartition, uint64_t>> snapshot;
+    {
+        std::scoped_lock lock(mtx);
+        if (!dirty)
+            return true;
+        snapshot.assign(committed.begin(), committed.end());
+        dirty = false;
+    }
+
+    // a failed save leaves the offsets to the next one
+    auto failed = [&] {
+        std::scoped_lock lock(mtx);
+        dirty = true;
+        return false;
+    };
+
+    std::ostringstream contents;
+    for (const auto& [partition, offset] : snapshot)
+        contents << offset << ' ' << partition.topic.size() << ' ' << partition.topic << ' ' << partition.partition << '\n';
+
+    // write and sync, then rename, so a crash never leaves a half-written offsets file
+    std::string temp = filename + ".tmp";
+    if (!write_synced(temp, contents.str())) {
+        std::cerr << "[disk error] group offsets save error: " << filename << std::endl;
+        return failed();
+    }
+
+    std::error_code ec;
+    std::filesystem::rename(temp, filename, ec);
+    if (ec) {
+        std::cerr << "[disk error] group offsets rename error: " << ec.message() << std::endl;
+        return failed();
+    }
+    return true;
+}
+
+
+GroupCoordinator::~GroupCoordinator() {
+    stop_flush = true;
+    save_all();
+}
+
+GroupCoordinator& GroupCoordinator::get_instance() {
+    static GroupCoordinator instance;
+    return instance;
+}
+
+void GroupCoordinator::init_storage(std::string dir) {
+    std::error_code ec;
+    std::filesystem::create_directories(dir, ec);
+    if (ec) {
+        std::cerr << "[disk error] group offsets directory: " << ec.message() << std::endl;
+        return;
+    }
+
+    {
+        std::scoped_lock lock(mtx);
+        offsets_dir = std::move(dir);
+    }
+    flush_thread = std::jthread([this] { flush_loop(); });
+}
+
+ConsumerGroup& GroupCoordinator::get_or_create(std::string_view group) {
+    std::scoped_lock lock(mtx);
+    auto it = groups.find(group);
+    if (it != groups.end())
+        return *it->second;
+
+    auto created = std::make_unique<ConsumerGroup>(std::string(group));
+    if (!offsets_dir.empty())
+        created->load(offsets_file(group));
+    return *groups.emplace(std::string(group), std::move(created)).first->second;
+}
+
+std::string GroupCoordinator::offsets_file(std::string_view group) const {
+    return offsets_dir + "/" + escape_name(group) + ".offsets";
+}
+
+void GroupCoordinator::flush_loop() {
+    while (!stop_flush) {
+        std::this_thread::sleep_for(std::chrono::seconds(1));
+        save_all();
+    }
+}
+
+// groups are never removed, so the pointers stay valid outside the lock
+void GroupCoordinator::save_all() {
+    std::vector<std::pair<std::string, ConsumerGroup*>> targets;
+    {
+        std::scoped_lock lock(mtx);
+        if (offsets_dir.empty())
+            return;
+        for (auto& [name, group] : groups)
+            targets.emplace_back(offsets_file(name), group.get());
+    }
+    for (auto& [filename, group] : targets)
+        group->save(filename);
+}
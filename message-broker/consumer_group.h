@@ -0,0 +1,85 @@
+#pragma once
+
+#include <string>
+#include <string_view>
+#include <vector>
+#include <map>
+#include <unordered_map>
+#include <mutex>
+#include <memory>
+#include <optional>
+#include <thread>
+#include <atomic>
+#include <cstdint>
+#include <compare>
+
+#include "topic_manager.h"
+
+struct TopicPartition {
+    std::string topic;
+    uint32_t partition = 0;
+
+    auto operator<=>(const TopicPartition&) const = default;
+};
+
+// Consumers that share a group split the partitions of its topics between them; every group
+// tracks its own offsets over the commit logs, so independent groups each read the full stream.
+class ConsumerGroup {
+public:
+    explicit ConsumerGroup(std::string name) : name(std::move(name)) {}
+
+    // topics are created if needed, the group assigns all of their partitions
+    void join(uint64_t member, std::vector<std::string> topics);
+    void leave(uint64_t member);
+
+    std::vector<TopicPartition> assignment(uint64_t member) const;
+    // next offset to fetch; nothing when the partition is not assigned to member
+    std::optional<uint64_t> position(uint64_t member, const TopicPartition& partition) const;
+    void advance(uint64_t member, const TopicPartition& partition, uint64_t next);
+    bool commit(uint64_t member, const TopicPartition& partition, uint64_t offset);
+
+    bool load(const std::string& filename);
+    // writes committed offsets if they changed since the last save
+    bool save(const std::string& filename);
+
+    const std::string& group_name() const { return name; }
+
+private:
+    mutable std::mutex mtx;
+    std::string name;
+    std::map<uint64_t, std::vector<std::string>> members;
+    std::map<std::string, uint32_t, std::less<>> partitionCounts;
+    std::map<TopicPartition, uint64_t> owners;
+    std::map<TopicPartition, uint64_t> positions;
+    std::map<TopicPartition, uint64_t> committed;
+    bool dirty = false;
+
+    void rebalance();
+};
+
+class GroupCoordinator {
+public:
+    static GroupCoordinator& get_instance();
+
+    // committed offsets are kept in <dir>/<group>.offsets
+    void init_storage(std::string dir);
+    ConsumerGroup& get_or_create(std::string_view group);
+    uint64_t next_member_id() { return nextMember.fetch_add(1); }
+
+private:
+    GroupCoordinator() = default;
+    ~GroupCoordinator();
+    GroupCoordinator(const GroupCoordinator&) = delete;
+    GroupCoordinator& operator=(const GroupCoordinator&) = delete;
+
+    std::mutex mtx;
+    std::unordered_map<std::string, std::unique_ptr<ConsumerGroup>, TopicHash, std::equal_to<>> groups;
+    std::string offsets_dir;
+    std::atomic<uint64_t> nextMember{ 1 };
+    std::jthread flush_thread;
+    std::atomic<bool> stop_flush{ false };
+
+    std::string offsets_file(std::string_view group) const;
+    void flush_loop();
+    void save_all();
+};
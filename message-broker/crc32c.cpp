@@ -0,0 +1,126 @@
+#include "crc32c.h"
+
+#include <array>
+#include <cstring>
+
+#if defined(_M_X64) || defined(__x86_64__)
+#define CRC32C_X86 1
+#include <nmmintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+#elif defined(__aarch64__) && defined(__ARM_FEATURE_CRC32)
+#define CRC32C_ARM 1
+#include <arm_acle.h>
+#endif
+
+namespace {
+    constexpr uint32_t polynomial = 0x82F63B78;
+
+    // table[k][b] is the crc of byte b followed by k zero bytes, for slicing by 8
+    constexpr std::array<std::array<uint32_t, 256>, 8> make_tables() {
+        std::array<std::array<uint32_t, 256>, 8> tables{};
+        for (uint32_t i = 0; i < 256; ++i) {
+            uint32_t crc = i;
+            for (int k = 0; k < 8; ++k)
+                crc = (crc & 1) ? (crc >> 1) ^ polynomial : crc >> 1;
+            tables[0][i] = crc;
+        }
+        for (size_t k = 1; k < 8; ++k) {
+            for (uint32_t i = 0; i < 256; ++i)
+                tables[k][i] = (tables[k - 1][i] >> 8) ^ tables[0][tables[k - 1][i] & 0xff];
+        }
+        return tables;
+    }
+
+    constexpr std::array<std::array<uint32_t, 256>, 8> tables = make_tables();
+
+    uint32_t crc32c_software(uint32_t crc, const unsigned char* p, size_t length) {
+        for (; length >= 8; p += 8, length -= 8) {
+            uint32_t low;
+            uint32_t high;
+            std::memcpy(&low, p, 4);
+            std::memcpy(&high, p + 4, 4);
+            // little-endian loads; every platform the broker builds for is little-endian
+            low ^= crc;
+            crc = tables[7][low & 0xff] ^ tables[6][(low >> 8) & 0xff] ^
+                tables[5][(low >> 16) & 0xff] ^ tables[4][low >> 24] ^
+                tables[3][high & 0xff] ^ tables[2][(high >> 8) & 0xff] ^
+                tables[1][(high >> 16) & 0xff] ^ tables[0][high >> 24];
+        }
+        for (; length > 0; ++p, --length)
+            crc = tables[0][(crc ^ *p) & 0xff] ^ (crc >> 8);
+        return crc;
+    }
+
+#if CRC32C_X86
+#if defined(__GNUC__) || defined(__clang__)
+    __attribute__((target("sse4.2")))
+#endif
+    uint32_t crc32c_hardware(uint32_t crc, const unsigned char* p, size_t length) {
+        uint64_t crc64 = crc;
+        for (; length >= 8; p += 8, length -= 8) {
+            uint64_t word;
+            std::memcpy(&word, p, 8);
+            crc64 = _mm_crc32_u64(crc64, word);
+        }
+        crc = static_cast<uint32_t>(crc64);
+        for (; length > 0; ++p, --length)
+            crc = _mm_crc32_u8(crc, *p);
+        return crc;
+    }
+
+    bool hardware_supported() {
+#ifdef _MSC_VER
+        int info[4];
+        __cpuid(info, 1);
+        return (info[2] & (1 << 20)) != 0;
+#else
+        return __builtin_cpu_supports("sse4.2");
+#endif
+    }
+#elif CRC32C_ARM
+    uint32_t crc32c_hardware(uint32_t crc, const unsigned char* p, size_t length) {
+        for (; length >= 8; p += 8, length -= 8) {
+            uint64_t word;
+            std::memcpy(&word, p, 8);
+            crc = __crc32cd(crc, word);
+        }
+        for (; length > 0; ++p, --length)
+            crc = __crc32cb(crc, *p);
+        return crc;
+    }
+
+    bool hardware_supported() {
+        return true;
+    }
+#else
+    uint32_t crc32c_hardware(uint32_t crc, const unsigned char* p, size_t length) {
+        return crc32c_software(crc, p, length);
+    }
+
+    bool hardware_supported() {
+        return false;
+    }
+#endif
+
+    using Implementation = uint32_t(*)(uint32_t, const unsigned char*, size_t);
+
+    // picked once; the CPU does not change under a running process
+    const bool hardware = hardware_supported();
+    const Implementation implementation = hardware ? crc32c_hardware : crc32c_software;
+}
+
+uint32_t crc32c(uint32_t crc, const void* data, size_t length) {
+    return ~implementation(~crc, static_cast<const unsigned char*>(data), length);
+}
+
+const char* crc32c_implementation() {
+#if CRC32C_X86
+    return hardware ? "sse4.2" : "software";
+#elif CRC32C_ARM
+    return "armv8 crc";
+#else
+    return "software";
+#endif
+}
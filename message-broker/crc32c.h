@@ -0,0 +1,10 @@
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+
+// CRC-32C (Castagnoli), as used by Kafka record batches. Uses the CPU's crc32 instruction
+// (SSE4.2 or ARMv8) when there is one and slicing-by-8 tables otherwise.
+uint32_t crc32c(uint32_t crc, const void* data, size_t length);
+// "sse4.2", "armv8 crc" or "software"
+const char* crc32c_implementation();
@@ -1,19 +1,47 @@
 #include "disk_handler.h"
 
-#include <fstream>
 #include <iostream>
 #include <chrono>
 #include <format>
 #include <filesystem>
+#include <algorithm>
+#include <cstring>
+#include <ctime>
+#include <charconv>
+
+#include "line_scan.h"
+
+namespace {
+    // Calls visit(line) for every complete line of data[position, limit) until it returns false;
+    // the zero fill of a preallocated segment ends the text. Returns the position after the last
+    // visited line.
+    template <typename Visit>
+    size_t for_each_line(const char* data, size_t position, size_t limit, Visit&& visit) {
+        while (position < limit) {
+            size_t end = position + find_line_boundary(data + position, limit - position);
+            if (end == limit || data[end] != '\n' || !visit(std::string_view(data + position, end - position)))
+                break;
+            position = end + 1;
+        }
+        return position;
+    }
+}
 
-DiskHandler::DiskHandler(std::string baseFilename, size_t segmentSize)
+DiskHandler::DiskHandler(std::string baseFilename, size_t segmentSize, size_t maxSegments)
     : baseName(std::move(baseFilename)),
     segmentSize(segmentSize),
+    maxSegments(maxSegments),
     currentOffset(0),
     currentSegmentIndex(0),
+    firstSegmentIndex(0),
+    segment(create_segment_file()),
     stopFlush(false) {
-        load_offset();
-        open_new_segment();
+        auto [first, last] = find_segments();
+        firstSegmentIndex = first;
+        currentSegmentIndex = last;
+        if (open_new_segment())
+            currentOffset = recover_end();
+        delete_old_segments();
         flushThread = std::jthread([this] { flush_loop(); 
     });
 }
@@ -21,18 +49,19 @@ DiskHandler::DiskHandler(std::string baseFilename, size_t segmentSize)
 DiskHandler::~DiskHandler() {
     stopFlush = true;
 
+    std::lock_guard lock(mtx);
     flush();
-    close_handles();
-    save_offset();
+    segment->close();
 }
 
 
 void DiskHandler::log(std::string_view level, std::string_view message) {
+    append(std::format("[{}] timestamp: {}, message: {}\n", level, convert_timestamp(), message));
+}
+
+void DiskHandler::append(std::string_view line) {
     std::lock_guard lock(mtx);
-   
-    std::string timestamp = convert_timestamp();
-    std::string formatted = std::format("[{}] timestamp: {}, message: {}\n", level, timestamp, message);
-    size_t len = formatted.size();
+    size_t len = line.size();
 
     if (len >= segmentSize) {
         std::cerr << "[disk error] log too large to fit in segment" << std::endl;
@@ -43,121 +72,141 @@ void DiskHandler::log(std::string_view level, std::string_view message) {
         std::cerr << "[debug] rotate_segment, currentOffset=" << currentOffset << ", length=" << len << ", segmentSize=" << segmentSize << std::endl;
 
         if (!rotate_segment()) {
-            std::cerr << "[disk error] rotate_segment failed" << std::endl;
+            std::cerr << "[disk error] rotate_segment failed, dropping the line" << std::endl;
             return;
         }
     }
+    if (!segment->is_open())
+        return;
 
     // std::cout << "[disk log] log(" << formatted.data();
-    std::memcpy(static_cast<char*>(mapView) + currentOffset, formatted.data(), len);
-    currentOffset += len;
+    size_t offset = currentOffset.load(std::memory_order_relaxed);
+    std::memcpy(segment->data() + offset, line.data(), len);
+    currentOffset.store(offset + len, std::memory_order_release);
 }
 
 std::optional<std::string> DiskHandler::read_next(LogCursor& cursor) {
-    std::lock_guard<std::mutex> lock(mtx);
-
-    if (cursor.segmentIndex > currentSegmentIndex) 
+    LogRange range = read_range(cursor, 1, SIZE_MAX);
+    if (range.lines.empty())
         return std::nullopt;
+    return std::string(range.lines.front());
+}
 
-    HANDLE hFile = open_segment(cursor.segmentIndex);
-
-    if (hFile == INVALID_HANDLE_VALUE) 
-        return std::nullopt;
-
-    HANDLE hMap = CreateFileMappingA(hFile, nullptr, PAGE_READONLY, 0, 0, nullptr);
-
-    if (!hMap) {
-        CloseHandle(hFile);
-        return std::nullopt;
-    }
-
-    void* view = MapViewOfFile(hMap, FILE_MAP_READ, 0, 0, 0);
-
-    if (!view) {
-        CloseHandle(hMap);
-        CloseHandle(hFile);
-        return std::nullopt;
-    }
+LogRange DiskHandler::read_range(LogCursor& cursor, size_t maxRecords, size_t maxBytes) {
+    LogRange range;
+    size_t bytes = 0;
 
-    const char* data = static_cast<const char*>(view);
-    size_t i = cursor.offset;
+    while (range.lines.size() < maxRecords) {
+        size_t active = currentSegmentIndex.load(std::memory_order_acquire);
+        if (cursor.segmentIndex > active)
+            break;
 
-    while (i < segmentSize) {
-        if (data[i] == '\n') {
-            std::string msg(data + cursor.offset, i - cursor.offset);
-            cursor.offset = i + 1;
+        size_t first = firstSegmentIndex.load(std::memory_order_acquire);
+        if (cursor.segmentIndex < first) {
+            cursor.segmentIndex = first;
+            cursor.offset = 0;
+        }
 
-            if (cursor.offset >= segmentSize) {
-                cursor.segmentIndex++;
-                cursor.offset = 0;
+        std::shared_ptr<const MappedSegment> file = open_segment(cursor.segmentIndex);
+        if (!file)
+            break;
+
+        bool rotated = cursor.segmentIndex < active;
+        size_t limit = text_limit(*file, rotated);
+        bool full = false;
+        cursor.offset = for_each_line(file->file->data(), cursor.offset, limit, [&](std::string_view line) {
+            if (range.lines.size() >= maxRecords || (!range.lines.empty() && bytes + line.size() > maxBytes)) {
+                full = true;
+                return false;
             }
-
-            UnmapViewOfFile(view);
-            CloseHandle(hMap);
-            CloseHandle(hFile);
-            return msg;
-        }
-        ++i;
+            range.lines.push_back(line);
+            bytes += line.size();
+            return true;
+        });
+        range.segments.push_back(std::move(file));
+
+        if (full || !rotated)
+            break;
+        cursor.segmentIndex++;
+        cursor.offset = 0;
     }
 
-    UnmapViewOfFile(view);
-    CloseHandle(hMap);
-    CloseHandle(hFile);
-
-    return std::nullopt;
+    return range;
 }
 
 std::vector<std::string> DiskHandler::read_all(size_t segmentIndex) {
     std::vector<std::string> lines;
-    std::string filename = get_segment_filename(segmentIndex);
-
-    HANDLE hFile = open_segment(segmentIndex);
-    if (hFile == INVALID_HANDLE_VALUE) 
-        return lines;
 
-    HANDLE hMap = CreateFileMappingA(hFile, nullptr, PAGE_READONLY, 0, 0, nullptr);
-    if (!hMap) {
-        CloseHandle(hFile);
+    std::shared_ptr<const MappedSegment> file = open_segment(segmentIndex);
+    if (!file) 
         return lines;
-    }
-
-    void* view = MapViewOfFile(hMap, FILE_MAP_READ, 0, 0, 0);
-    if (!view) {
-        CloseHandle(hMap);
-        CloseHandle(hFile);
-        return lines;
-    }
 
-    const char* data = static_cast<const char*>(view);
-    size_t start = 0;
+    size_t limit = text_limit(*file, segmentIndex < currentSegmentIndex.load(std::memory_order_acquire));
+    for_each_line(file->file->data(), 0, limit, [&](std::string_view line) {
+        lines.emplace_back(line);
+        return true;
+    });
+    return lines;
+}
 
-    for (size_t i = 0; i < segmentSize; ++i) {
-        if (data[i] == '\n') {
-            lines.emplace_back(data + start, i - start);
-            start = i + 1;
+size_t DiskHandler::replay(size_t firstSegment, const SegmentVisitor& visit, size_t threads) {
+    size_t last = currentSegmentIndex.load(std::memory_order_acquire);
+    size_t first = std::max(firstSegment, firstSegmentIndex.load(std::memory_order_acquire));
+    if (first > last)
+        return 0;
+
+    size_t segments = last - first + 1;
+    if (threads == 0)
+        threads = std::max(std::thread::hardware_concurrency(), 1u);
+    threads = std::min(threads, segments);
+
+    std::atomic<size_t> next{ first };
+    std::atomic<size_t> total{ 0 };
+    {
+        std::vector<std::jthread> workers;
+        for (size_t w = 0; w < threads; ++w) {
+            workers.emplace_back([&] {
+                std::vector<std::string_view> lines;
+                for (size_t index; (index = next.fetch_add(1, std::memory_order_relaxed)) <= last;) {
+                    std::shared_ptr<const MappedSegment> file = open_segment(index);
+                    if (!file)
+                        continue;
+
+                    lines.clear();
+                    size_t limit = text_limit(*file, index < currentSegmentIndex.load(std::memory_order_acquire));
+                    for_each_line(file->file->data(), 0, limit, [&](std::string_view line) {
+                        lines.push_back(line);
+                        return true;
+                    });
+                    visit(index, lines);
+                    total.fetch_add(lines.size(), std::memory_order_relaxed);
+                }
+            });
         }
     }
+    return total.load(std::memory_order_relaxed);
+}
 
-    UnmapViewOfFile(view);
-    CloseHandle(hMap);
-    CloseHandle(hFile);
-    return lines;
+// a rotated segment is read up to its zero fill, the active one only up to what was appended
+size_t DiskHandler::text_limit(const MappedSegment& file, bool rotated) const {
+    size_t limit = std::min(segmentSize, file.file->size());
+    if (!rotated)
+        limit = std::min(limit, currentOffset.load(std::memory_order_acquire));
+    return limit;
 }
 
 void DiskHandler::flush_loop() {
     while (!stopFlush) {
         std::this_thread::sleep_for(std::chrono::seconds(1));
+        // rotate_segment unmaps the segment under mtx
+        std::lock_guard lock(mtx);
         flush();
     }
 }
 
 void DiskHandler::flush() {
     try {
-        if (mapView) {
-            if (!FlushViewOfFile(mapView, 0)) {
-                std::cerr << "[disk error] FlushViewOfFile failed: " << GetLastError() << std::endl;
-            }
-        }
+        segment->flush();
     }
     catch (const std::system_error& e) {
         std::cerr << "[disk error] std::system_error in flush(): " << e.what() << std::endl;
@@ -169,141 +218,117 @@ void DiskHandler::flush() {
 
 bool DiskHandler::rotate_segment() {
     flush();
-    close_handles();
-    currentSegmentIndex++;
+    segment->close();
     currentOffset = 0;
+    currentSegmentIndex++;
 
     std::cerr << "[debug] rotate_segment: new index = " << currentSegmentIndex << ", offset reset to 0"<< std::endl;
 
     if (!open_new_segment()) {
-        std::cerr << "[disk error] open_new_segment error. Reverting to index 0." << std::endl;
-        currentSegmentIndex = 0;
-        currentOffset = 0;
-        if (!open_new_segment()) {
-            std::cerr << "[disk error] init offset, segment. open_new_segment error again." << std::endl;
-            return false;
-        }
+        // the next append tries the same index again rather than overwriting the oldest lines
+        std::cerr << "[disk error] open_new_segment error" << std::endl;
+        currentSegmentIndex--;
+        currentOffset = segmentSize;
+        return false;
     }
-
-    save_offset();
+    delete_old_segments();
     return true;
 }
 
-bool DiskHandler::open_new_segment() {
-    std::cout << "open_new_segment " << currentSegmentIndex << std::endl;
-    std::string filename = get_segment_filename(currentSegmentIndex);
-
-    hFile = CreateFileA(filename.c_str(), GENERIC_WRITE | GENERIC_READ,
-        0, nullptr, OPEN_ALWAYS, FILE_ATTRIBUTE_NORMAL, nullptr);
-
-    if (hFile == INVALID_HANDLE_VALUE) {
-        std::cerr << "[disk error] INVALID_HANDLE_VALUE: " << filename << std::endl;
-        return false;
-    }
+// readers still mapping a deleted segment keep their view of it
+void DiskHandler::delete_old_segments() {
+    if (maxSegments == 0)
+        return;
 
-    LARGE_INTEGER li;
-    li.QuadPart = static_cast<LONGLONG>(segmentSize);
-    if (!SetFilePointerEx(hFile, li, nullptr, FILE_BEGIN) || !SetEndOfFile(hFile)) {
-        std::cerr << "[disk error] Failed to set file size" << std::endl;
-        CloseHandle(hFile);
-        hFile = INVALID_HANDLE_VALUE;
-        return false;
-    }
+    size_t current = currentSegmentIndex.load(std::memory_order_relaxed);
+    size_t keepFrom = current + 1 > maxSegments ? current + 1 - maxSegments : 0;
+    size_t first = firstSegmentIndex.load(std::memory_order_relaxed);
+    if (keepFrom <= first)
+        return;
 
-    hMap = CreateFileMappingA(hFile, nullptr, PAGE_READWRITE, 0, segmentSize, nullptr);
-    if (!hMap) {
-        std::cerr << "[disk error] CreateFileMappingA error" << std::endl;
-        CloseHandle(hFile);
-        hFile = INVALID_HANDLE_VALUE;
-        return false;
-    }
+    firstSegmentIndex.store(keepFrom, std::memory_order_release);
+    for (size_t index = first; index < keepFrom; ++index) {
+        std::string filename = get_segment_filename(index);
+        SegmentCache::get_instance().invalidate(filename);
 
-    mapView = MapViewOfFile(hMap, FILE_MAP_ALL_ACCESS, 0, 0, segmentSize);
-    if (!mapView) {
-        std::cerr << "[disk error] MapViewOfFile error" << std::endl;
-        CloseHandle(hMap);
-        CloseHandle(hFile);
-        hMap = nullptr;
-        hFile = INVALID_HANDLE_VALUE;
-        return false;
+        std::error_code ec;
+        std::filesystem::remove(filename, ec);
+        if (ec)
+            std::cerr << "[disk error] remove " << filename << ": " << ec.message() << std::endl;
     }
-
-    return true;
 }
 
+bool DiskHandler::open_new_segment() {
+    std::cout << "open_new_segment " << currentSegmentIndex << std::endl;
+    std::string filename = get_segment_filename(currentSegmentIndex);
 
-
-void DiskHandler::close_handles() {
-    if (mapView) {
-        UnmapViewOfFile(mapView);
-        mapView = nullptr;
-    }
-    if (hMap) {
-        CloseHandle(hMap);
-        hMap = nullptr;
-    }
-    if (hFile != INVALID_HANDLE_VALUE && hFile != nullptr) {
-        CloseHandle(hFile);
-        hFile = INVALID_HANDLE_VALUE;
-    }
+    // a failed rotation can retry an index a reader still has cached
+    SegmentCache::get_instance().invalidate(filename);
+    return segment->open(filename, segmentSize, true);
 }
 
 
-HANDLE DiskHandler::open_segment(size_t index) {
-    std::string filename = get_segment_filename(index);
-    return CreateFileA(filename.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr,
-        OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+std::shared_ptr<const MappedSegment> DiskHandler::open_segment(size_t index) const {
+    return SegmentCache::get_instance().acquire(get_segment_filename(index));
 }
 
 std::string DiskHandler::get_segment_filename(size_t index) const {
     return std::format("{}_{:05}.log", baseName, index);
 }
 
-void DiskHandler::load_offset() {
-    std::ifstream file(baseName + ".meta");
-    if (!file) {
-        std::cerr << "[debug] No meta file found" << std::endl;
-        currentSegmentIndex = 0;
-        currentOffset = 0;
-        return;
-    }
-
-    if (!(file >> currentSegmentIndex >> currentOffset)) {
-        std::cerr << "[debug] Failed to read meta file, initing offset." << std::endl;
-        currentSegmentIndex = 0;
-        currentOffset = 0;
-        return;
-    }
-
-    std::string filename = get_segment_filename(currentSegmentIndex);
-    if (!std::filesystem::exists(filename)) {
-        std::cerr << "[disk warn] Missing log file " << filename << ". Resetting offset.\n";
-        currentSegmentIndex = 0;
-        currentOffset = 0;
-    }
-    else {
-        std::cerr << "[debug] offset: segment=" << currentSegmentIndex << ", offset=" << currentOffset << std::endl;
+// the newest segment is the highest index on disk
+std::pair<size_t, size_t> DiskHandler::find_segments() const {
+    std::filesystem::path base(baseName);
+    std::filesystem::path dir = base.has_parent_path() ? base.parent_path() : std::filesystem::path(".");
+    std::string prefix = base.filename().string() + "_";
+    size_t first = SIZE_MAX;
+    size_t last = 0;
+
+    std::error_code ec;
+    for (const auto& entry : std::filesystem::directory_iterator(dir, ec)) {
+        std::string name = entry.path().filename().string();
+        if (entry.path().extension() != ".log" || !name.starts_with(prefix))
+            continue;
+
+        std::string_view digits(name.data() + prefix.size(), name.size() - prefix.size() - 4);
+        size_t index = 0;
+        auto [end, parse] = std::from_chars(digits.data(), digits.data() + digits.size(), index);
+        if (parse == std::errc() && end == digits.data() + digits.size()) {
+            first = std::min(first, index);
+            last = std::max(last, index);
+        }
     }
+    return { first == SIZE_MAX ? 0 : first, last };
 }
 
-void DiskHandler::save_offset() const {
-    std::ofstream file(baseName + ".meta", std::ios::trunc);
-    if (!file) {
-        std::cerr << "[disk error] save_offset error" << std::endl;
-        return;
+// Segments are preallocated and zero-filled, so the text ends at the first NUL. A line a crash
+// cut short is zeroed, so the next append starts on a line boundary.
+size_t DiskHandler::recover_end() {
+    char* data = segment->data();
+    size_t size = std::min(segmentSize, segment->size());
+    const void* zero = std::memchr(data, '\0', size);
+    size_t text = zero ? static_cast<size_t>(static_cast<const char*>(zero) - data) : size;
+
+    size_t end = text;
+    while (end > 0 && data[end - 1] != '\n')
+        --end;
+    if (end < text) {
+        std::cerr << "[disk warn] dropped " << (text - end) << " bytes of a torn line in " << get_segment_filename(currentSegmentIndex) << std::endl;
+        std::memset(data + end, 0, text - end);
     }
-
-    file << currentSegmentIndex << ' ' << currentOffset;
-    file.flush();
+    return end;
 }
 
-
 std::string DiskHandler::convert_timestamp() {
     auto now = std::chrono::system_clock::now();
     std::time_t now_c = std::chrono::system_clock::to_time_t(now);
     std::tm local_tm;
 
+#ifdef _WIN32
     localtime_s(&local_tm, &now_c);
+#else
+    localtime_r(&now_c, &local_tm);
+#endif
 
     char time_buf[32];
     std::strftime(time_buf, sizeof(time_buf), "%Y-%m-%d %H:%M:%S", &local_tm);
@@ -1,6 +1,5 @@
 #pragma once
 
-#include <windows.h>
 #include <string>
 #include <mutex>
 #include <vector>
@@ -8,15 +7,27 @@
 #include <atomic>
 #include <thread>
 #include <string_view>
+#include <memory>
+#include <functional>
+
+#include "segment_file.h"
+#include "segment_cache.h"
 
 struct LogCursor {
     size_t segmentIndex;
     size_t offset;
 };
 
+// lines read by read_range, without their '\n'; the views stay valid while the range holds the mappings
+struct LogRange {
+    std::vector<std::shared_ptr<const MappedSegment>> segments;
+    std::vector<std::string_view> lines;
+};
+
 class DiskHandler {
 public:
-    DiskHandler(std::string baseFilename, size_t segmentSize);
+    // keeps the newest maxSegments segments, 0 keeps them all
+    DiskHandler(std::string baseFilename, size_t segmentSize, size_t maxSegments = 0);
     ~DiskHandler();
 
     DiskHandler(const DiskHandler&) = delete;
@@ -25,33 +36,48 @@ public:
     DiskHandler& operator=(DiskHandler&&) noexcept = default;
 
     void log(std::string_view level, std::string_view message);
+    // appends an already formatted line (AsyncLogger's drain thread)
+    void append(std::string_view line);
     std::optional<std::string> read_next(LogCursor& cursor);
+    // up to maxRecords lines from the cursor on, across rotated segments, at least one if any and
+    // no more than maxBytes after the first; the cursor moves past them
+    LogRange read_range(LogCursor& cursor, size_t maxRecords, size_t maxBytes);
     std::vector<std::string> read_all(size_t segmentIndex);
 
+    // lines of one segment in order; segments arrive on several threads at once
+    using SegmentVisitor = std::function<void(size_t segmentIndex, const std::vector<std::string_view>& lines)>;
+    // visits every segment from firstSegment to the active one on up to threads workers (0 for one
+    // per core); returns the number of lines visited
+    size_t replay(size_t firstSegment, const SegmentVisitor& visit, size_t threads = 0);
+
 private:
     std::mutex mtx;
     std::string baseName;
     size_t segmentSize;
-    size_t currentOffset;
-    size_t currentSegmentIndex;
-
-    HANDLE hFile = INVALID_HANDLE_VALUE;
-    HANDLE hMap= nullptr;
+    size_t maxSegments;
+    // written under mtx, read lock-free by read_next/read_all
+    std::atomic<size_t> currentOffset;
+    std::atomic<size_t> currentSegmentIndex;
+    // oldest segment still on disk; cursors behind it skip ahead
+    std::atomic<size_t> firstSegmentIndex;
 
-    void* mapView = nullptr;
+    std::unique_ptr<SegmentFile> segment;
 
     std::jthread flushThread;
     std::atomic<bool> stopFlush;
 
     bool rotate_segment();
-    void close_handles();
     bool open_new_segment();
     std::string get_segment_filename(size_t index) const;
     void flush_loop();
     void flush();
-    void save_offset() const;
-    void load_offset();
-    HANDLE open_segment(size_t index);
+    // lowest and highest segment index on disk
+    std::pair<size_t, size_t> find_segments() const;
+    void delete_old_segments();
+    // end of the text in the just opened segment; drops a torn last line
+    size_t recover_end();
+    std::shared_ptr<const MappedSegment> open_segment(size_t index) const;
+    size_t text_limit(const MappedSegment& file, bool rotated) const;
 
     std::string convert_timestamp();
 };
\ No newline at end of file
@@ -0,0 +1,244 @@
+#ifdef __linux__
+
+#include "epoll_engine.h"
+#include "command_handler.h"
+
+#include <iostream>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/sendfile.h>
+#include <sys/uio.h>
+#include <csignal>
+
+namespace {
+    constexpr int maxEvents = 256;
+    // queued responses written by one sendmsg
+    constexpr size_t maxSendSpans = 64;
+}
+
+EpollEngine::~EpollEngine() {
+    for (ClientContext* context : contexts) {
+        close_socket(context->sock);
+        destroy_context(context);
+    }
+    if (listenSocket != invalid_socket) close_socket(listenSocket);
+    if (wakeFd != -1) ::close(wakeFd);
+    if (epollFd != -1) ::close(epollFd);
+}
+
+bool EpollEngine::init(uint16_t port) {
+    // sendfile has no MSG_NOSIGNAL, a reset peer would raise SIGPIPE
+    std::signal(SIGPIPE, SIG_IGN);
+
+    epollFd = epoll_create1(EPOLL_CLOEXEC);
+    wakeFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (epollFd == -1 || wakeFd == -1) {
+        std::lock_guard<std::mutex> lock(cout_mutex);
+        std::cerr << "[error] epoll_create1/eventfd: " << errno << std::endl;
+        return false;
+    }
+
+    listenSocket = open_listen_socket(port, true, shardCount > 1);
+    if (listenSocket == invalid_socket)
+        return false;
+
+    epoll_event ev{};
+    ev.events = EPOLLIN;
+    ev.data.ptr = nullptr;
+    epoll_ctl(epollFd, EPOLL_CTL_ADD, listenSocket, &ev);
+
+    ev.data.ptr = &wakeFd;
+    epoll_ctl(epollFd, EPOLL_CTL_ADD, wakeFd, &ev);
+    return true;
+}
+
+void EpollEngine::run() {
+    epoll_event events[maxEvents];
+    enter_shard();
+
+    while (running) {
+        service_waiters();
+
+        int n = epoll_wait(epollFd, events, maxEvents, next_timeout_ms());
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            std::lock_guard<std::mutex> lock(cout_mutex);
+            std::cerr << "[error] epoll_wait: " << errno << std::endl;
+            break;
+        }
+
+        for (int i = 0; i < n; ++i) {
+            void* ptr = events[i].data.ptr;
+            if (ptr == nullptr) {
+                accept_clients();
+                continue;
+            }
+            if (ptr == &wakeFd) {
+                uint64_t value;
+                while (::read(wakeFd, &value, sizeof(value)) > 0) {}
+                continue;
+            }
+
+            ClientContext* context = static_cast<ClientContext*>(ptr);
+            if (events[i].events & (EPOLLHUP | EPOLLERR)) {
+                close_context(context);
+                continue;
+            }
+            if (events[i].events & EPOLLOUT) {
+                if (!flush_send(context)) {
+                    close_context(context);
+                    continue;
+                }
+            }
+            if (events[i].events & EPOLLIN) {
+                handle_read(context);
+            }
+        }
+    }
+}
+
+void EpollEngine::stop() {
+    if (!running.exchange(false))
+        return;
+    signal();
+}
+
+void EpollEngine::signal() {
+    uint64_t one = 1;
+    if (wakeFd != -1)
+        (void)::write(wakeFd, &one, sizeof(one));
+}
+
+void EpollEngine::deliver(ClientContext* context, PooledString out) {
+    context->send_queue.append(std::move(out));
+    if (!flush_send(context))
+        close_context(context);
+}
+
+void EpollEngine::accept_clients() {
+    while (true) {
+        socket_t clientSocket = accept4(listenSocket, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC);
+        if (clientSocket == invalid_socket) {
+            if (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR) {
+                std::lock_guard<std::mutex> lock(cout_mutex);
+                std::cerr << "[error] accept4: " << errno << std::endl;
+            }
+            return;
+        }
+
+        int nodelay = 1;
+        setsockopt(clientSocket, IPPROTO_TCP, TCP_NODELAY, &nodelay, sizeof(nodelay));
+
+        ClientContext* context = create_context(clientSocket);
+
+        epoll_event ev{};
+        ev.events = EPOLLIN;
+        ev.data.ptr = context;
+        if (epoll_ctl(epollFd, EPOLL_CTL_ADD, clientSocket, &ev) != 0) {
+            std::lock_guard<std::mutex> lock(cout_mutex);
+            std::cerr << "[error] epoll_ctl: " << errno << std::endl;
+            close_socket(clientSocket);
+            destroy_context(context);
+            continue;
+        }
+        contexts.insert(context);
+    }
+}
+
+void EpollEngine::handle_read(ClientContext* context) {
+    ssize_t received = recv(context->sock, context->buffer, ClientContext::bufferSize, 0);
+
+    if (received == 0) {
+        {
+            std::lock_guard<std::mutex> lock(cout_mutex);
+            std::cerr << "[" << context->sock << "] connection closed." << std::endl;
+        }
+        close_context(context);
+        return;
+    }
+    if (received < 0) {
+        if (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR)
+            close_context(context);
+        return;
+    }
+
+    PooledString response;
+    if (!dispatch(context, std::string_view(context->buffer, static_cast<size_t>(received)), response)) {
+        close_context(context);
+        return;
+    }
+    // a FETCH_LOG response can leave a file range queued with nothing in response
+    context->send_queue.append(std::move(response));
+    if (context->send_queue.empty())
+        return;
+
+    if (!flush_send(context))
+        close_context(context);
+}
+
+bool EpollEngine::flush_send(ClientContext* context) {
+    OutboundQueue& queue = context->send_queue;
+    while (!queue.empty()) {
+        OutboundChunk& chunk = queue.front();
+        ssize_t sent;
+        if (chunk.file) {
+            // the kernel copies the segment's page cache straight into the socket
+            off_t offset = static_cast<off_t>(chunk.offset);
+            sent = sendfile(context->sock, chunk.file->file->native_handle(), &offset, chunk.length);
+            if (sent == 0) {
+                std::lock_guard<std::mutex> lock(cout_mutex);
+                std::cerr << "[" << context->sock << " error] sendfile: segment shorter than the queued range" << std::endl;
+                return false;
+            }
+        }
+        else {
+            // every byte chunk up to the next file range in one gather write
+            OutboundSpan spans[maxSendSpans];
+            iovec iov[maxSendSpans];
+            size_t count = queue.gather(spans, maxSendSpans, false);
+            for (size_t i = 0; i < count; ++i)
+                iov[i] = iovec{ const_cast<char*>(spans[i].data), spans[i].size };
+
+            msghdr msg{};
+            msg.msg_iov = iov;
+            msg.msg_iovlen = count;
+            sent = sendmsg(context->sock, &msg, MSG_NOSIGNAL);
+        }
+
+        if (sent < 0) {
+            if (errno == EINTR) continue;
+            if (errno == EAGAIN || errno == EWOULDBLOCK) {
+                if (!context->send_pending)
+                    update_interest(context, true);
+                return true;
+            }
+            std::lock_guard<std::mutex> lock(cout_mutex);
+            std::cerr << "[" << context->sock << " error] send: " << errno << std::endl;
+            return false;
+        }
+        queue.consume(static_cast<size_t>(sent));
+    }
+
+    if (context->send_pending) {
+        update_interest(context, false);
+        on_send_drained(context);
+    }
+    return true;
+}
+
+void EpollEngine::update_interest(ClientContext* context, bool wantWrite) {
+    epoll_event ev{};
+    ev.events = wantWrite ? (EPOLLIN | EPOLLOUT) : EPOLLIN;
+    ev.data.ptr = context;
+    epoll_ctl(epollFd, EPOLL_CTL_MOD, context->sock, &ev);
+    context->send_pending = wantWrite;
+}
+
+void EpollEngine::close_context(ClientContext* context) {
+    epoll_ctl(epollFd, EPOLL_CTL_DEL, context->sock, nullptr);
+    close_socket(context->sock);
+    contexts.erase(context);
+    destroy_context(context);
+}
+
+#endif
@@ -0,0 +1,36 @@
+#pragma once
+
+#ifdef __linux__
+
+#include <unordered_set>
+
+#include "net_engine.h"
+
+class EpollEngine : public NetEngine {
+public:
+    using NetEngine::NetEngine;
+    ~EpollEngine() override;
+
+    bool init(uint16_t port) override;
+    void run() override;
+    void stop() override;
+    const char* name() const override { return "epoll"; }
+
+protected:
+    void signal() override;
+    void deliver(ClientContext* context, PooledString out) override;
+
+private:
+    int epollFd = -1;
+    int wakeFd = -1;
+    socket_t listenSocket = invalid_socket;
+    std::unordered_set<ClientContext*> contexts;
+
+    void accept_clients();
+    void handle_read(ClientContext* context);
+    bool flush_send(ClientContext* context);
+    void update_interest(ClientContext* context, bool wantWrite);
+    void close_context(ClientContext* context);
+};
+
+#endif
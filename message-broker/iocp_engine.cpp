@@ -0,0 +1,268 @@
+#ifdef _WIN32
+
+#include "iocp_engine.h"
+#include "command_handler.h"
+#include "shard_runtime.h"
+
+#include <iostream>
+#include <mswsock.h>
+
+#pragma comment(lib, "Ws2_32.lib")
+#pragma comment(lib, "Mswsock.lib")
+
+namespace {
+    // completion key 0 stops the worker, wakeKey services parked requests and push subscriptions
+    constexpr ULONG_PTR wakeKey = 1;
+    // queued responses written by one WSASend
+    constexpr size_t maxSendSpans = 64;
+}
+
+IocpEngine::~IocpEngine() {
+    stop();
+    if (workerThread.joinable())
+        workerThread.join();
+    if (hCompletionPort != NULL)
+        CloseHandle(hCompletionPort);
+}
+
+bool IocpEngine::init(uint16_t port) {
+    hCompletionPort = CreateIoCompletionPort(INVALID_HANDLE_VALUE, NULL, 0, 0);
+    if (hCompletionPort == NULL) {
+        std::lock_guard<std::mutex> lock(cout_mutex);
+        std::cerr << "[error] hCompletionPort: " << GetLastError() << std::endl;
+        return false;
+    }
+
+    // Windows has no SO_REUSEPORT balancing: the first shard accepts for all of them
+    if (shard > 0)
+        return true;
+    listenSocket = open_listen_socket(port, false);
+    return listenSocket != INVALID_SOCKET;
+}
+
+void IocpEngine::run() {
+    if (listenSocket == INVALID_SOCKET) {
+        iocp_worker();
+        return;
+    }
+
+    workerThread = std::thread([this] { iocp_worker(); });
+
+    // accepted connections are dealt to the shards in turn; every shard is an IocpEngine, and
+    // associating a socket with another shard's completion port is safe from this thread
+    size_t next = 0;
+    while (running) {
+        SOCKET clientSocket = accept(listenSocket, NULL, NULL);
+        if (clientSocket != INVALID_SOCKET) {
+            BOOL nodelay = TRUE;
+            setsockopt(clientSocket, IPPROTO_TCP, TCP_NODELAY, reinterpret_cast<const char*>(&nodelay), sizeof(nodelay));
+
+            auto& target = static_cast<IocpEngine&>(ShardRuntime::get_instance().engine(next++ % shardCount));
+            target.client_connection_handler(clientSocket);
+        }
+    }
+}
+
+void IocpEngine::stop() {
+    if (!running.exchange(false))
+        return;
+
+    if (listenSocket != INVALID_SOCKET) {
+        closesocket(listenSocket);
+        listenSocket = INVALID_SOCKET;
+    }
+    if (hCompletionPort != NULL)
+        PostQueuedCompletionStatus(hCompletionPort, 0, 0, NULL);
+}
+
+void IocpEngine::signal() {
+    if (hCompletionPort != NULL)
+        PostQueuedCompletionStatus(hCompletionPort, 0, wakeKey, NULL);
+}
+
+void IocpEngine::deliver(ClientContext* context, PooledString out) {
+    if (!queue_send(context, std::move(out)))
+        close_context(context);
+}
+
+void IocpEngine::iocp_worker() {
+    DWORD bytesTransferred;
+    ULONG_PTR completionKey;
+    LPOVERLAPPED overlapped;
+    ClientContext* context;
+    enter_shard();
+
+    while (running) {
+        service_waiters();
+
+        int timeoutMs = next_timeout_ms();
+        if (!GetQueuedCompletionStatus(hCompletionPort, &bytesTransferred, &completionKey, &overlapped,
+            timeoutMs < 0 ? INFINITE : static_cast<DWORD>(timeoutMs))) {
+            if (overlapped == NULL && GetLastError() == WAIT_TIMEOUT)
+                continue;
+
+            std::lock_guard<std::mutex> lock(cout_mutex);
+            std::cerr << "[error] GetQueuedCompletionStatus: " << GetLastError() << std::endl;
+            continue;
+        }
+
+        if (completionKey == 0 || completionKey == wakeKey)
+            continue;
+
+        context = reinterpret_cast<ClientContext*>(completionKey);
+
+        if (overlapped == &context->recv_overlapped) {
+            if (bytesTransferred == 0) {
+                {
+                    std::lock_guard<std::mutex> lock(cout_mutex);
+                    std::cerr << "[" << context->sock << "] connection closed." << std::endl;
+                }
+                close_context(context);
+                continue;
+            }
+
+            PooledString response;
+            if (!dispatch(context, std::string_view(context->buffer, bytesTransferred), response)) {
+                close_context(context);
+                continue;
+            }
+
+            if (!queue_send(context, std::move(response))) {
+                close_context(context);
+                continue;
+            }
+
+            if (!post_recv(context)) {
+                close_context(context);
+            }
+        }
+        else if (overlapped == &context->send_overlapped) {
+            // std::cout << "[" << context->sock << "] send complete." << std::endl;
+            if (context->sock == INVALID_SOCKET)
+                continue;
+
+            context->send_queue.consume(bytesTransferred);
+            if (context->send_queue.empty()) {
+                context->send_pending = false;
+                on_send_drained(context);
+                continue;
+            }
+            if (!post_send(context))
+                close_context(context);
+        }
+        else {
+            std::lock_guard<std::mutex> lock(cout_mutex);
+            std::cerr << "[" << context->sock << "] unknown" << std::endl;
+        }
+    }
+}
+
+void IocpEngine::client_connection_handler(SOCKET clientSocket) {
+    ClientContext* context = create_context(clientSocket);
+
+    if (CreateIoCompletionPort((HANDLE)clientSocket, hCompletionPort, (ULONG_PTR)context, 0) == NULL) {
+        std::lock_guard<std::mutex> lock(cout_mutex);
+        std::cerr << "[error] CreateIoCompletionPort: " << GetLastError() << std::endl;
+        closesocket(clientSocket);
+        destroy_context(context);
+        return;
+    }
+
+    if (!post_recv(context)) {
+        closesocket(clientSocket);
+        destroy_context(context);
+    }
+}
+
+// one send in flight per connection, always the front chunk of send_queue; later responses queue behind it
+bool IocpEngine::queue_send(ClientContext* context, PooledString data) {
+    if (context->sock == INVALID_SOCKET)
+        return true;
+
+    context->send_queue.append(std::move(data));
+    if (context->send_pending || context->send_queue.empty())
+        return true;
+
+    return post_send(context);
+}
+
+bool IocpEngine::post_send(ClientContext* context) {
+    OutboundQueue& queue = context->send_queue;
+    OutboundChunk& chunk = queue.front();
+    ZeroMemory(&context->send_overlapped, sizeof(OVERLAPPED));
+
+    if (chunk.file) {
+        queue.pin(1);
+        // file ranges go from the segment file to the socket in the kernel
+        uint64_t offset = chunk.offset;
+        context->send_overlapped.Offset = static_cast<DWORD>(offset);
+        context->send_overlapped.OffsetHigh = static_cast<DWORD>(offset >> 32);
+        if (!TransmitFile(context->sock, static_cast<HANDLE>(chunk.file->file->native_handle()),
+            static_cast<DWORD>(chunk.length), 0, &context->send_overlapped, NULL, 0) &&
+            WSAGetLastError() != WSA_IO_PENDING) {
+            std::lock_guard<std::mutex> lock(cout_mutex);
+            std::cerr << "[" << context->sock << " error] TransmitFile: " << WSAGetLastError() << std::endl;
+            return false;
+        }
+        context->send_pending = true;
+        return true;
+    }
+
+    // every byte chunk up to the next file range in one gather write; Winsock captures the
+    // WSABUF array during the call, only the buffers have to outlive it
+    OutboundSpan spans[maxSendSpans];
+    WSABUF wsabufs[maxSendSpans];
+    size_t count = queue.gather(spans, maxSendSpans, false);
+    for (size_t i = 0; i < count; ++i) {
+        wsabufs[i].buf = const_cast<char*>(spans[i].data);
+        wsabufs[i].len = static_cast<ULONG>(spans[i].size);
+    }
+    queue.pin(count);
+
+    DWORD bytesSent = 0;
+    DWORD flags = 0;
+
+    int sendResult = WSASend(context->sock, wsabufs, static_cast<DWORD>(count), &bytesSent, flags, &context->send_overlapped, NULL);
+
+    if (sendResult == SOCKET_ERROR && WSAGetLastError() != WSA_IO_PENDING) {
+        std::lock_guard<std::mutex> lock(cout_mutex);
+        std::cerr << "[" << context->sock << " error] WSASend: " << WSAGetLastError() << std::endl;
+        return false;
+    }
+
+    context->send_pending = true;
+    return true;
+}
+
+// outstanding overlapped operations still reference the context, so it is detached but not freed
+void IocpEngine::close_context(ClientContext* context) {
+    if (context->sock == INVALID_SOCKET)
+        return;
+
+    closesocket(context->sock);
+    context->sock = INVALID_SOCKET;
+    detach_context(context);
+}
+
+bool IocpEngine::post_recv(ClientContext* context) {
+    ZeroMemory(&context->recv_overlapped, sizeof(OVERLAPPED));
+
+    WSABUF wsabuf;
+    wsabuf.buf = context->buffer;
+    wsabuf.len = static_cast<ULONG>(ClientContext::bufferSize);
+    DWORD recvBytes = 0;
+    DWORD flags = 0;
+
+    int result = WSARecv(context->sock, &wsabuf, 1, &recvBytes, &flags, &context->recv_overlapped, NULL);
+    if (result == SOCKET_ERROR) {
+        int error = WSAGetLastError();
+        if (error != WSA_IO_PENDING) {
+            std::lock_guard<std::mutex> lock(cout_mutex);
+            std::cerr << "[error] WSARecv: " << error << std::endl;
+            return false;
+        }
+    }
+    return true;
+}
+
+#endif
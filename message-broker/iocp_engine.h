@@ -0,0 +1,36 @@
+#pragma once
+
+#ifdef _WIN32
+
+#include <thread>
+
+#include "net_engine.h"
+
+class IocpEngine : public NetEngine {
+public:
+    using NetEngine::NetEngine;
+    ~IocpEngine() override;
+
+    bool init(uint16_t port) override;
+    void run() override;
+    void stop() override;
+    const char* name() const override { return "iocp"; }
+
+protected:
+    void signal() override;
+    void deliver(ClientContext* context, PooledString out) override;
+
+private:
+    HANDLE hCompletionPort = NULL;
+    SOCKET listenSocket = INVALID_SOCKET;
+    std::thread workerThread;
+
+    void iocp_worker();
+    void client_connection_handler(SOCKET clientSocket);
+    bool post_recv(ClientContext* context);
+    bool queue_send(ClientContext* context, PooledString data);
+    bool post_send(ClientContext* context);
+    void close_context(ClientContext* context);
+};
+
+#endif
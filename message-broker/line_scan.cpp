@@ -0,0 +1,107 @@
+#include "line_scan.h"
+
+#include <bit>
+#include <cstdint>
+#include <cstring>
+
+#if defined(_M_X64) || defined(__x86_64__)
+#define LINE_SCAN_X86 1
+#include <immintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+#endif
+
+namespace {
+    size_t find_scalar(const char* data, size_t size) {
+        constexpr uint64_t ones = 0x0101010101010101ull;
+        constexpr uint64_t highs = 0x8080808080808080ull;
+        constexpr uint64_t newlines = ones * '\n';
+
+        // a word holds a zero byte when (v - ones) & ~v & highs is set; word ^ newlines turns
+        // newlines into zero bytes, and the exact position is found bytewise below
+        size_t i = 0;
+        for (; i + 8 <= size; i += 8) {
+            uint64_t word;
+            std::memcpy(&word, data + i, 8);
+            uint64_t shifted = word ^ newlines;
+            if ((((word - ones) & ~word) | ((shifted - ones) & ~shifted)) & highs)
+                break;
+        }
+        for (; i < size; ++i) {
+            if (data[i] == '\n' || data[i] == '\0')
+                return i;
+        }
+        return size;
+    }
+
+#if LINE_SCAN_X86
+    // SSE2 is part of x86-64, so this needs no check
+    size_t find_sse2(const char* data, size_t size) {
+        const __m128i newline = _mm_set1_epi8('\n');
+        const __m128i zero = _mm_setzero_si128();
+        size_t i = 0;
+        for (; i + 16 <= size; i += 16) {
+            __m128i chunk = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + i));
+            unsigned mask = static_cast<unsigned>(_mm_movemask_epi8(
+                _mm_or_si128(_mm_cmpeq_epi8(chunk, newline), _mm_cmpeq_epi8(chunk, zero))));
+            if (mask)
+                return i + std::countr_zero(mask);
+        }
+        return i + find_scalar(data + i, size - i);
+    }
+
+#if defined(__GNUC__) || defined(__clang__)
+    __attribute__((target("avx2")))
+#endif
+    size_t find_avx2(const char* data, size_t size) {
+        const __m256i newline = _mm256_set1_epi8('\n');
+        const __m256i zero = _mm256_setzero_si256();
+        size_t i = 0;
+        for (; i + 32 <= size; i += 32) {
+            __m256i chunk = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(data + i));
+            unsigned mask = static_cast<unsigned>(_mm256_movemask_epi8(
+                _mm256_or_si256(_mm256_cmpeq_epi8(chunk, newline), _mm256_cmpeq_epi8(chunk, zero))));
+            if (mask)
+                return i + std::countr_zero(mask);
+        }
+        return i + find_sse2(data + i, size - i);
+    }
+
+    bool avx2_supported() {
+#ifdef _MSC_VER
+        int info[4];
+        __cpuid(info, 1);
+        // the OS must save the ymm registers as well
+        if ((info[2] & (1 << 27)) == 0 || (_xgetbv(0) & 6) != 6)
+            return false;
+        __cpuidex(info, 7, 0);
+        return (info[1] & (1 << 5)) != 0;
+#else
+        return __builtin_cpu_supports("avx2");
+#endif
+    }
+
+    using Implementation = size_t(*)(const char*, size_t);
+
+    // picked once; the CPU does not change under a running process
+    const bool avx2 = avx2_supported();
+    const Implementation implementation = avx2 ? find_avx2 : find_sse2;
+#endif
+}
+
+size_t find_line_boundary(const char* data, size_t size) {
+#if LINE_SCAN_X86
+    return implementation(data, size);
+#else
+    return find_scalar(data, size);
+#endif
+}
+
+const char* line_scan_implementation() {
+#if LINE_SCAN_X86
+    return avx2 ? "avx2" : "sse2";
+#else
+    return "scalar";
+#endif
+}
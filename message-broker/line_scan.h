@@ -0,0 +1,10 @@
+#pragma once
+
+#include <cstddef>
+
+// Position of the first '\n' or '\0' in data[0, size), or size when there is neither. Lines of
+// the diagnostic log end in '\n' and the zero fill of a preallocated segment ends its text.
+// Compares 32 bytes at a time with AVX2 or 16 with SSE2, and a word at a time otherwise.
+size_t find_line_boundary(const char* data, size_t size);
+// "avx2", "sse2" or "scalar"
+const char* line_scan_implementation();
@@ -0,0 +1,41 @@
+#include "message_ring.h"
+
+#include <algorithm>
+#include <bit>
+
+MessageRing::MessageRing(size_t capacity)
+    : slots(std::make_unique<Slot[]>(std::bit_ceil(std::max<size_t>(capacity, 2)))),
+    mask(std::bit_ceil(std::max<size_t>(capacity, 2)) - 1) {
+    for (size_t i = 0; i <= mask; ++i)
+        slots[i].sequence.store(i, std::memory_order_relaxed);
+}
+
+bool MessageRing::try_push(SharedMessage& msg) {
+    size_t pos = enqueuePos.load(std::memory_order_relaxed);
+    while (true) {
+        Slot& slot = slots[pos & mask];
+        size_t sequence = slot.sequence.load(std::memory_order_acquire);
+        intptr_t diff = static_cast<intptr_t>(sequence) - static_cast<intptr_t>(pos);
+
+        if (diff == 0) {
+            if (enqueuePos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+                slot.size.store(msg.size(), std::memory_order_relaxed);
+                slot.message = std::move(msg);
+                slot.sequence.store(pos + 1, std::memory_order_release);
+                return true;
+            }
+        }
+        else if (diff < 0) {
+            return false;
+        }
+        else {
+            pos = enqueuePos.load(std::memory_order_relaxed);
+        }
+    }
+}
+
+size_t MessageRing::size_approx() const {
+    size_t tail = enqueuePos.load(std::memory_order_relaxed);
+    size_t head = dequeuePos.load(std::memory_order_relaxed);
+    return tail > head ? tail - head : 0;
+}
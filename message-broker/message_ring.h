@@ -0,0 +1,79 @@
+#pragma once
+
+#include <atomic>
+#include <memory>
+#include <utility>
+#include <cstddef>
+#include <cstdint>
+
+#include "shared_message.h"
+
+// std::hardware_destructive_interference_size is not reliable across compilers
+inline constexpr size_t cacheLineSize = 64;
+
+// Bounded lock-free multi-producer multi-consumer ring of message slots (Vyukov's algorithm).
+// A slot's sequence equals pos while it is free for the producer claiming pos and pos + 1 once
+// filled for the consumer claiming pos. Slots hold references to shared messages, so neither a
+// push nor a pop copies message bytes.
+class MessageRing {
+public:
+    enum class PopResult { Ok, Empty, TooLarge };
+
+    // rounded up to a power of two
+    explicit MessageRing(size_t capacity);
+
+    MessageRing(const MessageRing&) = delete;
+    MessageRing& operator=(const MessageRing&) = delete;
+
+    // false when full; msg is moved from only on success
+    bool try_push(SharedMessage& msg);
+
+    // hands the head message to consume as an rvalue, but only if it is at most maxSize bytes
+    template <typename Consume>
+    PopResult try_pop(Consume&& consume, size_t maxSize = SIZE_MAX);
+
+    size_t capacity() const { return mask + 1; }
+    size_t size_approx() const;
+
+private:
+    struct alignas(cacheLineSize) Slot {
+        std::atomic<size_t> sequence;
+        std::atomic<size_t> size;
+        SharedMessage message;
+    };
+
+    std::unique_ptr<Slot[]> slots;
+    size_t mask;
+    alignas(cacheLineSize) std::atomic<size_t> enqueuePos{ 0 };
+    alignas(cacheLineSize) std::atomic<size_t> dequeuePos{ 0 };
+};
+
+template <typename Consume>
+MessageRing::PopResult MessageRing::try_pop(Consume&& consume, size_t maxSize) {
+    size_t pos = dequeuePos.load(std::memory_order_relaxed);
+    while (true) {
+        Slot& slot = slots[pos & mask];
+        size_t sequence = slot.sequence.load(std::memory_order_acquire);
+        intptr_t diff = static_cast<intptr_t>(sequence) - static_cast<intptr_t>(pos + 1);
+
+        if (diff == 0) {
+            // a stale size only happens if another consumer took pos, and then the CAS fails
+            if (slot.size.load(std::memory_order_relaxed) > maxSize)
+                return PopResult::TooLarge;
+
+            if (dequeuePos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+                consume(std::move(slot.message));
+                // drop the slot's reference even if consume did not take it
+                slot.message = SharedMessage();
+                slot.sequence.store(pos + mask + 1, std::memory_order_release);
+                return PopResult::Ok;
+            }
+        }
+        else if (diff < 0) {
+            return PopResult::Empty;
+        }
+        else {
+            pos = dequeuePos.load(std::memory_order_relaxed);
+        }
+    }
+}
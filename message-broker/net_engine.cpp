@@ -0,0 +1,252 @@
+#include "net_engine.h"
+#include "command_handler.h"
+#include "consumer_group.h"
+#include "async_logger.h"
+#include "shard_runtime.h"
+
+#include <iostream>
+
+#ifdef _WIN32
+#include "iocp_engine.h"
+#else
+#include "epoll_engine.h"
+#include "uring_engine.h"
+#endif
+
+ClientContext* NetEngine::create_context(socket_t sock) {
+    {
+        std::lock_guard<std::mutex> lock(cout_mutex);
+        std::cout << "[info] client_connection_handler: " << sock << std::endl;
+    }
+
+    ClientContext* context = new ClientContext(pool, disk_handler);
+    context->sock = sock;
+    context->command_handler = std::make_unique<CommandHandler>();
+    context->waiter = std::make_shared<ConnectionWaiter>(*this, context);
+    return context;
+}
+
+void NetEngine::detach_context(ClientContext* context) {
+    if (context->waiter)
+        static_cast<ConnectionWaiter&>(*context->waiter).context = nullptr;
+    context->waiter.reset();
+    context->parked.clear();
+    context->pushes.clear();
+    context->acks.clear();
+
+    if (context->group) {
+        context->group->leave(context->memberId);
+        context->group = nullptr;
+    }
+}
+
+void NetEngine::destroy_context(ClientContext* context) {
+    detach_context(context);
+    delete context;
+}
+
+void ConnectionWaiter::notify() {
+    if (signaled.exchange(true, std::memory_order_acq_rel))
+        return;
+    engine.enqueue_wake(shared_from_this());
+}
+
+void NetEngine::enqueue_wake(std::shared_ptr<ConnectionWaiter> waiter) {
+    bool first;
+    {
+        std::lock_guard<std::mutex> lock(wakeMutex);
+        first = woken.empty();
+        woken.push_back(std::move(waiter));
+    }
+    if (first)
+        signal();
+}
+
+void NetEngine::enter_shard() {
+    ShardRuntime::get_instance().enter(shard);
+}
+
+void NetEngine::service_waiters() {
+    // results of forwarded appends wake their connections, which are then serviced below
+    ShardRuntime::get_instance().drain(shard);
+
+    std::vector<std::shared_ptr<ConnectionWaiter>> ready;
+    {
+        std::lock_guard<std::mutex> lock(wakeMutex);
+        ready.swap(woken);
+    }
+
+    auto now = std::chrono::steady_clock::now();
+    while (!deadlines.empty() && deadlines.top().first <= now) {
+        ready.push_back(deadlines.top().second);
+        deadlines.pop();
+    }
+
+    for (const auto& waiter : ready) {
+        // cleared first so a publish during service wakes the connection again
+        waiter->signaled.store(false, std::memory_order_release);
+        ClientContext* context = waiter->context;
+        if (!context)
+            continue;
+
+        PooledString out;
+        size_t queued = context->send_queue.size();
+        context->command_handler->service(context, now, out);
+        if (!out.empty() || context->send_queue.size() != queued)
+            deliver(context, std::move(out));
+    }
+}
+
+int NetEngine::next_timeout_ms() const {
+    if (deadlines.empty())
+        return -1;
+
+    auto wait = std::chrono::ceil<std::chrono::milliseconds>(deadlines.top().first - std::chrono::steady_clock::now());
+    return wait.count() > 0 ? static_cast<int>(wait.count()) : 0;
+}
+
+void NetEngine::on_send_drained(ClientContext* context) {
+    if (!context->pushes.empty() && context->waiter)
+        context->waiter->notify();
+}
+
+bool NetEngine::dispatch(ClientContext* context, std::string_view data, PooledString& out) {
+    if (context->mode == protocol::Mode::Unknown && !data.empty())
+        context->mode = data[0] == '\0' ? protocol::Mode::Binary : protocol::Mode::Text;
+
+    if (context->mode == protocol::Mode::Text) {
+        // legacy clients send one unterminated command per write, so a trailing piece is a command too
+        while (!data.empty()) {
+            size_t eol = data.find('\n');
+            std::string_view line = data.substr(0, eol);
+            data = eol == std::string_view::npos ? std::string_view() : data.substr(eol + 1);
+
+            if (line.find_first_not_of(" \r\t") == std::string_view::npos)
+                continue;
+            handle_request(context, protocol::parse_text(line), out);
+        }
+        return true;
+    }
+
+    // parse straight out of the receive buffer unless a partial frame is already pending
+    std::string_view input = data;
+    if (!context->inbound.empty()) {
+        context->inbound.append(data);
+        input = context->inbound;
+    }
+
+    size_t offset = 0;
+    while (offset < input.size()) {
+        protocol::Request request;
+        size_t consumed = 0;
+        protocol::ParseResult result = protocol::parse_frame(input.substr(offset), request, consumed);
+
+        if (result == protocol::ParseResult::Incomplete)
+            break;
+        if (result == protocol::ParseResult::Invalid) {
+            std::lock_guard<std::mutex> lock(cout_mutex);
+            std::cerr << "[" << context->sock << " error] malformed frame" << std::endl;
+            return false;
+        }
+
+        handle_request(context, request, out);
+        offset += consumed;
+    }
+
+    if (context->inbound.empty())
+        context->inbound.assign(input.substr(offset));
+    else
+        context->inbound.erase(0, offset);
+    return true;
+}
+
+void NetEngine::handle_request(ClientContext* context, const protocol::Request& request, PooledString& out) {
+    protocol::Response response = context->command_handler->handle_command(request, context);
+
+    if (response.deferred) {
+        // parked produces have no deadline, the group-commit thread always gets to them
+        if (request.type == protocol::RequestType::FetchBatch)
+            deadlines.emplace(context->parked.back().deadline, std::static_pointer_cast<ConnectionWaiter>(context->waiter));
+        return;
+    }
+
+    if (context->mode == protocol::Mode::Binary) {
+        if (response.status != protocol::Status::NoMessages)
+            log_debug("[{}] sent: {} ({} bytes, {} records)", context->sock, protocol::type_name(request.type), response.payload.size(), response.records.size());
+        CommandHandler::write_response(context, request, response, out);
+        return;
+    }
+
+    size_t start = out.size();
+    protocol::encode_text_response(out, response);
+    if (response.status != protocol::Status::NoMessages)
+        log_debug("[{}] sent: {}", context->sock, std::string_view(out).substr(start));
+}
+
+socket_t NetEngine::open_listen_socket(uint16_t port, bool nonblocking, bool reusePort) {
+    socket_t listenSocket = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+    if (listenSocket == invalid_socket) {
+        std::lock_guard<std::mutex> lock(cout_mutex);
+        std::cerr << "[error] socket: " << last_socket_error() << std::endl;
+        return invalid_socket;
+    }
+
+#ifndef _WIN32
+    int reuse = 1;
+    setsockopt(listenSocket, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
+    // the kernel spreads incoming connections over the shards' listening sockets
+    if (reusePort && setsockopt(listenSocket, SOL_SOCKET, SO_REUSEPORT, &reuse, sizeof(reuse)) != 0) {
+        std::lock_guard<std::mutex> lock(cout_mutex);
+        std::cerr << "[error] SO_REUSEPORT: " << last_socket_error() << std::endl;
+        close_socket(listenSocket);
+        return invalid_socket;
+    }
+#else
+    (void)reusePort;
+#endif
+
+    sockaddr_in service{};
+    service.sin_family = AF_INET;
+    service.sin_addr.s_addr = INADDR_ANY;
+    service.sin_port = htons(port);
+
+    if (bind(listenSocket, reinterpret_cast<sockaddr*>(&service), sizeof(service)) != 0 ||
+        listen(listenSocket, SOMAXCONN) != 0) {
+        std::lock_guard<std::mutex> lock(cout_mutex);
+        std::cerr << "[error] bind/listen: " << last_socket_error() << std::endl;
+        close_socket(listenSocket);
+        return invalid_socket;
+    }
+
+    if (nonblocking && !set_nonblocking(listenSocket)) {
+        std::lock_guard<std::mutex> lock(cout_mutex);
+        std::cerr << "[error] set_nonblocking: " << last_socket_error() << std::endl;
+        close_socket(listenSocket);
+        return invalid_socket;
+    }
+
+    return listenSocket;
+}
+
+std::unique_ptr<NetEngine> create_net_engine(std::string_view kind, BufferPool& pool, std::shared_ptr<DiskHandler> disk_handler) {
+#ifdef _WIN32
+    if (kind == "auto" || kind == "iocp")
+        return std::make_unique<IocpEngine>(pool, std::move(disk_handler));
+#else
+#ifdef BROKER_HAS_IO_URING
+    if (kind == "auto" || kind == "uring") {
+        if (UringEngine::supported())
+            return std::make_unique<UringEngine>(pool, std::move(disk_handler));
+
+        std::lock_guard<std::mutex> lock(cout_mutex);
+        std::cerr << "[warn] io_uring unavailable, falling back to epoll" << std::endl;
+    }
+#endif
+    if (kind == "auto" || kind == "uring" || kind == "epoll")
+        return std::make_unique<EpollEngine>(pool, std::move(disk_handler));
+#endif
+
+    std::lock_guard<std::mutex> lock(cout_mutex);
+    std::cerr << "[error] unsupported net engine: " << kind << std::endl;
+    return nullptr;
+}
@@ -0,0 +1,98 @@
+#pragma once
+
+#include <string>
+#include <string_view>
+#include <memory>
+#include <mutex>
+#include <atomic>
+#include <cstdint>
+#include <vector>
+#include <queue>
+#include <chrono>
+
+#include "platform.h"
+#include "client_context.h"
+#include "protocol.h"
+#include "waiter.h"
+
+class BufferPool;
+class DiskHandler;
+class NetEngine;
+
+extern std::mutex cout_mutex;
+
+// per-connection waiter; topics notify it from publishing threads and the engine services the
+// connection on its own thread. context is cleared (on the engine thread) when the connection closes.
+struct ConnectionWaiter : Waiter, std::enable_shared_from_this<ConnectionWaiter> {
+    ConnectionWaiter(NetEngine& engine, ClientContext* context) : engine(engine), context(context) {}
+    void notify() override;
+
+    NetEngine& engine;
+    ClientContext* context;
+    std::atomic<bool> signaled{ false };
+};
+
+// common interface for the platform network engines (IOCP, io_uring, epoll)
+class NetEngine {
+public:
+    NetEngine(BufferPool& pool, std::shared_ptr<DiskHandler> disk_handler)
+        : pool(pool), disk_handler(std::move(disk_handler)) {}
+    virtual ~NetEngine() = default;
+
+    NetEngine(const NetEngine&) = delete;
+    NetEngine& operator=(const NetEngine&) = delete;
+
+    // shard this engine serves, set before init; with several shards every engine listens on the
+    // same port (SO_REUSEPORT) unless the platform hands accepted sockets over instead
+    void set_shard(size_t index, size_t count) { shard = index; shardCount = count; }
+
+    virtual bool init(uint16_t port) = 0;
+    virtual void run() = 0;
+    virtual void stop() = 0;
+    virtual const char* name() const = 0;
+
+    // thread-safe; queues the waiter and wakes the engine thread
+    void enqueue_wake(std::shared_ptr<ConnectionWaiter> waiter);
+
+protected:
+    friend class ShardRuntime;
+
+    BufferPool& pool;
+    std::shared_ptr<DiskHandler> disk_handler;
+    std::atomic<bool> running{ true };
+    size_t shard = 0;
+    size_t shardCount = 1;
+
+    ClientContext* create_context(socket_t sock);
+    // detach from parked requests and push subscriptions; destroy_context also deletes
+    void detach_context(ClientContext* context);
+    void destroy_context(ClientContext* context);
+    // false when the peer sent a malformed frame and the connection should be closed
+    bool dispatch(ClientContext* context, std::string_view data, PooledString& out);
+    void handle_request(ClientContext* context, const protocol::Request& request, PooledString& out);
+    static socket_t open_listen_socket(uint16_t port, bool nonblocking, bool reusePort = false);
+
+    // engine thread, before its loop: binds the thread to the engine's shard
+    void enter_shard();
+    // engine thread: run tasks from other shards, answer woken and expired parked requests,
+    // stream push subscriptions
+    void service_waiters();
+    // engine thread: ms until the next parked request expires, -1 when none
+    int next_timeout_ms() const;
+    // called after a send backlog fully drains so paused push subscriptions resume
+    void on_send_drained(ClientContext* context);
+    // wakes the engine thread out of its wait; called from any thread
+    virtual void signal() = 0;
+    // queues bytes produced outside a receive completion on the connection, engine thread only
+    virtual void deliver(ClientContext* context, PooledString out) = 0;
+
+private:
+    using Deadline = std::pair<std::chrono::steady_clock::time_point, std::shared_ptr<ConnectionWaiter>>;
+
+    std::mutex wakeMutex;
+    std::vector<std::shared_ptr<ConnectionWaiter>> woken;
+    std::priority_queue<Deadline, std::vector<Deadline>, std::greater<>> deadlines;
+};
+
+// kind: "auto", "iocp", "uring", "epoll"
+std::unique_ptr<NetEngine> create_net_engine(std::string_view kind, BufferPool& pool, std::shared_ptr<DiskHandler> disk_handler);
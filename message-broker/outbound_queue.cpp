@@ -0,0 +1,104 @@
+#include "outbound_queue.h"
+
+namespace {
+    // bigger writes keep their own buffer and go out as a separate span of the gather write
+    constexpr size_t mergeLimit = 512;
+}
+
+bool OutboundQueue::can_merge() const {
+    return chunks.size() > pinned && !chunks.back().file && !chunks.back().message;
+}
+
+void OutboundQueue::append(std::string_view data) {
+    if (data.empty())
+        return;
+
+    if (can_merge())
+        chunks.back().bytes.append(data);
+    else
+        chunks.emplace_back().bytes.assign(data);
+    total += data.size();
+}
+
+void OutboundQueue::append(PooledString&& data) {
+    if (data.empty())
+        return;
+
+    total += data.size();
+    if (can_merge() && data.size() < mergeLimit)
+        chunks.back().bytes.append(data);
+    else
+        chunks.emplace_back().bytes = std::move(data);
+}
+
+void OutboundQueue::append_file(std::shared_ptr<const MappedSegment> file, size_t offset, size_t length) {
+    if (length == 0)
+        return;
+
+    OutboundChunk chunk;
+    chunk.file = std::move(file);
+    chunk.offset = offset;
+    chunk.length = length;
+    chunks.push_back(std::move(chunk));
+    total += length;
+}
+
+size_t OutboundQueue::gather(OutboundSpan* spans, size_t maxSpans, bool mapped) const {
+    size_t count = 0;
+    for (const OutboundChunk& chunk : chunks) {
+        if (count == maxSpans)
+            break;
+        if (chunk.file) {
+            // sendfile / TransmitFile take a file range on its own
+            if (!mapped)
+                break;
+            spans[count++] = OutboundSpan{ chunk.file->file->data() + chunk.offset, chunk.length };
+        }
+        else if (chunk.message)
+            spans[count++] = OutboundSpan{ chunk.message.record().data() + chunk.offset, chunk.length };
+        else
+            spans[count++] = OutboundSpan{ chunk.bytes.data(), chunk.bytes.size() };
+    }
+    return count;
+}
+
+void OutboundQueue::append_message(SharedMessage message) {
+    // a span per tiny record would cost more than copying it
+    std::string_view record = message.record();
+    if (record.size() < mergeLimit) {
+        append(record);
+        return;
+    }
+
+    OutboundChunk& chunk = chunks.emplace_back();
+    chunk.length = record.size();
+    chunk.message = std::move(message);
+    total += chunk.length;
+}
+
+void OutboundQueue::consume(size_t n) {
+    total -= n;
+    pinned = 0;
+
+    while (n > 0) {
+        OutboundChunk& chunk = chunks.front();
+        if (n >= chunk.size()) {
+            n -= chunk.size();
+            chunks.pop_front();
+            continue;
+        }
+        if (chunk.file || chunk.message) {
+            chunk.offset += n;
+            chunk.length -= n;
+        }
+        else
+            chunk.bytes.erase(0, n);
+        break;
+    }
+}
+
+void OutboundQueue::clear() {
+    chunks.clear();
+    total = 0;
+    pinned = 0;
+}
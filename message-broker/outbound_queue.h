@@ -0,0 +1,65 @@
+#pragma once
+
+#include <string>
+#include <string_view>
+#include <memory>
+#include <deque>
+#include <cstddef>
+
+#include "segment_cache.h"
+#include "buffer_pool.h"
+#include "shared_message.h"
+
+// one piece of a connection's outbound stream
+struct OutboundChunk {
+    PooledString bytes;
+    // a range of a segment file, sent with sendfile / TransmitFile (or from the mapping) instead of bytes;
+    // holding the mapping keeps the file open until the range is out
+    std::shared_ptr<const MappedSegment> file;
+    // or a record sent straight from the shared message, which stays alive until it is out
+    SharedMessage message;
+    // unsent range of the file or of the message record
+    size_t offset = 0;
+    size_t length = 0;
+
+    size_t size() const { return file || message ? length : bytes.size(); }
+};
+
+// contiguous bytes of a queued chunk, one entry of a gather write
+struct OutboundSpan {
+    const char* data;
+    size_t size;
+};
+
+// Bytes waiting to be sent on a connection, in order. Responses keep their own buffers and are sent
+// together with one gather write; only tiny writes are merged into the last byte chunk, and never
+// into a chunk that is being sent (pin), so an in-flight buffer never moves.
+class OutboundQueue {
+public:
+    void append(std::string_view data);
+    void append(PooledString&& data);
+    void append_file(std::shared_ptr<const MappedSegment> file, size_t offset, size_t length);
+    // the message's record (length prefix and body); small ones are copied like small writes
+    void append_message(SharedMessage message);
+
+    bool empty() const { return chunks.empty(); }
+    // total bytes queued
+    size_t size() const { return total; }
+
+    OutboundChunk& front() { return chunks.front(); }
+    // fills spans from the leading chunks, at most maxSpans, and returns how many. A file range
+    // ends the run unless mapped is set, then its bytes are taken from the segment mapping.
+    size_t gather(OutboundSpan* spans, size_t maxSpans, bool mapped) const;
+    // the first count chunks are handed to an asynchronous send and must stay where they are
+    void pin(size_t count) { pinned = count; }
+    // drops n sent bytes from the front, and every chunk that is fully sent
+    void consume(size_t n);
+    void clear();
+
+private:
+    std::deque<OutboundChunk> chunks;
+    size_t total = 0;
+    size_t pinned = 0;
+
+    bool can_merge() const;
+};
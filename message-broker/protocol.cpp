@@ -0,0 +1,307 @@
+#include "protocol.h"
+
+namespace protocol {
+    namespace {
+        uint16_t get_u16(const char* p) {
+            const auto* b = reinterpret_cast<const unsigned char*>(p);
+            return static_cast<uint16_t>((b[0] << 8) | b[1]);
+        }
+
+        uint32_t get_u32(const char* p) {
+            const auto* b = reinterpret_cast<const unsigned char*>(p);
+            return (static_cast<uint32_t>(b[0]) << 24) | (static_cast<uint32_t>(b[1]) << 16) |
+                (static_cast<uint32_t>(b[2]) << 8) | static_cast<uint32_t>(b[3]);
+        }
+
+        uint64_t get_u64(const char* p) {
+            return (static_cast<uint64_t>(get_u32(p)) << 32) | get_u32(p + 4);
+        }
+
+        void put_u16(PooledString& out, uint16_t v) {
+            out.push_back(static_cast<char>(v >> 8));
+            out.push_back(static_cast<char>(v));
+        }
+
+        void put_u32(PooledString& out, uint32_t v) {
+            out.push_back(static_cast<char>(v >> 24));
+            out.push_back(static_cast<char>(v >> 16));
+            out.push_back(static_cast<char>(v >> 8));
+            out.push_back(static_cast<char>(v));
+        }
+
+        // trailing payload bytes are not appended here, the caller sends them after the frame
+        void put_frame(PooledString& out, uint8_t type, uint8_t status, uint32_t correlationId,
+            std::string_view topic, std::string_view payload, size_t trailing = 0) {
+            size_t length = headerSize - lengthSize + topic.size() + payload.size() + trailing;
+            out.reserve(out.size() + lengthSize + length - trailing);
+
+            put_u32(out, static_cast<uint32_t>(length));
+            out.push_back(static_cast<char>(type));
+            out.push_back(static_cast<char>(status));
+            put_u16(out, static_cast<uint16_t>(topic.size()));
+            put_u32(out, correlationId);
+            put_u32(out, static_cast<uint32_t>(payload.size() + trailing));
+            out.append(topic);
+            out.append(payload);
+        }
+
+        void put_u64(PooledString& out, uint64_t v) {
+            put_u32(out, static_cast<uint32_t>(v >> 32));
+            put_u32(out, static_cast<uint32_t>(v));
+        }
+
+        std::string_view trim(std::string_view str) {
+            size_t start = str.find_first_not_of(" \r\n\t");
+            if (start == std::string_view::npos) return {};
+            size_t end = str.find_last_not_of(" \r\n\t");
+            return str.substr(start, end - start + 1);
+        }
+    }
+
+    ParseResult parse_frame(std::string_view data, Request& request, size_t& consumed) {
+        if (data.size() < lengthSize)
+            return ParseResult::Incomplete;
+
+        uint32_t length = get_u32(data.data());
+        if (length < headerSize - lengthSize || length > maxFrameSize)
+            return ParseResult::Invalid;
+
+        if (data.size() < lengthSize + length)
+            return ParseResult::Incomplete;
+
+        const char* p = data.data() + lengthSize;
+        uint16_t topicLength = get_u16(p + 2);
+        uint32_t payloadLength = get_u32(p + 8);
+
+        if (static_cast<size_t>(topicLength) + payloadLength != length - (headerSize - lengthSize))
+            return ParseResult::Invalid;
+
+        request.type = static_cast<RequestType>(static_cast<uint8_t>(p[0]));
+        request.correlationId = get_u32(p + 4);
+        request.topic = std::string_view(data.data() + headerSize, topicLength);
+        request.payload = std::string_view(data.data() + headerSize + topicLength, payloadLength);
+
+        consumed = lengthSize + length;
+        return ParseResult::Ok;
+    }
+
+    void encode_request(PooledString& out, const Request& request) {
+        put_frame(out, static_cast<uint8_t>(request.type), 0, request.correlationId, request.topic, request.payload);
+    }
+
+    void encode_response(PooledString& out, const Request& request, const Response& response) {
+        size_t trailing = response.file ? response.file->length : 0;
+        for (const SharedMessage& record : response.records)
+            trailing += record.record().size();
+
+        put_frame(out, static_cast<uint8_t>(request.type), static_cast<uint8_t>(response.status),
+            request.correlationId, response.topic.empty() ? request.topic : std::string_view(response.topic), response.payload,
+            trailing);
+    }
+
+    void append_record(PooledString& out, std::string_view record) {
+        put_u32(out, static_cast<uint32_t>(record.size()));
+        out.append(record);
+    }
+
+    bool parse_records(std::string_view payload, std::vector<std::string_view>& records) {
+        size_t offset = 0;
+        while (offset < payload.size()) {
+            if (payload.size() - offset < 4)
+                return false;
+
+            uint32_t length = get_u32(payload.data() + offset);
+            offset += 4;
+            if (payload.size() - offset < length)
+                return false;
+
+            records.emplace_back(payload.data() + offset, length);
+            offset += length;
+        }
+        return true;
+    }
+
+    void append_log_record(PooledString& out, uint64_t offset, std::string_view record) {
+        put_u64(out, offset);
+        put_u32(out, static_cast<uint32_t>(record.size()));
+        out.append(record);
+    }
+
+    bool parse_log_records(std::string_view payload, uint32_t& partition, std::vector<std::pair<uint64_t, std::string_view>>& records) {
+        if (payload.size() < 4)
+            return false;
+        partition = get_u32(payload.data());
+
+        size_t offset = 4;
+        while (offset < payload.size()) {
+            if (payload.size() - offset < 12)
+                return false;
+
+            uint64_t recordOffset = get_u64(payload.data() + offset);
+            uint32_t length = get_u32(payload.data() + offset + 8);
+            offset += 12;
+            if (payload.size() - offset < length)
+                return false;
+
+            records.emplace_back(recordOffset, payload.substr(offset, length));
+            offset += length;
+        }
+        return true;
+    }
+
+    void encode_u32(PooledString& out, uint32_t value) {
+        put_u32(out, value);
+    }
+
+    bool parse_u32(std::string_view payload, uint32_t& value) {
+        if (payload.size() < 4)
+            return false;
+        value = get_u32(payload.data());
+        return true;
+    }
+
+    void encode_u64(PooledString& out, uint64_t value) {
+        put_u64(out, value);
+    }
+
+    bool parse_u64(std::string_view payload, uint64_t& value) {
+        if (payload.size() < 8)
+            return false;
+        value = get_u64(payload.data());
+        return true;
+    }
+
+    void encode_commit_offset(PooledString& out, uint64_t offset, uint32_t partition) {
+        put_u64(out, offset);
+        put_u32(out, partition);
+    }
+
+    bool parse_commit_offset(std::string_view payload, uint64_t& offset, uint32_t& partition) {
+        if (payload.size() < 8)
+            return false;
+        offset = get_u64(payload.data());
+        partition = payload.size() >= 12 ? get_u32(payload.data() + 8) : 0;
+        return true;
+    }
+
+    void encode_fetch_log(PooledString& out, uint64_t offset, uint32_t maxBytes, uint32_t partition) {
+        put_u64(out, offset);
+        put_u32(out, maxBytes);
+        put_u32(out, partition);
+    }
+
+    bool parse_fetch_log(std::string_view payload, uint64_t& offset, uint32_t& maxBytes, uint32_t& partition) {
+        if (payload.size() < 12)
+            return false;
+        offset = get_u64(payload.data());
+        maxBytes = get_u32(payload.data() + 8);
+        partition = payload.size() >= 16 ? get_u32(payload.data() + 12) : 0;
+        return maxBytes > 0;
+    }
+
+    void encode_offset_for_time(PooledString& out, int64_t timestamp, uint32_t partition) {
+        put_u64(out, static_cast<uint64_t>(timestamp));
+        put_u32(out, partition);
+    }
+
+    bool parse_offset_for_time(std::string_view payload, int64_t& timestamp, uint32_t& partition) {
+        if (payload.size() < 8)
+            return false;
+        timestamp = static_cast<int64_t>(get_u64(payload.data()));
+        partition = payload.size() >= 12 ? get_u32(payload.data() + 8) : 0;
+        return true;
+    }
+
+    void encode_fetch_params(PooledString& out, const FetchParams& params) {
+        put_u32(out, params.maxRecords);
+        put_u32(out, params.maxBytes);
+        put_u32(out, params.minBytes);
+        put_u32(out, params.maxWaitMs);
+        put_u32(out, params.partition);
+    }
+
+    bool parse_fetch_params(std::string_view payload, FetchParams& params) {
+        if (payload.size() < 12)
+            return false;
+
+        params.maxRecords = get_u32(payload.data());
+        params.maxBytes = get_u32(payload.data() + 4);
+        params.minBytes = get_u32(payload.data() + 8);
+        params.maxWaitMs = payload.size() >= 16 ? get_u32(payload.data() + 12) : 0;
+        params.partition = payload.size() >= 20 ? get_u32(payload.data() + 16) : FetchParams::anyPartition;
+        return params.maxRecords > 0;
+    }
+
+    Request parse_text(std::string_view line) {
+        std::string_view cmd = trim(line);
+        Request request;
+
+        if (cmd.starts_with("SUBSCRIBE ")) {
+            request.type = RequestType::Subscribe;
+            request.topic = cmd.substr(10);
+            return request;
+        }
+
+        if (cmd.starts_with("PULL")) {
+            request.type = RequestType::Pull;
+            return request;
+        }
+
+        if (cmd.starts_with("PUBLISH ")) { // PUBLISH <topic> <message>
+            size_t firstSpace = cmd.find(' ', 8);
+            if (firstSpace != std::string_view::npos) {
+                request.type = RequestType::Publish;
+                request.topic = cmd.substr(8, firstSpace - 8);
+                request.payload = cmd.substr(firstSpace + 1);
+                return request;
+            }
+        }
+
+        request.payload = cmd;
+        return request;
+    }
+
+    void encode_text_response(PooledString& out, const Response& response) {
+        switch (response.status) {
+        case Status::Ok:
+            out.append(response.payload.empty() ? std::string_view("OK") : std::string_view(response.payload));
+            break;
+        case Status::NoMessages:
+            out.append("NO_MESSAGES");
+            break;
+        case Status::NoTopic:
+            out.append("NO_TOPIC");
+            break;
+        case Status::InvalidRequest:
+            out.append("INVALID_CMD: ");
+            out.append(response.payload);
+            break;
+        case Status::StorageError:
+            out.append("STORAGE_ERROR");
+            break;
+        case Status::QueueFull:
+            out.append("QUEUE_FULL");
+            break;
+        }
+    }
+
+    const char* type_name(RequestType type) {
+        switch (type) {
+        case RequestType::Subscribe: return "SUBSCRIBE";
+        case RequestType::Pull: return "PULL";
+        case RequestType::Publish: return "PUBLISH";
+        case RequestType::ProduceBatch: return "PRODUCE_BATCH";
+        case RequestType::FetchBatch: return "FETCH_BATCH";
+        case RequestType::SubscribePush: return "SUBSCRIBE_PUSH";
+        case RequestType::Push: return "PUSH";
+        case RequestType::JoinGroup: return "JOIN_GROUP";
+        case RequestType::CommitOffset: return "COMMIT_OFFSET";
+        case RequestType::FetchLog: return "FETCH_LOG";
+        case RequestType::CreateTopic: return "CREATE_TOPIC";
+        case RequestType::ProduceKeyed: return "PRODUCE_KEYED";
+        case RequestType::ProduceCompressed: return "PRODUCE_COMPRESSED";
+        case RequestType::OffsetForTime: return "OFFSET_FOR_TIME";
+        default: return "UNKNOWN";
+        }
+    }
+}
@@ -0,0 +1,152 @@
+#pragma once
+
+#include <string>
+#include <string_view>
+#include <cstdint>
+#include <cstddef>
+#include <vector>
+#include <utility>
+#include <memory>
+#include <optional>
+
+#include "buffer_pool.h"
+#include "shared_message.h"
+
+struct MappedSegment;
+
+// Binary frame (all integers big-endian):
+//   u32 length          bytes following this field
+//   u8  type            RequestType (responses echo the request type)
+//   u8  status          Status, 0 in requests
+//   u16 topic_length
+//   u32 correlation_id
+//   u32 payload_length
+//   topic, payload
+// Frames are capped at maxFrameSize, so the first byte of a binary connection is always 0x00,
+// which never starts a text command. That byte selects the connection's mode.
+namespace protocol {
+    constexpr size_t lengthSize = 4;
+    constexpr size_t headerSize = 16;
+    constexpr size_t maxFrameSize = 16 * 1024 * 1024;
+
+    enum class Mode : uint8_t { Unknown, Text, Binary };
+
+    enum class RequestType : uint8_t {
+        Unknown = 0,
+        Subscribe = 1,
+        Pull = 2,
+        Publish = 3,
+        ProduceBatch = 4,
+        FetchBatch = 5,
+        SubscribePush = 6,
+        // broker -> client only: records for a push subscription, correlation id of the SubscribePush
+        Push = 7,
+        // topic is the group id, payload a record set of topic names
+        JoinGroup = 8,
+        // payload: u64 next offset to consume for the frame's topic [| u32 partition, default 0]
+        CommitOffset = 9,
+        // payload: u64 offset | u32 max_bytes [| u32 partition, default 0]; the response payload is raw
+        // commit log records (LogRecordHeader layout, little-endian) sent straight from the segment file;
+        // a compressed batch is sent whole, so it may start before offset
+        FetchLog = 10,
+        // payload: u32 partition count [| u8 cleanup policy: 0 delete, 1 compact, 2 compact and delete];
+        // Ok again for an existing topic with the same count and policy
+        CreateTopic = 11,
+        // payload: record set of key, value pairs; every value goes to the partition of its key,
+        // empty keys round-robin
+        ProduceKeyed = 12,
+        // payload: u8 codec | compressed batch (compression.h); logged as sent to the next partition
+        // round-robin, FETCH_LOG returns it as one record
+        ProduceCompressed = 13,
+        // payload: i64 timestamp (ms since epoch) [| u32 partition, default 0]; the response payload is
+        // the u64 offset of the partition's first record stamped at or after it, or the log's next
+        // offset when there is none yet, to start a FETCH_LOG from
+        OffsetForTime = 14,
+    };
+
+    enum class Status : uint8_t {
+        Ok = 0,
+        NoMessages = 1,
+        NoTopic = 2,
+        InvalidRequest = 3,
+        // a produce's records could not be written to the commit log; none of that partition's
+        // records were acknowledged or queued, others of the same request may have been
+        StorageError = 4,
+        // a memory-only partition's queue had no room for the records; retry once consumers caught up
+        QueueFull = 5,
+    };
+
+    enum class ParseResult { Ok, Incomplete, Invalid };
+
+    // views point into the receive or reassembly buffer and are only valid while it is
+    struct Request {
+        RequestType type = RequestType::Unknown;
+        uint32_t correlationId = 0;
+        std::string_view topic;
+        std::string_view payload;
+    };
+
+    // FetchBatch / SubscribePush request payload: u32 max_records | u32 max_bytes | u32 min_bytes [| u32 max_wait_ms [| u32 partition]]
+    // with max_wait_ms > 0 an empty fetch is parked until records arrive or the wait expires
+    struct FetchParams {
+        // every partition of the topic
+        static constexpr uint32_t anyPartition = UINT32_MAX;
+
+        uint32_t maxRecords = 1;
+        uint32_t maxBytes = 1024 * 1024;
+        uint32_t minBytes = 0;
+        uint32_t maxWaitMs = 0;
+        uint32_t partition = anyPartition;
+    };
+
+    struct Response {
+        Status status = Status::Ok;
+        PooledString payload;
+        // parked request: nothing is sent now, the engine answers it later
+        bool deferred = false;
+        // overrides the echoed request topic, e.g. a group fetch names the topic it read
+        std::string topic;
+        // sent after payload straight from a segment file; the frame's payload length covers both
+        struct FileRange {
+            std::shared_ptr<const MappedSegment> segment;
+            size_t offset;
+            size_t length;
+        };
+        std::optional<FileRange> file;
+        // record set entries after payload, sent from the shared messages themselves
+        std::vector<SharedMessage> records;
+    };
+
+    ParseResult parse_frame(std::string_view data, Request& request, size_t& consumed);
+    inline Status frame_status(std::string_view frame) { return static_cast<Status>(static_cast<uint8_t>(frame[lengthSize + 1])); }
+    void encode_request(PooledString& out, const Request& request);
+    void encode_response(PooledString& out, const Request& request, const Response& response);
+
+    // record set used by ProduceBatch requests and FetchBatch responses: repeated u32 length | bytes
+    void append_record(PooledString& out, std::string_view record);
+    bool parse_records(std::string_view payload, std::vector<std::string_view>& records);
+
+    // FetchBatch response for a group member: u32 partition, then repeated u64 offset | u32 length | bytes
+    void append_log_record(PooledString& out, uint64_t offset, std::string_view record);
+    bool parse_log_records(std::string_view payload, uint32_t& partition, std::vector<std::pair<uint64_t, std::string_view>>& records);
+    void encode_u32(PooledString& out, uint32_t value);
+    bool parse_u32(std::string_view payload, uint32_t& value);
+    void encode_u64(PooledString& out, uint64_t value);
+    bool parse_u64(std::string_view payload, uint64_t& value);
+
+    void encode_commit_offset(PooledString& out, uint64_t offset, uint32_t partition);
+    bool parse_commit_offset(std::string_view payload, uint64_t& offset, uint32_t& partition);
+    void encode_fetch_log(PooledString& out, uint64_t offset, uint32_t maxBytes, uint32_t partition = 0);
+    bool parse_fetch_log(std::string_view payload, uint64_t& offset, uint32_t& maxBytes, uint32_t& partition);
+    void encode_offset_for_time(PooledString& out, int64_t timestamp, uint32_t partition = 0);
+    bool parse_offset_for_time(std::string_view payload, int64_t& timestamp, uint32_t& partition);
+
+    void encode_fetch_params(PooledString& out, const FetchParams& params);
+    bool parse_fetch_params(std::string_view payload, FetchParams& params);
+
+    // legacy text commands: "SUBSCRIBE <topic>", "PULL", "PUBLISH <topic> <message>"
+    Request parse_text(std::string_view line);
+    void encode_text_response(PooledString& out, const Response& response);
+
+    const char* type_name(RequestType type);
+}
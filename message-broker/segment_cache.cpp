@@ -0,0 +1,122 @@
+#include "segment_cache.h"
+
+size_t MappedSegment::bytes() const {
+    return (file ? file->size() : 0) + (index ? index->mapped_bytes() : 0);
+}
+
+SegmentCache& SegmentCache::get_instance() {
+    static SegmentCache instance;
+    return instance;
+}
+
+void SegmentCache::configure(size_t segments, size_t bytes) {
+    std::lock_guard<std::mutex> lock(mtx);
+    maxSegments = segments;
+    maxBytes = bytes;
+    evict_locked();
+}
+
+std::shared_ptr<const MappedSegment> SegmentCache::acquire(const std::string& filename) {
+    if (auto cached = lookup(filename))
+        return cached;
+
+    // map outside the lock; a racing reader may insert first, and insert() keeps theirs
+    auto segment = std::make_shared<MappedSegment>();
+    segment->file = create_segment_file();
+    if (!segment->file->open(filename, 0, false))
+        return nullptr;
+
+    return insert(filename, std::move(segment));
+}
+
+std::shared_ptr<const MappedSegment> SegmentCache::acquire_indexed(const std::string& basePath, uint64_t baseOffset) {
+    if (auto cached = lookup(basePath))
+        return cached;
+
+    auto segment = std::make_shared<MappedSegment>();
+    segment->file = create_segment_file();
+    if (!segment->file->open(basePath + ".log", 0, false))
+        return nullptr;
+
+    segment->index = std::make_unique<SegmentIndex>(baseOffset, 0);
+    if (!segment->index->open(basePath, 0, false))
+        segment->index.reset();
+
+    return insert(basePath, std::move(segment));
+}
+
+void SegmentCache::invalidate(const std::string& key) {
+    std::lock_guard<std::mutex> lock(mtx);
+    auto it = entries.find(key);
+    if (it == entries.end())
+        return;
+
+    mappedBytes -= it->second->segment->bytes();
+    lru.erase(it->second);
+    entries.erase(it);
+}
+
+void SegmentCache::invalidate_directory(std::string_view directory) {
+    std::string prefix(directory);
+    if (!prefix.empty() && prefix.back() != '/')
+        prefix += '/';
+
+    std::lock_guard<std::mutex> lock(mtx);
+    for (auto it = lru.begin(); it != lru.end();) {
+        if (it->key.starts_with(prefix)) {
+            mappedBytes -= it->segment->bytes();
+            entries.erase(it->key);
+            it = lru.erase(it);
+        }
+        else {
+            ++it;
+        }
+    }
+}
+
+SegmentCacheStats SegmentCache::stats() const {
+    std::lock_guard<std::mutex> lock(mtx);
+    SegmentCacheStats s = counters;
+    s.entries = entries.size();
+    s.mappedBytes = mappedBytes;
+    return s;
+}
+
+std::shared_ptr<const MappedSegment> SegmentCache::lookup(const std::string& key) {
+    std::lock_guard<std::mutex> lock(mtx);
+    auto it = entries.find(key);
+    if (it == entries.end()) {
+        counters.misses++;
+        return nullptr;
+    }
+
+    counters.hits++;
+    lru.splice(lru.begin(), lru, it->second);
+    return it->second->segment;
+}
+
+std::shared_ptr<const MappedSegment> SegmentCache::insert(const std::string& key, std::shared_ptr<const MappedSegment> segment) {
+    std::lock_guard<std::mutex> lock(mtx);
+    auto it = entries.find(key);
+    if (it != entries.end()) {
+        lru.splice(lru.begin(), lru, it->second);
+        return it->second->segment;
+    }
+
+    lru.push_front({ key, segment });
+    entries.emplace(key, lru.begin());
+    mappedBytes += segment->bytes();
+    evict_locked();
+    return segment;
+}
+
+// the front entry is the one just used and is never evicted here
+void SegmentCache::evict_locked() {
+    while (lru.size() > 1 && (lru.size() > maxSegments || mappedBytes > maxBytes)) {
+        Entry& victim = lru.back();
+        mappedBytes -= victim.segment->bytes();
+        entries.erase(victim.key);
+        lru.pop_back();
+        counters.evictions++;
+    }
+}
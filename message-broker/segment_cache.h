@@ -0,0 +1,67 @@
+#pragma once
+
+#include <string>
+#include <string_view>
+#include <memory>
+#include <mutex>
+#include <list>
+#include <unordered_map>
+#include <cstdint>
+
+#include "segment_file.h"
+#include "segment_index.h"
+
+struct MappedSegment {
+    std::unique_ptr<SegmentFile> file;
+    std::unique_ptr<SegmentIndex> index;    // sealed commit log segments only
+
+    size_t bytes() const;
+};
+
+struct SegmentCacheStats {
+    uint64_t hits = 0;
+    uint64_t misses = 0;
+    uint64_t evictions = 0;
+    size_t entries = 0;
+    size_t mappedBytes = 0;
+};
+
+// Read-only segment mappings shared by every reader. Entries are reference counted, so an
+// evicted mapping stays valid until the last reader holding it lets go.
+class SegmentCache {
+public:
+    static SegmentCache& get_instance();
+
+    void configure(size_t maxSegments, size_t maxBytes);
+
+    std::shared_ptr<const MappedSegment> acquire(const std::string& filename);
+    // maps <basePath>.log together with its .index/.timeindex sidecars
+    std::shared_ptr<const MappedSegment> acquire_indexed(const std::string& basePath, uint64_t baseOffset);
+
+    void invalidate(const std::string& key);
+    void invalidate_directory(std::string_view directory);
+
+    SegmentCacheStats stats() const;
+
+private:
+    SegmentCache() = default;
+    SegmentCache(const SegmentCache&) = delete;
+    SegmentCache& operator=(const SegmentCache&) = delete;
+
+    struct Entry {
+        std::string key;
+        std::shared_ptr<const MappedSegment> segment;
+    };
+
+    mutable std::mutex mtx;
+    std::list<Entry> lru;
+    std::unordered_map<std::string, std::list<Entry>::iterator> entries;
+    size_t maxSegments = 64;
+    size_t maxBytes = 1024ull * 1024 * 1024;
+    size_t mappedBytes = 0;
+    SegmentCacheStats counters;
+
+    std::shared_ptr<const MappedSegment> lookup(const std::string& key);
+    std::shared_ptr<const MappedSegment> insert(const std::string& key, std::shared_ptr<const MappedSegment> segment);
+    void evict_locked();
+};
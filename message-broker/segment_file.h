@@ -0,0 +1,32 @@
+#pragma once
+
+#include <string>
+#include <memory>
+
+// memory-mapped log segment, one implementation per platform
+class SegmentFile {
+public:
+#ifdef _WIN32
+    using NativeHandle = void*;     // HANDLE
+#else
+    using NativeHandle = int;
+#endif
+
+    virtual ~SegmentFile() = default;
+
+    // size == 0 maps the existing file as-is (read-only opens)
+    virtual bool open(const std::string& filename, size_t size, bool writable) = 0;
+    virtual void close() = 0;
+    virtual bool flush() = 0;
+    // writes [offset, offset + length) back to the file and waits for it to reach the device
+    virtual bool flush_range(size_t offset, size_t length) = 0;
+
+    // the open file, for sending ranges of it straight to a socket
+    virtual NativeHandle native_handle() const = 0;
+    virtual char* data() const = 0;
+    virtual size_t size() const = 0;
+
+    bool is_open() const { return data() != nullptr; }
+};
+
+std::unique_ptr<SegmentFile> create_segment_file();
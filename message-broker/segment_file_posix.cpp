@@ -0,0 +1,128 @@
+#ifndef _WIN32
+
+#include "segment_file.h"
+
+#include <iostream>
+#include <algorithm>
+#include <cerrno>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+class PosixSegmentFile : public SegmentFile {
+public:
+    ~PosixSegmentFile() override { close(); }
+
+    bool open(const std::string& filename, size_t size, bool writable) override;
+    void close() override;
+    bool flush() override;
+    bool flush_range(size_t offset, size_t length) override;
+
+    NativeHandle native_handle() const override { return fd; }
+    char* data() const override { return static_cast<char*>(mapView); }
+    size_t size() const override { return mapSize; }
+
+private:
+    int fd = -1;
+    void* mapView = nullptr;
+    size_t mapSize = 0;
+
+    bool preallocate(size_t size);
+};
+
+bool PosixSegmentFile::open(const std::string& filename, size_t size, bool writable) {
+    close();
+
+    fd = ::open(filename.c_str(), writable ? (O_RDWR | O_CREAT | O_CLOEXEC) : (O_RDONLY | O_CLOEXEC), 0644);
+    if (fd == -1) {
+        if (writable)
+            std::cerr << "[disk error] open failed: " << filename << ", errno=" << errno << std::endl;
+        return false;
+    }
+
+    if (writable) {
+        if (!preallocate(size)) {
+            std::cerr << "[disk error] Failed to set file size" << std::endl;
+            close();
+            return false;
+        }
+        mapSize = size;
+    }
+    else {
+        struct stat st {};
+        if (fstat(fd, &st) != 0 || st.st_size == 0) {
+            close();
+            return false;
+        }
+        mapSize = static_cast<size_t>(st.st_size);
+    }
+
+    void* view = mmap(nullptr, mapSize, writable ? (PROT_READ | PROT_WRITE) : PROT_READ, MAP_SHARED, fd, 0);
+    if (view == MAP_FAILED) {
+        std::cerr << "[disk error] mmap error: " << errno << std::endl;
+        close();
+        return false;
+    }
+    mapView = view;
+
+    madvise(mapView, mapSize, MADV_SEQUENTIAL);
+    return true;
+}
+
+bool PosixSegmentFile::preallocate(size_t size) {
+    struct stat st {};
+    if (fstat(fd, &st) == 0 && static_cast<size_t>(st.st_size) == size)
+        return true;
+
+#ifdef __linux__
+    if (fallocate(fd, 0, 0, static_cast<off_t>(size)) == 0)
+        return ftruncate(fd, static_cast<off_t>(size)) == 0;
+#endif
+    // fallocate is not supported on every filesystem (tmpfs on old kernels, NFS)
+    return ftruncate(fd, static_cast<off_t>(size)) == 0;
+}
+
+void PosixSegmentFile::close() {
+    if (mapView) {
+        munmap(mapView, mapSize);
+        mapView = nullptr;
+    }
+    if (fd != -1) {
+        ::close(fd);
+        fd = -1;
+    }
+    mapSize = 0;
+}
+
+bool PosixSegmentFile::flush() {
+    if (!mapView)
+        return true;
+
+    if (msync(mapView, mapSize, MS_SYNC) != 0) {
+        std::cerr << "[disk error] msync failed: " << errno << std::endl;
+        return false;
+    }
+    return true;
+}
+
+bool PosixSegmentFile::flush_range(size_t offset, size_t length) {
+    if (!mapView || length == 0 || offset >= mapSize)
+        return true;
+
+    // msync wants a page aligned start
+    static const size_t pageSize = static_cast<size_t>(sysconf(_SC_PAGESIZE));
+    size_t start = offset - offset % pageSize;
+    size_t end = std::min(offset + length, mapSize);
+    if (msync(static_cast<char*>(mapView) + start, end - start, MS_SYNC) != 0) {
+        std::cerr << "[disk error] msync failed: " << errno << std::endl;
+        return false;
+    }
+    return true;
+}
+
+std::unique_ptr<SegmentFile> create_segment_file() {
+    return std::make_unique<PosixSegmentFile>();
+}
+
+#endif
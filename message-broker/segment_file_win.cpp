@@ -0,0 +1,130 @@
+#ifdef _WIN32
+
+#include "segment_file.h"
+
+#include <windows.h>
+#include <iostream>
+#include <algorithm>
+
+class WinSegmentFile : public SegmentFile {
+public:
+    ~WinSegmentFile() override { close(); }
+
+    bool open(const std::string& filename, size_t size, bool writable) override;
+    void close() override;
+    bool flush() override;
+    bool flush_range(size_t offset, size_t length) override;
+
+    NativeHandle native_handle() const override { return hFile; }
+    char* data() const override { return static_cast<char*>(mapView); }
+    size_t size() const override { return mapSize; }
+
+private:
+    HANDLE hFile = INVALID_HANDLE_VALUE;
+    HANDLE hMap = nullptr;
+    void* mapView = nullptr;
+    size_t mapSize = 0;
+    bool writable = false;
+};
+
+bool WinSegmentFile::open(const std::string& filename, size_t size, bool writable) {
+    close();
+    this->writable = writable;
+
+    if (writable) {
+        hFile = CreateFileA(filename.c_str(), GENERIC_WRITE | GENERIC_READ,
+            FILE_SHARE_READ, nullptr, OPEN_ALWAYS, FILE_ATTRIBUTE_NORMAL, nullptr);
+    }
+    else {
+        hFile = CreateFileA(filename.c_str(), GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_WRITE, nullptr,
+            OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+    }
+
+    if (hFile == INVALID_HANDLE_VALUE) {
+        if (writable)
+            std::cerr << "[disk error] INVALID_HANDLE_VALUE: " << filename << std::endl;
+        return false;
+    }
+
+    if (writable) {
+        LARGE_INTEGER li;
+        li.QuadPart = static_cast<LONGLONG>(size);
+        if (!SetFilePointerEx(hFile, li, nullptr, FILE_BEGIN) || !SetEndOfFile(hFile)) {
+            std::cerr << "[disk error] Failed to set file size" << std::endl;
+            close();
+            return false;
+        }
+        mapSize = size;
+    }
+    else {
+        LARGE_INTEGER li;
+        if (!GetFileSizeEx(hFile, &li) || li.QuadPart == 0) {
+            close();
+            return false;
+        }
+        mapSize = static_cast<size_t>(li.QuadPart);
+    }
+
+    hMap = CreateFileMappingA(hFile, nullptr, writable ? PAGE_READWRITE : PAGE_READONLY, 0,
+        writable ? static_cast<DWORD>(mapSize) : 0, nullptr);
+    if (!hMap) {
+        std::cerr << "[disk error] CreateFileMappingA error" << std::endl;
+        close();
+        return false;
+    }
+
+    mapView = MapViewOfFile(hMap, writable ? FILE_MAP_ALL_ACCESS : FILE_MAP_READ, 0, 0, writable ? mapSize : 0);
+    if (!mapView) {
+        std::cerr << "[disk error] MapViewOfFile error" << std::endl;
+        close();
+        return false;
+    }
+
+    return true;
+}
+
+void WinSegmentFile::close() {
+    if (mapView) {
+        UnmapViewOfFile(mapView);
+        mapView = nullptr;
+    }
+    if (hMap) {
+        CloseHandle(hMap);
+        hMap = nullptr;
+    }
+    if (hFile != INVALID_HANDLE_VALUE && hFile != nullptr) {
+        CloseHandle(hFile);
+        hFile = INVALID_HANDLE_VALUE;
+    }
+    mapSize = 0;
+}
+
+bool WinSegmentFile::flush() {
+    if (!mapView)
+        return true;
+
+    return flush_range(0, mapSize);
+}
+
+bool WinSegmentFile::flush_range(size_t offset, size_t length) {
+    if (!mapView || length == 0 || offset >= mapSize)
+        return true;
+
+    length = (std::min)(length, mapSize - offset);
+    if (!FlushViewOfFile(static_cast<char*>(mapView) + offset, length)) {
+        std::cerr << "[disk error] FlushViewOfFile failed: " << GetLastError() << std::endl;
+        return false;
+    }
+    // FlushViewOfFile only hands the pages to the cache manager; this waits for the device
+    if (writable && !FlushFileBuffers(hFile)) {
+        std::cerr << "[disk error] FlushFileBuffers failed: " << GetLastError() << std::endl;
+        return false;
+    }
+    return true;
+}
+
+std::unique_ptr<SegmentFile> create_segment_file() {
+    return std::make_unique<WinSegmentFile>();
+}
+
+#endif
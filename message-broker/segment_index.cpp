@@ -0,0 +1,126 @@
+#include "segment_index.h"
+
+#include <algorithm>
+#include <cstring>
+
+SegmentIndex::SegmentIndex(uint64_t baseOffset, size_t intervalBytes)
+    : baseOffset(baseOffset),
+    intervalBytes(intervalBytes),
+    offsetFile(create_segment_file()),
+    timeFile(create_segment_file()) {
+}
+
+bool SegmentIndex::open(const std::string& basePath, size_t segmentSize, bool writable) {
+    maxEntries = writable && intervalBytes > 0 ? segmentSize / intervalBytes + 1 : 0;
+
+    size_t offsetSize = writable ? maxEntries * sizeof(OffsetIndexEntry) : 0;
+    size_t timeSize = writable ? maxEntries * sizeof(TimeIndexEntry) : 0;
+
+    if (!offsetFile->open(basePath + ".index", offsetSize, writable) ||
+        !timeFile->open(basePath + ".timeindex", timeSize, writable)) {
+        close();
+        return false;
+    }
+
+    maxEntries = std::min(offsetFile->size() / sizeof(OffsetIndexEntry), timeFile->size() / sizeof(TimeIndexEntry));
+    count_entries();
+    return true;
+}
+
+void SegmentIndex::close() {
+    offsetEntries.store(0, std::memory_order_release);
+    timeEntries.store(0, std::memory_order_release);
+    offsetFile->close();
+    timeFile->close();
+}
+
+void SegmentIndex::flush() {
+    offsetFile->flush();
+    timeFile->flush();
+}
+
+void SegmentIndex::reset() {
+    if (offsetFile->is_open())
+        std::memset(offsetFile->data(), 0, offsetFile->size());
+    if (timeFile->is_open())
+        std::memset(timeFile->data(), 0, timeFile->size());
+    offsetEntries.store(0, std::memory_order_release);
+    timeEntries.store(0, std::memory_order_release);
+    bytesSinceEntry = 0;
+}
+
+void SegmentIndex::on_append(uint64_t offset, int64_t timestamp, size_t position, size_t recordSize) {
+    if (!offsetFile->is_open())
+        return;
+
+    size_t offsetCount = offsetEntries.load(std::memory_order_relaxed);
+    if (position > 0 && bytesSinceEntry >= intervalBytes && offsetCount < maxEntries) {
+        uint32_t relative = static_cast<uint32_t>(offset - baseOffset);
+
+        OffsetIndexEntry entry{ relative, static_cast<uint32_t>(position) };
+        std::memcpy(offsetFile->data() + offsetCount * sizeof(entry), &entry, sizeof(entry));
+        offsetEntries.store(offsetCount + 1, std::memory_order_release);
+
+        size_t timeCount = timeEntries.load(std::memory_order_relaxed);
+        if (timeCount == 0 || timestamp > time_entries()[timeCount - 1].timestamp) {
+            TimeIndexEntry timeEntry{ timestamp, relative, static_cast<uint32_t>(position) };
+            std::memcpy(timeFile->data() + timeCount * sizeof(timeEntry), &timeEntry, sizeof(timeEntry));
+            timeEntries.store(timeCount + 1, std::memory_order_release);
+        }
+        bytesSinceEntry = 0;
+    }
+
+    bytesSinceEntry += recordSize;
+}
+
+size_t SegmentIndex::lookup_offset(uint64_t offset) const {
+    size_t count = offsetEntries.load(std::memory_order_acquire);
+    if (count == 0 || offset < baseOffset)
+        return 0;
+
+    uint64_t relative = offset - baseOffset;
+    const OffsetIndexEntry* begin = offset_entries();
+    const OffsetIndexEntry* end = begin + count;
+
+    auto it = std::upper_bound(begin, end, relative,
+        [](uint64_t value, const OffsetIndexEntry& e) { return value < e.relativeOffset; });
+    return it == begin ? 0 : (it - 1)->position;
+}
+
+size_t SegmentIndex::lookup_time(int64_t timestamp) const {
+    size_t count = timeEntries.load(std::memory_order_acquire);
+    if (count == 0)
+        return 0;
+
+    const TimeIndexEntry* begin = time_entries();
+    const TimeIndexEntry* end = begin + count;
+
+    auto it = std::lower_bound(begin, end, timestamp,
+        [](const TimeIndexEntry& e, int64_t value) { return e.timestamp < value; });
+    return it == begin ? 0 : (it - 1)->position;
+}
+
+const OffsetIndexEntry* SegmentIndex::offset_entries() const {
+    return reinterpret_cast<const OffsetIndexEntry*>(offsetFile->data());
+}
+
+const TimeIndexEntry* SegmentIndex::time_entries() const {
+    return reinterpret_cast<const TimeIndexEntry*>(timeFile->data());
+}
+
+void SegmentIndex::count_entries() {
+    const OffsetIndexEntry* entries = offset_entries();
+    size_t offsetCount = 0;
+    while (offsetCount < maxEntries && entries[offsetCount].position != 0 &&
+        (offsetCount == 0 || entries[offsetCount].position > entries[offsetCount - 1].position))
+        offsetCount++;
+
+    const TimeIndexEntry* times = time_entries();
+    size_t timeCount = 0;
+    while (timeCount < maxEntries && times[timeCount].position != 0 &&
+        (timeCount == 0 || times[timeCount].timestamp > times[timeCount - 1].timestamp))
+        timeCount++;
+
+    offsetEntries.store(offsetCount, std::memory_order_release);
+    timeEntries.store(timeCount, std::memory_order_release);
+}
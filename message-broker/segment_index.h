@@ -0,0 +1,62 @@
+#pragma once
+
+#include <string>
+#include <memory>
+#include <cstdint>
+#include <atomic>
+
+#include "segment_file.h"
+
+// <base>.index : u32 relative offset | u32 position, one entry every intervalBytes of log
+struct OffsetIndexEntry {
+    uint32_t relativeOffset;
+    uint32_t position;
+};
+static_assert(sizeof(OffsetIndexEntry) == 8);
+
+// <base>.timeindex : i64 timestamp | u32 relative offset | u32 position
+struct TimeIndexEntry {
+    int64_t timestamp;
+    uint32_t relativeOffset;
+    uint32_t position;
+};
+static_assert(sizeof(TimeIndexEntry) == 16);
+
+// Sparse offset and time index of one commit log segment. Entries are never written for
+// position 0, so a zero entry marks the end of a preallocated index file. One writer appends;
+// entry counts are published after the entry itself, so concurrent lookups only see complete entries.
+class SegmentIndex {
+public:
+    SegmentIndex(uint64_t baseOffset, size_t intervalBytes);
+
+    // segmentSize sizes the files of a writable index; read-only opens map them as they are
+    bool open(const std::string& basePath, size_t segmentSize, bool writable);
+    void close();
+    void flush();
+    void reset();
+
+    void on_append(uint64_t offset, int64_t timestamp, size_t position, size_t recordSize);
+
+    // position of the last indexed record at or before offset
+    size_t lookup_offset(uint64_t offset) const;
+    // position of the last indexed record older than timestamp
+    size_t lookup_time(int64_t timestamp) const;
+
+    size_t entry_count() const { return offsetEntries.load(std::memory_order_acquire); }
+    size_t mapped_bytes() const { return offsetFile->size() + timeFile->size(); }
+
+private:
+    uint64_t baseOffset;
+    size_t intervalBytes;
+    size_t maxEntries = 0;
+    std::atomic<size_t> offsetEntries{ 0 };
+    std::atomic<size_t> timeEntries{ 0 };
+    size_t bytesSinceEntry = 0;
+
+    std::unique_ptr<SegmentFile> offsetFile;
+    std::unique_ptr<SegmentFile> timeFile;
+
+    const OffsetIndexEntry* offset_entries() const;
+    const TimeIndexEntry* time_entries() const;
+    void count_entries();
+};
@@ -0,0 +1,118 @@
+#include "shard_runtime.h"
+#include "net_engine.h"
+#include "command_handler.h"
+#include "async_logger.h"
+
+#include <algorithm>
+#include <thread>
+
+namespace {
+    thread_local size_t currentShard = ShardRuntime::noShard;
+}
+
+ShardRuntime& ShardRuntime::get_instance() {
+    static ShardRuntime instance;
+    return instance;
+}
+
+void ShardRuntime::assign(std::vector<NetEngine*> shardEngines) {
+    engines = std::move(shardEngines);
+    inboxes.clear();
+    for (size_t i = 0; i < engines.size(); ++i) {
+        auto inbox = std::make_unique<Inbox>();
+        for (size_t j = 0; j < engines.size(); ++j)
+            inbox->from.push_back(j == i ? nullptr : std::make_unique<SpscQueue<ShardTask>>(queueCapacity));
+        inbox->pending.resize(engines.size());
+        inboxes.push_back(std::move(inbox));
+    }
+}
+
+void ShardRuntime::enter(size_t shard) {
+    currentShard = shard;
+    if (engines.size() <= 1)
+        return;
+
+    size_t cores = std::max<size_t>(std::thread::hardware_concurrency(), 1);
+    if (!pin_current_thread(shard % cores))
+        log_warn("shard {}: could not pin thread to core {}", shard, shard % cores);
+}
+
+size_t ShardRuntime::current() {
+    return currentShard;
+}
+
+// consecutive partitions of a topic go to consecutive shards, so a hot topic spreads over all of them
+size_t ShardRuntime::owner(std::string_view topic, uint32_t partition) const {
+    if (engines.size() <= 1)
+        return 0;
+    return (TopicHash{}(topic) + partition) % engines.size();
+}
+
+void ShardRuntime::send(size_t target, ShardTask task) {
+    Inbox& self = *inboxes[currentShard];
+    std::deque<ShardTask>& pending = self.pending[target];
+    if (pending.empty() && post(target, task))
+        return;
+
+    pending.push_back(std::move(task));
+    if (!self.signaled.exchange(true, std::memory_order_acq_rel))
+        engines[currentShard]->signal();
+}
+
+// false when the queue is full, then task is left untouched
+bool ShardRuntime::post(size_t target, ShardTask& task) {
+    if (!inboxes[target]->from[currentShard]->try_push(task))
+        return false;
+
+    // one wakeup per drain, however many tasks arrive before it
+    if (!inboxes[target]->signaled.exchange(true, std::memory_order_acq_rel))
+        engines[target]->signal();
+    return true;
+}
+
+void ShardRuntime::drain(size_t shard) {
+    if (shard >= inboxes.size())
+        return;
+    Inbox& inbox = *inboxes[shard];
+    // cleared first so a task posted during the drain signals again
+    inbox.signaled.store(false, std::memory_order_release);
+
+    flush(shard);
+    ShardTask task;
+    for (auto& queue : inbox.from) {
+        while (queue && queue->try_pop(task))
+            run(task);
+    }
+
+    // results sent while running may be waiting too; come back until everything went out
+    if (!flush(shard) && !inbox.signaled.exchange(true, std::memory_order_acq_rel))
+        engines[shard]->signal();
+}
+
+bool ShardRuntime::flush(size_t shard) {
+    bool flushed = true;
+    for (size_t target = 0; target < engines.size(); ++target) {
+        std::deque<ShardTask>& pending = inboxes[shard]->pending[target];
+        while (!pending.empty() && post(target, pending.front()))
+            pending.pop_front();
+        flushed &= pending.empty();
+    }
+    return flushed;
+}
+
+void ShardRuntime::run(ShardTask& task) {
+    if (task.kind == ShardTask::Kind::Appended) {
+        auto& waiter = static_cast<ConnectionWaiter&>(*task.waiter);
+        if (waiter.context)
+            CommandHandler::forward_completed(waiter.context, task.correlationId, task.batch.partition, task.appended);
+        return;
+    }
+
+    task.appended = TopicManager::get_instance().append(*task.topic, task.batch);
+    task.kind = ShardTask::Kind::Appended;
+    task.batch.messages.clear();
+    task.batch.keys.clear();
+    task.batch.compressed = SharedMessage();
+
+    send(task.source, std::move(task));
+}
@@ -0,0 +1,88 @@
+#pragma once
+
+#include <atomic>
+#include <deque>
+#include <memory>
+#include <optional>
+#include <string_view>
+#include <vector>
+#include <cstddef>
+#include <cstdint>
+
+#include "spsc_queue.h"
+#include "topic_manager.h"
+#include "waiter.h"
+
+class NetEngine;
+
+// Records handed to the shard that owns their partition (Append), and the append result handed
+// back to the shard of the producing connection (Appended).
+struct ShardTask {
+    enum class Kind : uint8_t { Append, Appended };
+
+    Kind kind = Kind::Append;
+    // shard of the producing connection
+    size_t source = 0;
+    Topic* topic = nullptr;
+    PartitionBatch batch;
+    AppendOutcome appended;
+    // the producing connection; its context is gone once the connection closed
+    std::shared_ptr<Waiter> waiter;
+    uint32_t correlationId = 0;
+};
+
+// Shard-per-core runtime. Every shard runs its own NetEngine on its own thread, pinned to one
+// core when there is more than one shard, and serves the connections it accepted. Each partition
+// is owned by one shard, which does the appends of every binary connection: a connection on
+// another shard hands the records over an SPSC queue and gets the result back the same way.
+// Text clients, which are answered in order, and threads outside the shards (broker.cpp's test
+// publisher) still append from their own thread; the log and queue take concurrent writers.
+// Ownership is therefore not single-writer: it keeps binary appends on one core, but a text
+// PUBLISH to the same partition interleaves with them in whatever order the two arrive.
+// Reads stay shared, they take no lock.
+class ShardRuntime {
+public:
+    static constexpr size_t noShard = SIZE_MAX;
+    static constexpr size_t queueCapacity = 4096;
+
+    static ShardRuntime& get_instance();
+
+    // engines[i] becomes shard i; called once before any engine runs
+    void assign(std::vector<NetEngine*> shardEngines);
+    size_t count() const { return engines.size(); }
+    NetEngine& engine(size_t shard) const { return *engines[shard]; }
+
+    // binds the calling thread to a shard; engine threads call it before their loop
+    void enter(size_t shard);
+    // shard of the calling thread, noShard outside the engine threads
+    static size_t current();
+    size_t owner(std::string_view topic, uint32_t partition) const;
+
+    // from the current shard. Tasks reach target in the order they were sent: while its queue is
+    // full they wait in order on this shard and go out on its next drains, so one connection's
+    // records for a partition are appended in the order they arrived.
+    void send(size_t target, ShardTask task);
+    // sends what waits on shard, then runs what other shards sent to it; its engine thread only
+    void drain(size_t shard);
+
+private:
+    struct Inbox {
+        // one queue per sending shard, so every queue has a single producer and a single consumer
+        std::vector<std::unique_ptr<SpscQueue<ShardTask>>> from;
+        std::atomic<bool> signaled{ false };
+        // tasks of this shard for each target whose queue was full, oldest first
+        std::vector<std::deque<ShardTask>> pending;
+    };
+
+    std::vector<NetEngine*> engines;
+    std::vector<std::unique_ptr<Inbox>> inboxes;
+
+    ShardRuntime() = default;
+    ShardRuntime(const ShardRuntime&) = delete;
+    ShardRuntime& operator=(const ShardRuntime&) = delete;
+
+    bool post(size_t target, ShardTask& task);
+    // false when tasks still wait for a full queue
+    bool flush(size_t shard);
+    void run(ShardTask& task);
+};
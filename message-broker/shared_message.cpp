@@ -0,0 +1,78 @@
+#include "shared_message.h"
+#include "buffer_pool.h"
+
+#include <cstring>
+#include <new>
+#include <utility>
+
+size_t SharedMessage::block_bytes(size_t size) {
+    return sizeof(Block) + prefixSize + size;
+}
+
+SharedMessage SharedMessage::create(std::string_view body) {
+    void* memory = BufferPool::get_instance().allocate(block_bytes(body.size()));
+    Block* block = new (memory) Block{ {1}, static_cast<uint32_t>(body.size()) };
+
+    auto* prefix = reinterpret_cast<unsigned char*>(block + 1);
+    uint32_t length = static_cast<uint32_t>(body.size());
+    prefix[0] = static_cast<unsigned char>(length >> 24);
+    prefix[1] = static_cast<unsigned char>(length >> 16);
+    prefix[2] = static_cast<unsigned char>(length >> 8);
+    prefix[3] = static_cast<unsigned char>(length);
+    std::memcpy(prefix + prefixSize, body.data(), body.size());
+    return SharedMessage(block);
+}
+
+SharedMessage::SharedMessage(const SharedMessage& other) noexcept : block(other.block) {
+    if (block)
+        block->refs.fetch_add(1, std::memory_order_relaxed);
+}
+
+SharedMessage::SharedMessage(SharedMessage&& other) noexcept : block(std::exchange(other.block, nullptr)) {}
+
+SharedMessage& SharedMessage::operator=(const SharedMessage& other) noexcept {
+    if (block != other.block) {
+        if (other.block)
+            other.block->refs.fetch_add(1, std::memory_order_relaxed);
+        release();
+        block = other.block;
+    }
+    return *this;
+}
+
+SharedMessage& SharedMessage::operator=(SharedMessage&& other) noexcept {
+    if (this != &other) {
+        release();
+        block = std::exchange(other.block, nullptr);
+    }
+    return *this;
+}
+
+SharedMessage::~SharedMessage() {
+    release();
+}
+
+void SharedMessage::release() {
+    if (block && block->refs.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+        size_t size = block->size;
+        block->~Block();
+        BufferPool::get_instance().deallocate(block, block_bytes(size));
+    }
+    block = nullptr;
+}
+
+std::string_view SharedMessage::body() const {
+    if (!block)
+        return {};
+    return std::string_view(bytes() + prefixSize, block->size);
+}
+
+std::string_view SharedMessage::record() const {
+    if (!block)
+        return {};
+    return std::string_view(bytes(), prefixSize + block->size);
+}
+
+size_t SharedMessage::size() const {
+    return block ? block->size : 0;
+}
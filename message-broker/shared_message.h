@@ -0,0 +1,43 @@
+#pragma once
+
+#include <atomic>
+#include <string_view>
+#include <cstddef>
+#include <cstdint>
+
+// Immutable message body, allocated once from the BufferPool when the message arrives and shared
+// by reference count: the topic queue and every response that carries the message hold the same
+// bytes until the last reference drops. The body is stored behind its record length prefix
+// (u32 big-endian, as protocol::append_record writes it), so a response sends it as it is.
+class SharedMessage {
+public:
+    SharedMessage() = default;
+    static SharedMessage create(std::string_view body);
+
+    SharedMessage(const SharedMessage& other) noexcept;
+    SharedMessage(SharedMessage&& other) noexcept;
+    SharedMessage& operator=(const SharedMessage& other) noexcept;
+    SharedMessage& operator=(SharedMessage&& other) noexcept;
+    ~SharedMessage();
+
+    explicit operator bool() const { return block != nullptr; }
+
+    std::string_view body() const;
+    // length prefix and body
+    std::string_view record() const;
+    size_t size() const;
+
+private:
+    struct Block {
+        std::atomic<uint32_t> refs;
+        uint32_t size;
+    };
+    static constexpr size_t prefixSize = 4;
+
+    Block* block = nullptr;
+
+    explicit SharedMessage(Block* block) : block(block) {}
+    static size_t block_bytes(size_t size);
+    void release();
+    const char* bytes() const { return reinterpret_cast<const char*>(block + 1); }
+};
@@ -0,0 +1,59 @@
+#pragma once
+
+#include <atomic>
+#include <bit>
+#include <memory>
+#include <utility>
+#include <cstddef>
+
+#include "message_ring.h"
+
+// Bounded single-producer single-consumer queue. Only the producer writes tail and only the
+// consumer writes head, each on its own cache line, and each side caches the other's index so
+// it reads the shared one only when the queue looks full or empty. No CAS, no lock.
+template <typename T>
+class SpscQueue {
+public:
+    // rounded up to a power of two
+    explicit SpscQueue(size_t capacity)
+        : mask(std::bit_ceil(capacity < 2 ? size_t(2) : capacity) - 1), slots(std::make_unique<T[]>(mask + 1)) {}
+
+    SpscQueue(const SpscQueue&) = delete;
+    SpscQueue& operator=(const SpscQueue&) = delete;
+
+    // producer only; false when full, value is moved from only on success
+    bool try_push(T& value) {
+        size_t pos = tail.load(std::memory_order_relaxed);
+        if (pos - cachedHead > mask) {
+            cachedHead = head.load(std::memory_order_acquire);
+            if (pos - cachedHead > mask)
+                return false;
+        }
+        slots[pos & mask] = std::move(value);
+        tail.store(pos + 1, std::memory_order_release);
+        return true;
+    }
+
+    // consumer only
+    bool try_pop(T& value) {
+        size_t pos = head.load(std::memory_order_relaxed);
+        if (pos == cachedTail) {
+            cachedTail = tail.load(std::memory_order_acquire);
+            if (pos == cachedTail)
+                return false;
+        }
+        value = std::move(slots[pos & mask]);
+        // drop what the slot still references before the producer can reuse it
+        slots[pos & mask] = T();
+        head.store(pos + 1, std::memory_order_release);
+        return true;
+    }
+
+private:
+    size_t mask;
+    std::unique_ptr<T[]> slots;
+    alignas(cacheLineSize) std::atomic<size_t> head{ 0 };
+    size_t cachedTail = 0;
+    alignas(cacheLineSize) std::atomic<size_t> tail{ 0 };
+    size_t cachedHead = 0;
+};
@@ -1,62 +1,568 @@
 #include "topic_manager.h"
+#include "async_logger.h"
 
 #include <sstream>
 #include <iostream>
+#include <format>
+#include <chrono>
+#include <cctype>
+#include <algorithm>
+#include <filesystem>
+#include <cstdint>
+#include <charconv>
+#include <fstream>
 
+namespace {
+    // murmur2 as Kafka's default partitioner uses it, so a key lands in the partition a Kafka
+    // producer would pick; the result is the same on every platform and build
+    uint32_t murmur2(std::string_view key) {
+        constexpr uint32_t m = 0x5bd1e995;
+        const auto* data = reinterpret_cast<const unsigned char*>(key.data());
+        size_t length = key.size();
+        uint32_t h = 0x9747b28c ^ static_cast<uint32_t>(length);
 
-void TopicQueue::publish(const std::string& msg) {
-    std::lock_guard<std::mutex> lock(mtx);
-    q.push(msg);
-}
+        for (size_t i = 0; i + 4 <= length; i += 4) {
+            uint32_t k = data[i] | (data[i + 1] << 8) | (data[i + 2] << 16) | (uint32_t(data[i + 3]) << 24);
+            k *= m;
+            k ^= k >> 24;
+            k *= m;
+            h *= m;
+            h ^= k;
+        }
 
-std::optional<std::string> TopicQueue::pull() {
-    std::lock_guard<std::mutex> lock(mtx);
-    if (q.empty()) return std::nullopt;
-    std::string m = q.front(); q.pop();
-    return m;
-}
+        size_t tail = length & ~size_t(3);
+        switch (length % 4) {
+        case 3: h ^= data[tail + 2] << 16; [[fallthrough]];
+        case 2: h ^= data[tail + 1] << 8; [[fallthrough]];
+        case 1: h ^= data[tail]; h *= m;
+        }
 
+        h ^= h >> 13;
+        h *= m;
+        h ^= h >> 15;
+        return h;
+    }
+}
 
 TopicManager::TopicManager() = default;
-TopicManager::~TopicManager() = default;
+
+TopicManager::~TopicManager() {
+    {
+        std::scoped_lock lock(commit_mutex);
+        stop_commit = true;
+    }
+    commit_cv.notify_all();
+    {
+        std::scoped_lock lock(cleaner_mutex);
+        stop_cleaner = true;
+    }
+    cleaner_cv.notify_all();
+}
 
 TopicManager& TopicManager::get_instance() {
     static TopicManager instance;
     return instance;
 }
 
-void TopicManager::init_logger(std::shared_ptr<DiskHandler> diskHandler) {
-    std::scoped_lock lock(disk_mutex);
-    disk_handler = std::move(diskHandler);
+void TopicManager::init_storage(std::string dataDir, size_t segmentSize, DurabilityPolicy durability, uint32_t defaultPartitions,
+    Codec codec, RetentionPolicy retention, uint64_t compactionRate) {
+    {
+        std::scoped_lock lock(mtx);
+        data_dir = std::move(dataDir);
+        log_segment_size = segmentSize;
+        durability_policy = durability;
+        default_partitions = std::max<uint32_t>(defaultPartitions, 1);
+        log_codec = codec;
+        retention_policy = retention;
+        compaction_rate = compactionRate;
+    }
+    recover_topics();
+    commit_thread = std::jthread([this] { commit_loop(); });
+    cleaner_thread = std::jthread([this] { cleaner_loop(); });
+}
+
+bool TopicManager::create(std::string_view topic, uint32_t partitions, CleanupPolicy cleanup) {
+    Topic& t = get_or_create(topic, partitions, cleanup);
+    return t.partition_count() == partitions && t.cleanup == cleanup;
+}
+
+uint32_t TopicManager::partition_count(std::string_view topic) {
+    return get_or_create(topic).partition_count();
+}
+
+std::vector<PartitionBatch> TopicManager::partition_records(Topic& t, const std::vector<std::string_view>& values,
+    const std::vector<std::string_view>& keys) {
+    std::vector<PartitionBatch> batches;
+    if (keys.empty()) {
+        PartitionBatch& batch = batches.emplace_back();
+        batch.partition = route(t, {});
+        batch.messages.reserve(values.size());
+        for (std::string_view value : values)
+            batch.messages.push_back(SharedMessage::create(value));
+        return batches;
+    }
+
+    // records of one key keep their order within the partition's batch
+    std::vector<size_t> slot(t.partition_count(), SIZE_MAX);
+    for (size_t i = 0; i < values.size(); ++i) {
+        uint32_t partition = route(t, keys[i]);
+        if (slot[partition] == SIZE_MAX) {
+            slot[partition] = batches.size();
+            batches.emplace_back().partition = partition;
+        }
+        PartitionBatch& batch = batches[slot[partition]];
+        batch.messages.push_back(SharedMessage::create(values[i]));
+        batch.keys.push_back(SharedMessage::create(keys[i]));
+    }
+    return batches;
+}
+
+// the log appends from the shared buffers and the queue keeps references to them; records the
+// log did not take are not queued either, so a consumer never sees what a producer was told failed
+AppendOutcome TopicManager::append(Topic& t, PartitionBatch& batch) {
+    Partition& p = *t.partitions[batch.partition];
+    AppendOutcome outcome;
+    if (!p.log) {
+        // the queue is all a memory-only partition has, dropping from it would lose records
+        if (!p.queue.try_publish_batch(batch.messages))
+            outcome.status = AppendStatus::QueueFull;
+        return outcome;
+    }
+
+    std::optional<AppendResult> offsets;
+    if (batch.compressed) {
+        offsets = p.log->append_compressed(batch.codec, batch.compressed.body());
+    }
+    else {
+        std::vector<std::string_view> bodies;
+        std::vector<std::string_view> keys;
+        bodies.reserve(batch.messages.size());
+        keys.reserve(batch.keys.size());
+        for (const SharedMessage& message : batch.messages)
+            bodies.push_back(message.body());
+        for (const SharedMessage& key : batch.keys)
+            keys.push_back(key.body());
+
+        offsets = p.log->append_batch(bodies, keys);
+    }
+    if (!offsets) {
+        outcome.status = AppendStatus::StorageError;
+        return outcome;
+    }
+    outcome.offsets = *offsets;
+    appended(*p.log);
+    p.queue.publish_batch(batch.messages);
+    return outcome;
+}
+
+std::optional<PartitionAppend> TopicManager::publish(std::string_view topic, std::string_view msg) {
+    Topic& t = get_or_create(topic);
+    std::vector<PartitionBatch> batches = partition_records(t, { msg });
+    AppendOutcome outcome = append(t, batches.front());
+    if (outcome.status != AppendStatus::Ok)
+        return std::nullopt;
+    return PartitionAppend{ batches.front().partition, outcome.offsets };
+}
+
+std::optional<SharedMessage> TopicManager::pull(Topic& t) {
+    std::optional<SharedMessage> msg;
+    pull_batch(t, Topic::anyPartition, 1, SIZE_MAX, 0, [&](SharedMessage&& m) { msg = std::move(m); });
+    return msg;
+}
+
+size_t TopicManager::pull_batch(std::string_view topic, uint32_t partition, size_t maxRecords, size_t maxBytes, size_t minBytes,
+    const TopicQueue::MessageSink& sink) {
+    Topic* t = topics.find(topic);
+    return t ? pull_batch(*t, partition, maxRecords, maxBytes, minBytes, sink) : 0;
+}
+
+size_t TopicManager::pull_batch(Topic& t, uint32_t partition, size_t maxRecords, size_t maxBytes, size_t minBytes,
+    const TopicQueue::MessageSink& sink) {
+    if (partition != Topic::anyPartition) {
+        Partition* p = t.partition(partition);
+        return p ? p->queue.pull_batch(maxRecords, maxBytes, minBytes, sink) : 0;
+    }
+
+    // min_bytes applies per partition, records are never reordered within one
+    size_t records = 0;
+    size_t bytes = 0;
+    uint32_t count = t.partition_count();
+    uint32_t start = t.nextFetch.fetch_add(1, std::memory_order_relaxed);
+    for (uint32_t i = 0; i < count && records < maxRecords && bytes < maxBytes; ++i) {
+        Partition& p = *t.partitions[(start + i) % count];
+        records += p.queue.pull_batch(maxRecords - records, maxBytes - bytes, minBytes, [&](SharedMessage&& msg) {
+            bytes += msg.size();
+            sink(std::move(msg));
+        });
+    }
+    return records;
 }
 
-void TopicManager::publish(const std::string& topic, const std::string& msg) {
+bool TopicManager::has_topic(std::string_view topic) const {
+    return topics.find(topic) != nullptr;
+}
+
+bool TopicManager::has_storage() const {
     std::scoped_lock lock(mtx);
-    topic_map[topic].publish(msg);
-    disk_handler->log("info", "Published to " + topic + ": " + msg);
+    return !data_dir.empty();
+}
+
+std::vector<LogRecord> TopicManager::read(std::string_view topic, uint32_t partition, uint64_t offset, size_t maxRecords, size_t maxBytes) const {
+    Topic* t = topics.find(topic);
+    Partition* p = t ? t->partition(partition) : nullptr;
+    if (!p || !p->log)
+        return {};
+    return p->log->read(offset, maxRecords, maxBytes);
 }
 
-std::optional<std::string> TopicManager::pull(const std::string& topic) {
+std::optional<uint64_t> TopicManager::offset_for_time(std::string_view topic, uint32_t partition, int64_t timestamp) const {
+    Topic* t = topics.find(topic);
+    Partition* p = t ? t->partition(partition) : nullptr;
+    if (!p || !p->log)
+        return std::nullopt;
+    // read the next offset first: a record appended in between is then found by the lookup
+    uint64_t next = p->log->next_offset();
+    return p->log->offset_for_time(timestamp).value_or(next);
+}
+
+void TopicManager::watch(std::string_view topic, const std::shared_ptr<Waiter>& waiter, uint32_t partition) {
+    auto watch_topic = [&](Topic& t) {
+        if (Partition* p = t.partition(partition)) {
+            p->queue.watch(waiter);
+            return;
+        }
+        for (auto& p : t.partitions)
+            p->queue.watch(waiter);
+    };
+
+    if (Topic* t = topics.find(topic)) {
+        watch_topic(*t);
+        return;
+    }
+
+    // checked again under the creation lock so a topic created in between still wakes the waiter
     std::scoped_lock lock(mtx);
-    auto it = topic_map.find(topic);
-    if (it != topic_map.end()) {
-        disk_handler->log("info", "Pulled from topic: " + topic);
-        return it->second.pull();
+    if (Topic* t = topics.find(topic)) {
+        watch_topic(*t);
+        return;
     }
-    return std::nullopt;
+
+    auto& pending = pending_watchers[std::string(topic)];
+    std::erase_if(pending, [](const std::weak_ptr<Waiter>& w) { return w.expired(); });
+    pending.push_back(waiter);
 }
 
-bool TopicManager::has_topic(const std::string& topic) const {
+void TopicManager::set_queue_capacity(size_t capacity) {
     std::scoped_lock lock(mtx);
-    return topic_map.contains(topic);
+    queue_capacity = capacity;
+}
+
+void TopicManager::log_queue_stats() {
+    topics.for_each([&](const std::string& name, Topic& t) {
+        for (uint32_t i = 0; i < t.partition_count(); ++i) {
+            Partition& p = *t.partitions[i];
+            uint64_t dropped = p.queue.dropped();
+            if (dropped == p.reportedDrops)
+                continue;
+            log_warn("queue {} partition {}: dropped {} oldest messages (capacity {}), the commit log still has them",
+                name, i, dropped - p.reportedDrops, p.queue.capacity());
+            p.reportedDrops = dropped;
+        }
+    });
 }
 
 void TopicManager::get_topic_list() const {
-    std::scoped_lock lock(mtx);
     std::ostringstream oss;
     oss << "[info] Current topics: ";
-    for (const auto& [name, _] : topic_map) {
+    topics.for_each([&](const std::string& name, Topic&) {
         oss << "'" << name << "' ";
-    }
+    });
     std::cout << oss.str() << std::endl;
 }
+
+
+Topic& TopicManager::get_or_create(std::string_view topic, uint32_t partitions, CleanupPolicy cleanup) {
+    if (Topic* t = topics.find(topic))
+        return *t;
+
+    Topic* created = nullptr;
+    {
+        std::scoped_lock lock(mtx);
+        if (Topic* t = topics.find(topic))
+            return *t;
+
+        // a topic that already has logs keeps the partitions and policy it was created with
+        uint32_t stored = stored_partitions(topic);
+        uint32_t count = stored ? stored : partitions ? partitions : default_partitions;
+        created = &topics.insert(topic, [&](Topic& t) {
+            t.cleanup = stored ? stored_cleanup(topic) : cleanup;
+            for (uint32_t i = 0; i < count; ++i) {
+                auto& p = t.partitions.emplace_back(std::make_unique<Partition>(queue_capacity));
+                if (!data_dir.empty())
+                    p->log = std::make_unique<CommitLog>(partition_directory(topic, i), log_segment_size, log_codec);
+            }
+        });
+        if (!stored && !data_dir.empty() && cleanup != CleanupPolicy::Delete)
+            store_cleanup(topic, cleanup);
+
+        auto pending = pending_watchers.find(topic);
+        if (pending != pending_watchers.end()) {
+            for (const auto& w : pending->second) {
+                if (auto waiter = w.lock()) {
+                    for (auto& p : created->partitions)
+                        p->queue.watch(waiter);
+                }
+            }
+            pending_watchers.erase(pending);
+        }
+    }
+
+    log_info("Created topic: {} with {} partitions, cleanup {}", topic, created->partition_count(), cleanup_policy_name(created->cleanup));
+    return *created;
+}
+
+// Opens every topic found under the data directory before the broker serves, so the first
+// FETCH_LOG, group fetch or produce already sees the recovered offsets. Every partition log
+// validates its tail segment on open, and the partitions are opened on parallel threads.
+void TopicManager::recover_topics() {
+    auto started = std::chrono::steady_clock::now();
+    std::vector<std::string> names;
+    std::error_code ec;
+    for (const auto& entry : std::filesystem::directory_iterator(data_dir, ec)) {
+        // '@' is always escaped in topic names, so a directory with one is a partition above 0 or group state
+        std::string dir = entry.path().filename().string();
+        if (!entry.is_directory(ec) || dir.find('@') != std::string::npos)
+            continue;
+        if (std::optional<std::string> name = unescape_name(dir))
+            names.push_back(std::move(*name));
+    }
+    if (names.empty())
+        return;
+
+    struct Job {
+        size_t topic;
+        uint32_t partition;
+        std::unique_ptr<CommitLog> log;
+    };
+    std::vector<uint32_t> counts;
+    std::vector<CleanupPolicy> policies;
+    std::vector<Job> jobs;
+    for (size_t i = 0; i < names.size(); ++i) {
+        policies.push_back(stored_cleanup(names[i]));
+        counts.push_back(stored_partitions(names[i]));
+        for (uint32_t p = 0; p < counts.back(); ++p)
+            jobs.push_back({ i, p, nullptr });
+    }
+
+    {
+        std::atomic<size_t> next{ 0 };
+        size_t workers = std::min<size_t>(jobs.size(), std::max(std::thread::hardware_concurrency(), 1u));
+        std::vector<std::jthread> threads;
+        for (size_t w = 0; w < workers; ++w) {
+            threads.emplace_back([&] {
+                for (size_t j; (j = next.fetch_add(1, std::memory_order_relaxed)) < jobs.size();) {
+                    Job& job = jobs[j];
+                    job.log = std::make_unique<CommitLog>(partition_directory(names[job.topic], job.partition), log_segment_size, log_codec);
+                }
+            });
+        }
+    }
+
+    std::scoped_lock lock(mtx);
+    size_t j = 0;
+    for (size_t i = 0; i < names.size(); ++i) {
+        topics.insert(names[i], [&](Topic& t) {
+            t.cleanup = policies[i];
+            for (uint32_t p = 0; p < counts[i]; ++p)
+                t.partitions.emplace_back(std::make_unique<Partition>(queue_capacity))->log = std::move(jobs[j++].log);
+        });
+    }
+
+    auto elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - started);
+    log_info("Recovered {} topics with {} partitions in {} ms", names.size(), jobs.size(), elapsed.count());
+}
+
+// partition directories found on disk; they are created together, so the first gap ends the topic
+uint32_t TopicManager::stored_partitions(std::string_view topic) const {
+    if (data_dir.empty())
+        return 0;
+
+    uint32_t count = 0;
+    std::error_code ec;
+    while (std::filesystem::is_directory(partition_directory(topic, count), ec))
+        ++count;
+    return count;
+}
+
+CleanupPolicy TopicManager::stored_cleanup(std::string_view topic) const {
+    std::ifstream file(partition_directory(topic, 0) + "/cleanup.policy");
+    std::string name;
+    if (!file || !std::getline(file, name))
+        return CleanupPolicy::Delete;
+
+    std::optional<CleanupPolicy> policy = parse_cleanup_policy(name);
+    if (!policy) {
+        log_warn("Unknown cleanup policy '{}' of topic {}, using delete", name, topic);
+        return CleanupPolicy::Delete;
+    }
+    return *policy;
+}
+
+void TopicManager::store_cleanup(std::string_view topic, CleanupPolicy cleanup) const {
+    std::ofstream file(partition_directory(topic, 0) + "/cleanup.policy", std::ios::trunc);
+    file << cleanup_policy_name(cleanup) << '\n';
+    if (!file)
+        std::cerr << "[disk error] cleanup policy write failed: " << topic << std::endl;
+}
+
+// a key keeps its partition as long as the partition count does, which is fixed at creation
+uint32_t TopicManager::route(Topic& t, std::string_view key) const {
+    uint32_t count = t.partition_count();
+    if (count == 1)
+        return 0;
+    if (key.empty())
+        return t.nextProduce.fetch_add(1, std::memory_order_relaxed) % count;
+    return (murmur2(key) & 0x7fffffff) % count;
+}
+
+std::string escape_name(std::string_view name) {
+    std::string escaped;
+    for (unsigned char c : name) {
+        if (std::isalnum(c) || c == '.' || c == '_' || c == '-')
+            escaped += static_cast<char>(c);
+        else
+            escaped += std::format("%{:02x}", static_cast<unsigned>(c));
+    }
+    if (escaped == "." || escaped == "..")
+        escaped = "%2e" + escaped.substr(1);
+    return escaped;
+}
+
+std::optional<std::string> unescape_name(std::string_view escaped) {
+    std::string name;
+    for (size_t i = 0; i < escaped.size(); ++i) {
+        if (escaped[i] != '%') {
+            name += escaped[i];
+            continue;
+        }
+        unsigned value = 0;
+        if (i + 2 >= escaped.size() ||
+            std::from_chars(escaped.data() + i + 1, escaped.data() + i + 3, value, 16).ptr != escaped.data() + i + 3)
+            return std::nullopt;
+        name += static_cast<char>(value);
+        i += 2;
+    }
+    // only the canonical spelling maps back to the same directory
+    if (name.empty() || escape_name(name) != escaped)
+        return std::nullopt;
+    return name;
+}
+
+// partition 0 uses the topic directory itself, so logs written before topics had partitions stay
+// readable; '@' is always escaped in topic names, so "<topic>@<n>" never collides with a topic
+std::string TopicManager::partition_directory(std::string_view topic, uint32_t partition) const {
+    std::string dir = data_dir + "/" + escape_name(topic);
+    if (partition > 0)
+        dir += std::format("@{}", partition);
+    return dir;
+}
+
+// wakes the group-commit thread when the policy wants this append on disk now
+void TopicManager::appended(CommitLog& log) {
+    const DurabilityPolicy& policy = durability_policy;
+    bool due = policy.mode == DurabilityPolicy::Mode::Always ||
+        (policy.mode == DurabilityPolicy::Mode::Bytes && log.unsynced_bytes() >= policy.bytes);
+    if (!due || commit_requested.exchange(true, std::memory_order_acq_rel))
+        return;
+
+    { std::scoped_lock lock(commit_mutex); }
+    commit_cv.notify_one();
+}
+
+// One thread syncs every log that needs it, so all appends that arrived since the last pass
+// share one flush per log. Producers waiting for durability are woken by the logs themselves.
+void TopicManager::commit_loop() {
+    const DurabilityPolicy policy = durability_policy;
+    auto wait = policy.mode == DurabilityPolicy::Mode::None ? std::chrono::milliseconds(1000) : policy.interval;
+    auto last_pass = std::chrono::steady_clock::now();
+
+    while (!stop_commit) {
+        {
+            std::unique_lock lock(commit_mutex);
+            commit_cv.wait_until(lock, last_pass + wait, [this] {
+                return stop_commit.load() || commit_requested.load(std::memory_order_acquire);
+            });
+        }
+        commit_requested.store(false, std::memory_order_release);
+
+        auto now = std::chrono::steady_clock::now();
+        bool interval_due = now >= last_pass + wait;
+        if (interval_due)
+            last_pass = now;
+        if (stop_commit || policy.mode == DurabilityPolicy::Mode::None)
+            continue;
+
+        // topics are never removed, so the logs outlive this loop
+        topics.for_each([&](const std::string&, Topic& t) {
+            for (auto& p : t.partitions) {
+                if (!p->log || p->log->unsynced_bytes() == 0)
+                    continue;
+                if (interval_due || policy.mode == DurabilityPolicy::Mode::Always ||
+                    (policy.mode == DurabilityPolicy::Mode::Bytes && p->log->unsynced_bytes() >= policy.bytes))
+                    p->log->sync();
+            }
+        });
+    }
+}
+
+// Deletes expired segments and compacts keyed topics in the background.
+void TopicManager::cleaner_loop() {
+    constexpr auto interval = std::chrono::seconds(5);
+
+    while (!stop_cleaner) {
+        {
+            std::unique_lock lock(cleaner_mutex);
+            cleaner_cv.wait_for(lock, interval, [this] { return stop_cleaner.load(); });
+        }
+        if (stop_cleaner)
+            break;
+        clean_logs();
+    }
+}
+
+// Compaction reads and writes at most compaction_rate bytes per second over a pass, so it never
+// takes the disk from producers.
+void TopicManager::clean_logs() {
+    std::scoped_lock pass(cleaner_pass_mutex);
+    const RetentionPolicy retention = retention_policy;
+    const uint64_t rate = compaction_rate;
+
+    auto started = std::chrono::steady_clock::now();
+    uint64_t paced = 0;
+    CompactionThrottle throttle = [&](size_t bytes) {
+        paced += bytes;
+        if (rate > 0) {
+            auto due = started + std::chrono::microseconds(paced * 1000000 / rate);
+            std::unique_lock lock(cleaner_mutex);
+            cleaner_cv.wait_until(lock, due, [this] { return stop_cleaner.load(); });
+        }
+        return !stop_cleaner.load();
+    };
+
+    uint64_t deleted = 0;
+    uint64_t compacted = 0;
+    // topics are never removed, so the logs outlive this pass
+    topics.for_each([&](const std::string&, Topic& t) {
+        for (auto& p : t.partitions) {
+            if (!p->log || stop_cleaner)
+                continue;
+            if (t.cleanup != CleanupPolicy::Compact)
+                deleted += p->log->apply_retention(retention);
+            if (t.cleanup != CleanupPolicy::Delete)
+                compacted += p->log->compact(throttle);
+        }
+    });
+
+    if (deleted > 0 || compacted > 0)
+        log_info("Log cleaner freed {} bytes by retention and {} bytes by compaction", deleted, compacted);
+}
@@ -4,30 +4,104 @@
 #include <mutex>
 #include <memory>
 #include <optional>
-#include <queue>
 #include <string>
+#include <string_view>
+#include <functional>
+#include <vector>
+#include <thread>
+#include <atomic>
+#include <condition_variable>
 
-#include "disk_handler.h"
+#include "commit_log.h"
+#include "topic_queue.h"
+#include "topic_registry.h"
+#include "waiter.h"
 
-class TopicQueue {
-private:
-    std::mutex mtx;
-    std::queue<std::string> q;
+// %-escapes anything outside [A-Za-z0-9._-] so client supplied names are safe as one path component
+std::string escape_name(std::string_view name);
+// inverse of escape_name; nullopt for a name escape_name would not have produced
+std::optional<std::string> unescape_name(std::string_view escaped);
 
-public:
-    void publish(const std::string& msg);
-    std::optional<std::string> pull();
+// where a publish landed: the partition and the offsets its commit log gave the records
+struct PartitionAppend {
+    uint32_t partition;
+    AppendResult offsets;
+};
+
+// how an append went; offsets are what the partition's commit log gave the records, {0, 0} for a
+// memory-only partition. StorageError: the log did not take the batch and none of it was queued.
+// A record larger than a segment is refused before anything is written, but a write or segment
+// roll failing in the middle of a batch can leave the records before it in the log.
+// QueueFull: a memory-only partition's queue had no room, and the records were not taken.
+enum class AppendStatus : uint8_t { Ok, StorageError, QueueFull };
+
+struct AppendOutcome {
+    AppendStatus status = AppendStatus::Ok;
+    AppendResult offsets{ 0, 0 };
+};
+
+// records of one produce request bound for the same partition; keys is empty for keyless records.
+// A batch the producer compressed is logged as compressed, the messages only feed the queue.
+struct PartitionBatch {
+    uint32_t partition = 0;
+    std::vector<SharedMessage> messages;
+    std::vector<SharedMessage> keys;
+    Codec codec = Codec::None;
+    SharedMessage compressed;
 };
 
 class TopicManager {
 public:
     static TopicManager& get_instance();
 
-    void init_logger(std::shared_ptr<DiskHandler> diskHandler);
-    void publish(const std::string& topic, const std::string& msg);
-    [[nodiscard]] std::optional<std::string> pull(const std::string& topic);
-    [[nodiscard]] bool has_topic(const std::string& topic) const;
+    // without storage, topics are memory-only; topics created implicitly get defaultPartitions and
+    // their logs compress appended records with codec. Topics already on disk are recovered here.
+    // The log cleaner applies retention to topics with the delete policy and compacts the others,
+    // reading and writing at most compactionRate bytes per second (0 for no limit).
+    void init_storage(std::string dataDir, size_t segmentSize, DurabilityPolicy durability = {}, uint32_t defaultPartitions = 1,
+        Codec codec = Codec::None, RetentionPolicy retention = {}, uint64_t compactionRate = 0);
+    [[nodiscard]] const DurabilityPolicy& durability() const { return durability_policy; }
+    // queue capacity of the partitions created from now on; set before init_storage so recovered
+    // topics get it too
+    void set_queue_capacity(size_t capacity);
+    // lock-free lookup of an existing topic
+    [[nodiscard]] Topic* find(std::string_view topic) const { return topics.find(topic); }
+    // false when the topic already exists with another partition count or cleanup policy
+    bool create(std::string_view topic, uint32_t partitions, CleanupPolicy cleanup = CleanupPolicy::Delete);
+    // a topic with logs on disk keeps their partition count and cleanup policy, otherwise it gets
+    // partitions (0 for the default) and cleanup
+    Topic& get_or_create(std::string_view topic, uint32_t partitions = 0, CleanupPolicy cleanup = CleanupPolicy::Delete);
+    // partition count of the topic, created if it does not exist yet
+    uint32_t partition_count(std::string_view topic);
+    // Copies the records once into shared messages and groups them by partition. Without keys the
+    // whole request goes to the next partition round-robin; with keys every record goes to the
+    // partition its key hashes to, and records with an empty key round-robin one by one.
+    std::vector<PartitionBatch> partition_records(Topic& t, const std::vector<std::string_view>& values, const std::vector<std::string_view>& keys = {});
+    // appends to the partition's log, then its queue, from any thread
+    AppendOutcome append(Topic& t, PartitionBatch& batch);
+    // nullopt when the append failed
+    std::optional<PartitionAppend> publish(std::string_view topic, std::string_view msg);
+    // one message from the topic's partitions in turn
+    [[nodiscard]] std::optional<SharedMessage> pull(Topic& t);
+    // partition may be Topic::anyPartition to take from every partition in turn
+    size_t pull_batch(std::string_view topic, uint32_t partition, size_t maxRecords, size_t maxBytes, size_t minBytes, const TopicQueue::MessageSink& sink);
+    size_t pull_batch(Topic& t, uint32_t partition, size_t maxRecords, size_t maxBytes, size_t minBytes, const TopicQueue::MessageSink& sink);
+    [[nodiscard]] bool has_topic(std::string_view topic) const;
+    [[nodiscard]] bool has_storage() const;
+    // non-destructive read from a partition's commit log
+    [[nodiscard]] std::vector<LogRecord> read(std::string_view topic, uint32_t partition, uint64_t offset, size_t maxRecords, size_t maxBytes) const;
+    // first offset of the partition stamped at or after timestamp (ms since epoch), the log's next
+    // offset when every record is older; nullopt when the partition has no log
+    [[nodiscard]] std::optional<uint64_t> offset_for_time(std::string_view topic, uint32_t partition, int64_t timestamp) const;
+    // wakes the waiter on the next publish to any partition (or only the given one);
+    // a topic that does not exist yet notifies its watchers when it is created
+    void watch(std::string_view topic, const std::shared_ptr<Waiter>& waiter, uint32_t partition = Topic::anyPartition);
     void get_topic_list() const;
+    // logs the messages each partition's queue dropped since the last call; called periodically
+    void log_queue_stats();
+    // one log cleaner pass over every partition with a log, as the cleaner thread runs every few
+    // seconds once storage is set up
+    void clean_logs();
 
 private:
     TopicManager();
@@ -35,9 +109,44 @@ private:
     TopicManager(const TopicManager&) = delete;
     TopicManager& operator=(const TopicManager&) = delete;
 
+    // serializes topic creation and guards pending_watchers and the storage settings;
+    // lookups, publishes and pulls on existing topics never take it
     mutable std::mutex mtx;
-    mutable std::mutex disk_mutex;
 
-    std::unordered_map<std::string, TopicQueue> topic_map;
-    std::shared_ptr<DiskHandler> disk_handler = nullptr;
+    TopicRegistry topics;
+    std::unordered_map<std::string, std::vector<std::weak_ptr<Waiter>>, TopicHash, std::equal_to<>> pending_watchers;
+
+    std::string data_dir;
+    size_t log_segment_size = 0;
+    DurabilityPolicy durability_policy;
+    uint32_t default_partitions = 1;
+    size_t queue_capacity = TopicQueue::defaultCapacity;
+    Codec log_codec = Codec::None;
+    RetentionPolicy retention_policy;
+    uint64_t compaction_rate = 0;
+
+    // group commit: producers that need a sync set commit_requested and wake commit_thread
+    std::mutex commit_mutex;
+    std::condition_variable commit_cv;
+    std::atomic<bool> commit_requested{ false };
+    std::atomic<bool> stop_commit{ false };
+    std::jthread commit_thread;
+
+    std::mutex cleaner_mutex;
+    std::condition_variable cleaner_cv;
+    std::atomic<bool> stop_cleaner{ false };
+    // compaction takes one caller at a time
+    std::mutex cleaner_pass_mutex;
+    std::jthread cleaner_thread;
+
+    void recover_topics();
+    uint32_t stored_partitions(std::string_view topic) const;
+    // the policy is kept next to partition 0's segments; topics without the file use delete
+    CleanupPolicy stored_cleanup(std::string_view topic) const;
+    void store_cleanup(std::string_view topic, CleanupPolicy cleanup) const;
+    std::string partition_directory(std::string_view topic, uint32_t partition) const;
+    uint32_t route(Topic& t, std::string_view key) const;
+    void appended(CommitLog& log);
+    void commit_loop();
+    void cleaner_loop();
 };
\ No newline at end of file
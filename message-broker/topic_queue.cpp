@@ -0,0 +1,75 @@
+#include "topic_queue.h"
+
+#include <algorithm>
+
+void TopicQueue::publish(SharedMessage msg) {
+    push(msg);
+    watchers.notify_all();
+}
+
+void TopicQueue::publish_batch(std::vector<SharedMessage>& msgs) {
+    for (SharedMessage& msg : msgs)
+        push(msg);
+    watchers.notify_all();
+}
+
+bool TopicQueue::try_publish_batch(std::vector<SharedMessage>& msgs) {
+    if (ring.capacity() - std::min(ring.size_approx(), ring.capacity()) < msgs.size())
+        return false;
+
+    size_t pushed = 0;
+    for (SharedMessage& msg : msgs) {
+        size_t size = msg.size();
+        if (!ring.try_push(msg))
+            break;
+        queuedBytes.fetch_add(size, std::memory_order_relaxed);
+        ++pushed;
+    }
+    if (pushed > 0)
+        watchers.notify_all();
+    return pushed == msgs.size();
+}
+
+void TopicQueue::push(SharedMessage& msg) {
+    size_t size = msg.size();
+    while (!ring.try_push(msg)) {
+        auto discard = [this](SharedMessage&& old) { queuedBytes.fetch_sub(old.size(), std::memory_order_relaxed); };
+        if (ring.try_pop(discard) == MessageRing::PopResult::Ok)
+            droppedCount.fetch_add(1, std::memory_order_relaxed);
+    }
+    queuedBytes.fetch_add(size, std::memory_order_relaxed);
+}
+
+std::optional<SharedMessage> TopicQueue::pull() {
+    std::optional<SharedMessage> msg;
+    ring.try_pop([&](SharedMessage&& m) {
+        queuedBytes.fetch_sub(m.size(), std::memory_order_relaxed);
+        msg.emplace(std::move(m));
+    });
+    return msg;
+}
+
+size_t TopicQueue::pull_batch(size_t maxRecords, size_t maxBytes, size_t minBytes, const MessageSink& sink) {
+    if (queuedBytes.load(std::memory_order_relaxed) < minBytes)
+        return 0;
+
+    size_t count = 0;
+    size_t bytes = 0;
+    auto take = [&](SharedMessage&& m) {
+        bytes += m.size();
+        ++count;
+        sink(std::move(m));
+    };
+
+    while (count < maxRecords) {
+        size_t room = count == 0 ? SIZE_MAX : (maxBytes > bytes ? maxBytes - bytes : 0);
+        if (ring.try_pop(take, room) != MessageRing::PopResult::Ok)
+            break;
+    }
+    queuedBytes.fetch_sub(bytes, std::memory_order_relaxed);
+    return count;
+}
+
+void TopicQueue::watch(const std::shared_ptr<Waiter>& waiter) {
+    watchers.watch(waiter);
+}
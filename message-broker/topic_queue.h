@@ -0,0 +1,51 @@
+#pragma once
+
+#include <string>
+#include <string_view>
+#include <vector>
+#include <optional>
+#include <memory>
+#include <atomic>
+#include <functional>
+#include <cstddef>
+#include <cstdint>
+
+#include "message_ring.h"
+#include "waiter.h"
+
+// In-memory delivery queue of a partition on a bounded lock-free ring of shared messages. When
+// the partition has a commit log, the log holds the full history: publish drops the oldest message
+// to make room instead of blocking the producer, and counts the drop. A memory-only partition has
+// nothing behind its queue, so its producers use try_publish_batch and are refused instead.
+class TopicQueue {
+public:
+    static constexpr size_t defaultCapacity = 4096;
+
+    using MessageSink = std::function<void(SharedMessage&&)>;
+
+    explicit TopicQueue(size_t capacity = defaultCapacity) : ring(capacity) {}
+
+    void publish(SharedMessage msg);
+    void publish_batch(std::vector<SharedMessage>& msgs);
+    // never drops: false when the ring has no room for all of msgs, then none are queued unless
+    // another producer took the room in between, and the ones queued before that stay
+    bool try_publish_batch(std::vector<SharedMessage>& msgs);
+    std::optional<SharedMessage> pull();
+    // hands up to maxRecords / maxBytes to sink and returns the count; nothing until at least
+    // minBytes are queued, and always one record if any qualifies
+    size_t pull_batch(size_t maxRecords, size_t maxBytes, size_t minBytes, const MessageSink& sink);
+    // one-shot: the next publish notifies the waiter and drops it, so it has to watch again
+    void watch(const std::shared_ptr<Waiter>& waiter);
+
+    uint64_t dropped() const { return droppedCount.load(std::memory_order_relaxed); }
+    size_t capacity() const { return ring.capacity(); }
+
+private:
+    MessageRing ring;
+    std::atomic<size_t> queuedBytes{ 0 };
+    std::atomic<uint64_t> droppedCount{ 0 };
+
+    WaiterList watchers;
+
+    void push(SharedMessage& msg);
+};
@@ -0,0 +1,85 @@
+#include "topic_registry.h"
+
+namespace {
+    constexpr size_t initialBuckets = 64;
+}
+
+std::string_view cleanup_policy_name(CleanupPolicy policy) {
+    switch (policy) {
+    case CleanupPolicy::Compact: return "compact";
+    case CleanupPolicy::CompactDelete: return "compact,delete";
+    default: return "delete";
+    }
+}
+
+std::optional<CleanupPolicy> parse_cleanup_policy(std::string_view name) {
+    for (CleanupPolicy policy : { CleanupPolicy::Delete, CleanupPolicy::Compact, CleanupPolicy::CompactDelete }) {
+        if (cleanup_policy_name(policy) == name)
+            return policy;
+    }
+    return std::nullopt;
+}
+
+TopicRegistry::Table::Table(size_t bucketCount)
+    : mask(bucketCount - 1), buckets(std::make_unique<std::atomic<Link*>[]>(bucketCount)) {
+    for (size_t i = 0; i < bucketCount; ++i)
+        buckets[i].store(nullptr, std::memory_order_relaxed);
+}
+
+TopicRegistry::TopicRegistry() {
+    tables.push_back(std::make_unique<Table>(initialBuckets));
+    current.store(tables.back().get(), std::memory_order_release);
+}
+
+TopicRegistry::~TopicRegistry() = default;
+
+Topic* TopicRegistry::find(std::string_view name) const {
+    size_t hash = TopicHash{}(name);
+    const Table* table = current.load(std::memory_order_acquire);
+
+    for (const Link* l = table->buckets[hash & table->mask].load(std::memory_order_acquire); l; l = l->next) {
+        if (l->entry->hash == hash && l->entry->name == name)
+            return &l->entry->topic;
+    }
+    return nullptr;
+}
+
+Topic& TopicRegistry::insert(std::string_view name, const std::function<void(Topic&)>& init) {
+    if (Topic* existing = find(name))
+        return *existing;
+
+    Entry& entry = entries.emplace_back();
+    entry.name = std::string(name);
+    entry.hash = TopicHash{}(name);
+    init(entry.topic);
+
+    Table* table = current.load(std::memory_order_relaxed);
+    if (entries.size() > table->mask + 1) {
+        // grow at load factor 1: rehash everything into a table twice the size, then swap it in
+        auto grown = std::make_unique<Table>((table->mask + 1) * 2);
+        for (Entry& e : entries)
+            link(*grown, e);
+        table = grown.get();
+        tables.push_back(std::move(grown));
+        current.store(table, std::memory_order_release);
+    }
+    else {
+        link(*table, entry);
+    }
+    return entry.topic;
+}
+
+// publishes with release so a reader that finds the link also sees the entry
+void TopicRegistry::link(Table& table, Entry& entry) {
+    std::atomic<Link*>& bucket = table.buckets[entry.hash & table.mask];
+    Link& l = table.links.emplace_back(Link{ &entry, bucket.load(std::memory_order_relaxed) });
+    bucket.store(&l, std::memory_order_release);
+}
+
+void TopicRegistry::for_each(const std::function<void(const std::string&, Topic&)>& visit) const {
+    const Table* table = current.load(std::memory_order_acquire);
+    for (size_t i = 0; i <= table->mask; ++i) {
+        for (const Link* l = table->buckets[i].load(std::memory_order_acquire); l; l = l->next)
+            visit(l->entry->name, l->entry->topic);
+    }
+}
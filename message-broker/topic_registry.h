@@ -0,0 +1,104 @@
+#pragma once
+
+#include <atomic>
+#include <deque>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <vector>
+#include <functional>
+#include <optional>
+#include <cstddef>
+#include <cstdint>
+
+#include "commit_log.h"
+#include "topic_queue.h"
+
+// What the log cleaner does with a topic's sealed segments; the values are sent in CREATE_TOPIC.
+enum class CleanupPolicy : uint8_t {
+    // segments past the retention time or size are deleted
+    Delete = 0,
+    // records whose key has a later record are dropped, so the log keeps the latest value per key
+    Compact = 1,
+    CompactDelete = 2,
+};
+
+// "delete", "compact" and "compact,delete"
+std::string_view cleanup_policy_name(CleanupPolicy policy);
+std::optional<CleanupPolicy> parse_cleanup_policy(std::string_view name);
+
+// one ordered stream of a topic with its own queue and commit log
+struct Partition {
+    explicit Partition(size_t queueCapacity = TopicQueue::defaultCapacity) : queue(queueCapacity) {}
+
+    TopicQueue queue;
+    std::unique_ptr<CommitLog> log;
+    // queue drops already logged by TopicManager::log_queue_stats
+    uint64_t reportedDrops = 0;
+};
+
+// A topic is split into partitions when it is created and keeps that count. Records with the same
+// key always land in the same partition, so order is kept per key while the partitions' queues
+// and logs are written in parallel.
+struct Topic {
+    static constexpr uint32_t anyPartition = UINT32_MAX;
+
+    std::vector<std::unique_ptr<Partition>> partitions;
+    CleanupPolicy cleanup = CleanupPolicy::Delete;
+    // round robin for records without a key
+    std::atomic<uint32_t> nextProduce{ 0 };
+    // partition a fetch over all of them starts at, so no partition starves the others
+    std::atomic<uint32_t> nextFetch{ 0 };
+
+    uint32_t partition_count() const { return static_cast<uint32_t>(partitions.size()); }
+    Partition* partition(uint32_t index) const { return index < partitions.size() ? partitions[index].get() : nullptr; }
+};
+
+struct TopicHash {
+    using is_transparent = void;
+    size_t operator()(std::string_view topic) const { return std::hash<std::string_view>{}(topic); }
+};
+
+// Read-mostly topic registry. find() walks an immutable bucket table without taking a lock.
+// Inserts are rare (topic creation) and must be serialized by the caller. Growing the table
+// publishes a new one; retired tables stay alive until the registry is destroyed, so readers
+// never touch freed memory. Topics are never removed.
+class TopicRegistry {
+public:
+    TopicRegistry();
+    ~TopicRegistry();
+
+    TopicRegistry(const TopicRegistry&) = delete;
+    TopicRegistry& operator=(const TopicRegistry&) = delete;
+
+    Topic* find(std::string_view name) const;
+    // init runs before the topic becomes visible to find()
+    Topic& insert(std::string_view name, const std::function<void(Topic&)>& init);
+    void for_each(const std::function<void(const std::string&, Topic&)>& visit) const;
+
+private:
+    struct Entry {
+        std::string name;
+        size_t hash;
+        Topic topic;
+    };
+
+    struct Link {
+        Entry* entry;
+        Link* next;
+    };
+
+    struct Table {
+        explicit Table(size_t bucketCount);
+
+        size_t mask;
+        std::unique_ptr<std::atomic<Link*>[]> buckets;
+        std::deque<Link> links;
+    };
+
+    std::atomic<Table*> current;
+    std::vector<std::unique_ptr<Table>> tables;
+    std::deque<Entry> entries;
+
+    static void link(Table& table, Entry& entry);
+};
@@ -0,0 +1,356 @@
+#include "uring_engine.h"
+#include "command_handler.h"
+
+#ifdef BROKER_HAS_IO_URING
+
+#include <iostream>
+#include <cstdlib>
+#include <cstdio>
+#include <cerrno>
+#include <sys/eventfd.h>
+#include <sys/utsname.h>
+
+namespace {
+    constexpr unsigned queueDepth = 4096;
+    constexpr unsigned maxConnections = 4096;
+    constexpr unsigned bufferCount = 4096;
+    constexpr size_t bufferSize = 4096;
+    constexpr int bufferGroup = 0;
+
+    // multishot recv with provided buffer rings needs 6.0+
+    bool kernel_at_least(int major, int minor) {
+        utsname u{};
+        if (uname(&u) != 0) return false;
+        int kmajor = 0, kminor = 0;
+        if (std::sscanf(u.release, "%d.%d", &kmajor, &kminor) != 2) return false;
+        return kmajor > major || (kmajor == major && kminor >= minor);
+    }
+}
+
+UringEngine::~UringEngine() {
+    for (Slot& slot : slots) {
+        if (slot.context)
+            destroy_context(slot.context);
+    }
+    if (ringReady) {
+        if (bufRing)
+            io_uring_free_buf_ring(&ring, bufRing, bufferCount, bufferGroup);
+        io_uring_queue_exit(&ring);
+    }
+    std::free(bufSlab);
+    if (listenSocket != invalid_socket) close_socket(listenSocket);
+    if (wakeFd != -1) ::close(wakeFd);
+}
+
+bool UringEngine::supported() {
+    if (!kernel_at_least(6, 0))
+        return false;
+
+    io_uring probeRing{};
+    if (io_uring_queue_init(8, &probeRing, 0) != 0)
+        return false;
+
+    bool ok = false;
+    if (io_uring_probe* probe = io_uring_get_probe_ring(&probeRing)) {
+        ok = io_uring_opcode_supported(probe, IORING_OP_ACCEPT) &&
+            io_uring_opcode_supported(probe, IORING_OP_RECV) &&
+            io_uring_opcode_supported(probe, IORING_OP_SEND) &&
+            io_uring_opcode_supported(probe, IORING_OP_CLOSE);
+        io_uring_free_probe(probe);
+    }
+    io_uring_queue_exit(&probeRing);
+    return ok;
+}
+
+bool UringEngine::init(uint16_t port) {
+    io_uring_params params{};
+    params.flags = IORING_SETUP_SINGLE_ISSUER | IORING_SETUP_COOP_TASKRUN;
+    params.cq_entries = queueDepth * 4;
+    params.flags |= IORING_SETUP_CQSIZE;
+
+    int ret = io_uring_queue_init_params(queueDepth, &ring, &params);
+    if (ret < 0) {
+        std::lock_guard<std::mutex> lock(cout_mutex);
+        std::cerr << "[error] io_uring_queue_init_params: " << -ret << std::endl;
+        return false;
+    }
+    ringReady = true;
+
+    // fixed file table: accepted sockets live only as registered slots
+    ret = io_uring_register_files_sparse(&ring, maxConnections);
+    if (ret < 0) {
+        std::lock_guard<std::mutex> lock(cout_mutex);
+        std::cerr << "[error] io_uring_register_files_sparse: " << -ret << std::endl;
+        return false;
+    }
+    slots.resize(maxConnections);
+
+    // registered provided-buffer ring shared by every multishot recv
+    if (posix_memalign(reinterpret_cast<void**>(&bufSlab), 4096, bufferCount * bufferSize) != 0) {
+        bufSlab = nullptr;
+        return false;
+    }
+    bufRing = io_uring_setup_buf_ring(&ring, bufferCount, bufferGroup, 0, &ret);
+    if (!bufRing) {
+        std::lock_guard<std::mutex> lock(cout_mutex);
+        std::cerr << "[error] io_uring_setup_buf_ring: " << -ret << std::endl;
+        return false;
+    }
+    for (unsigned i = 0; i < bufferCount; ++i) {
+        io_uring_buf_ring_add(bufRing, bufSlab + i * bufferSize, bufferSize, static_cast<unsigned short>(i),
+            io_uring_buf_ring_mask(bufferCount), static_cast<int>(i));
+    }
+    io_uring_buf_ring_advance(bufRing, bufferCount);
+
+    wakeFd = eventfd(0, EFD_CLOEXEC);
+    if (wakeFd == -1)
+        return false;
+
+    listenSocket = open_listen_socket(port, false, shardCount > 1);
+    if (listenSocket == invalid_socket)
+        return false;
+
+    // accepted sockets exist only as fixed-file slots, out of setsockopt's reach (the socket
+    // command for it needs kernel 6.7); Linux copies TCP_NODELAY from the listening socket into
+    // every connection it accepts
+    int nodelay = 1;
+    if (setsockopt(listenSocket, IPPROTO_TCP, TCP_NODELAY, &nodelay, sizeof(nodelay)) != 0) {
+        std::lock_guard<std::mutex> lock(cout_mutex);
+        std::cerr << "[error] TCP_NODELAY: " << errno << std::endl;
+    }
+
+    arm_accept();
+    arm_wake();
+    return true;
+}
+
+void UringEngine::run() {
+    enter_shard();
+
+    while (running) {
+        service_waiters();
+
+        int ret;
+        int timeoutMs = next_timeout_ms();
+        if (timeoutMs < 0) {
+            ret = io_uring_submit_and_wait(&ring, 1);
+        }
+        else {
+            __kernel_timespec ts{};
+            ts.tv_sec = timeoutMs / 1000;
+            ts.tv_nsec = static_cast<long long>(timeoutMs % 1000) * 1000000;
+            io_uring_cqe* first = nullptr;
+            ret = io_uring_submit_and_wait_timeout(&ring, &first, 1, &ts, nullptr);
+            if (ret == -ETIME)
+                ret = 0;
+        }
+        if (ret < 0 && ret != -EINTR) {
+            std::lock_guard<std::mutex> lock(cout_mutex);
+            std::cerr << "[error] io_uring_submit_and_wait: " << -ret << std::endl;
+            break;
+        }
+
+        unsigned head;
+        unsigned count = 0;
+        io_uring_cqe* cqe;
+        io_uring_for_each_cqe(&ring, head, cqe) {
+            handle_cqe(cqe);
+            ++count;
+        }
+        io_uring_cq_advance(&ring, count);
+    }
+}
+
+void UringEngine::stop() {
+    if (!running.exchange(false))
+        return;
+    signal();
+}
+
+void UringEngine::signal() {
+    uint64_t one = 1;
+    if (wakeFd != -1)
+        (void)::write(wakeFd, &one, sizeof(one));
+}
+
+// fixed-file slot index doubles as the context's socket
+void UringEngine::deliver(ClientContext* context, PooledString out) {
+    queue_response(static_cast<uint32_t>(context->sock), std::move(out));
+}
+
+uint64_t UringEngine::encode(Op op, uint32_t slot, uint32_t generation) {
+    return (static_cast<uint64_t>(generation) << 32) | (static_cast<uint64_t>(slot) << 8) | static_cast<uint8_t>(op);
+}
+
+io_uring_sqe* UringEngine::get_sqe() {
+    io_uring_sqe* sqe = io_uring_get_sqe(&ring);
+    while (!sqe) {
+        io_uring_submit(&ring);
+        sqe = io_uring_get_sqe(&ring);
+    }
+    return sqe;
+}
+
+void UringEngine::arm_accept() {
+    io_uring_sqe* sqe = get_sqe();
+    io_uring_prep_multishot_accept_direct(sqe, listenSocket, nullptr, nullptr, 0);
+    io_uring_sqe_set_data64(sqe, encode(Op::Accept, 0, 0));
+}
+
+void UringEngine::arm_recv(uint32_t slot) {
+    io_uring_sqe* sqe = get_sqe();
+    io_uring_prep_recv_multishot(sqe, static_cast<int>(slot), nullptr, 0, 0);
+    sqe->flags |= IOSQE_FIXED_FILE | IOSQE_BUFFER_SELECT;
+    sqe->buf_group = bufferGroup;
+    io_uring_sqe_set_data64(sqe, encode(Op::Recv, slot, slots[slot].generation));
+}
+
+void UringEngine::arm_wake() {
+    io_uring_sqe* sqe = get_sqe();
+    io_uring_prep_read(sqe, wakeFd, &wakeValue, sizeof(wakeValue), 0);
+    io_uring_sqe_set_data64(sqe, encode(Op::Wake, 0, 0));
+}
+
+// one sendmsg in flight per connection, covering the leading chunks of its queue
+void UringEngine::submit_send(uint32_t slot) {
+    Slot& s = slots[slot];
+    OutboundQueue& queue = s.context->send_queue;
+
+    // io_uring has no sendfile and splice would need a pipe per connection, so a file range is
+    // sent from the segment's read-only mapping; it still never goes through a broker buffer
+    OutboundSpan spans[maxSendSpans];
+    size_t count = queue.gather(spans, maxSendSpans, true);
+    for (size_t i = 0; i < count; ++i)
+        s.iov[i] = iovec{ const_cast<char*>(spans[i].data), spans[i].size };
+    queue.pin(count);
+
+    s.msg = msghdr{};
+    s.msg.msg_iov = s.iov;
+    s.msg.msg_iovlen = count;
+    io_uring_sqe* sqe = get_sqe();
+    io_uring_prep_sendmsg(sqe, static_cast<int>(slot), &s.msg, MSG_NOSIGNAL);
+    sqe->flags |= IOSQE_FIXED_FILE;
+    io_uring_sqe_set_data64(sqe, encode(Op::Send, slot, s.generation));
+    s.context->send_pending = true;
+}
+
+void UringEngine::queue_response(uint32_t slot, PooledString response) {
+    Slot& s = slots[slot];
+    s.context->send_queue.append(std::move(response));
+    if (s.context->send_pending || s.context->send_queue.empty())
+        return;
+
+    submit_send(slot);
+}
+
+void UringEngine::handle_cqe(const io_uring_cqe* cqe) {
+    uint64_t data = io_uring_cqe_get_data64(cqe);
+    Op op = static_cast<Op>(data & 0xff);
+    uint32_t slot = static_cast<uint32_t>((data >> 8) & 0xffffff);
+    uint32_t generation = static_cast<uint32_t>(data >> 32);
+    bool more = (cqe->flags & IORING_CQE_F_MORE) != 0;
+
+    switch (op) {
+    case Op::Accept: {
+        if (cqe->res >= 0) {
+            uint32_t index = static_cast<uint32_t>(cqe->res);
+            Slot& s = slots[index];
+            s.retired.clear();
+            s.context = create_context(static_cast<socket_t>(index));
+            arm_recv(index);
+        }
+        else {
+            std::lock_guard<std::mutex> lock(cout_mutex);
+            std::cerr << "[error] accept: " << -cqe->res << std::endl;
+        }
+        if (!more && running)
+            arm_accept();
+        break;
+    }
+    case Op::Recv: {
+        Slot& s = slots[slot];
+        if (cqe->flags & IORING_CQE_F_BUFFER) {
+            uint16_t bid = static_cast<uint16_t>(cqe->flags >> IORING_CQE_BUFFER_SHIFT);
+            bool ok = true;
+            if (s.context && s.generation == generation && cqe->res > 0) {
+                PooledString response;
+                ok = dispatch(s.context,
+                    std::string_view(bufSlab + bid * bufferSize, static_cast<size_t>(cqe->res)), response);
+                queue_response(slot, std::move(response));
+            }
+            recycle_buffer(bid);
+            if (!ok) {
+                close_slot(slot);
+                break;
+            }
+        }
+
+        if (!s.context || s.generation != generation)
+            break;
+
+        if (cqe->res == 0 || (cqe->res < 0 && cqe->res != -ENOBUFS)) {
+            close_slot(slot);
+        }
+        else if (!more) {
+            arm_recv(slot);
+        }
+        break;
+    }
+    case Op::Send: {
+        Slot& s = slots[slot];
+        if (!s.context || s.generation != generation)
+            break;
+
+        if (cqe->res < 0) {
+            std::lock_guard<std::mutex> lock(cout_mutex);
+            std::cerr << "[" << slot << " error] send: " << -cqe->res << std::endl;
+            s.context->send_pending = false;
+            close_slot(slot);
+            break;
+        }
+
+        s.context->send_queue.consume(static_cast<size_t>(cqe->res));
+        if (s.context->send_queue.empty()) {
+            s.context->send_pending = false;
+            on_send_drained(s.context);
+        }
+        else {
+            submit_send(slot);
+        }
+        break;
+    }
+    case Op::Close:
+        break;
+    case Op::Wake:
+        if (running)
+            arm_wake();
+        break;
+    }
+}
+
+void UringEngine::recycle_buffer(uint16_t bid) {
+    io_uring_buf_ring_add(bufRing, bufSlab + bid * bufferSize, bufferSize, bid,
+        io_uring_buf_ring_mask(bufferCount), 0);
+    io_uring_buf_ring_advance(bufRing, 1);
+}
+
+void UringEngine::close_slot(uint32_t slot) {
+    Slot& s = slots[slot];
+    {
+        std::lock_guard<std::mutex> lock(cout_mutex);
+        std::cerr << "[" << slot << "] connection closed." << std::endl;
+    }
+
+    // the kernel may still be reading the in-flight chunk; moving the deque keeps its elements in place
+    if (s.context->send_pending)
+        s.retired = std::move(s.context->send_queue);
+    destroy_context(s.context);
+    s.context = nullptr;
+    s.generation++;
+
+    io_uring_sqe* sqe = get_sqe();
+    io_uring_prep_close_direct(sqe, slot);
+    io_uring_sqe_set_data64(sqe, encode(Op::Close, slot, s.generation));
+}
+
+#endif
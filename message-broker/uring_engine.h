@@ -0,0 +1,66 @@
+#pragma once
+
+// the build defines BROKER_USE_IO_URING when it found liburing to link (CMakeLists.txt)
+#if defined(__linux__) && defined(BROKER_USE_IO_URING)
+#define BROKER_HAS_IO_URING
+
+#include <liburing.h>
+#include <vector>
+#include <sys/uio.h>
+
+#include "net_engine.h"
+
+class UringEngine : public NetEngine {
+public:
+    using NetEngine::NetEngine;
+    ~UringEngine() override;
+
+    static bool supported();
+
+    bool init(uint16_t port) override;
+    void run() override;
+    void stop() override;
+    const char* name() const override { return "uring"; }
+
+protected:
+    void signal() override;
+    void deliver(ClientContext* context, PooledString out) override;
+
+private:
+    enum class Op : uint8_t { Accept = 1, Recv, Send, Close, Wake };
+
+    // queued chunks written by one sendmsg
+    static constexpr size_t maxSendSpans = 16;
+
+    struct Slot {
+        ClientContext* context = nullptr;
+        // gather list of the in-flight sendmsg, read by the kernel until it completes
+        iovec iov[maxSendSpans];
+        msghdr msg{};
+        // queue of a closed connection whose send was still in flight, kept until the slot is reused
+        OutboundQueue retired;
+        uint32_t generation = 0;
+    };
+
+    io_uring ring{};
+    bool ringReady = false;
+    io_uring_buf_ring* bufRing = nullptr;
+    char* bufSlab = nullptr;
+    int wakeFd = -1;
+    uint64_t wakeValue = 0;
+    socket_t listenSocket = invalid_socket;
+    std::vector<Slot> slots;
+
+    static uint64_t encode(Op op, uint32_t slot, uint32_t generation);
+    io_uring_sqe* get_sqe();
+    void arm_accept();
+    void arm_recv(uint32_t slot);
+    void arm_wake();
+    void submit_send(uint32_t slot);
+    void queue_response(uint32_t slot, PooledString response);
+    void handle_cqe(const io_uring_cqe* cqe);
+    void recycle_buffer(uint16_t bid);
+    void close_slot(uint32_t slot);
+};
+
+#endif
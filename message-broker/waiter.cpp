@@ -0,0 +1,40 @@
+#include "waiter.h"
+
+void WaiterList::watch(const std::shared_ptr<Waiter>& waiter) {
+    {
+        std::lock_guard<std::mutex> lock(mtx);
+        std::erase_if(waiters, [](const std::weak_ptr<Waiter>& w) { return w.expired(); });
+        bool present = false;
+        for (const auto& w : waiters) {
+            if (!w.owner_before(waiter) && !waiter.owner_before(w)) {
+                present = true;
+                break;
+            }
+        }
+        if (!present)
+            waiters.push_back(waiter);
+        watched.store(true, std::memory_order_relaxed);
+    }
+    // pairs with the fence in notify_all: either the notifier sees the registration or the
+    // watcher's next look at the watched state sees the change
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+}
+
+// waiters are notified outside the lock so they can act right away
+void WaiterList::notify_all() {
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (!watched.load(std::memory_order_relaxed))
+        return;
+
+    std::vector<std::weak_ptr<Waiter>> woken;
+    {
+        std::lock_guard<std::mutex> lock(mtx);
+        woken.swap(waiters);
+        watched.store(false, std::memory_order_relaxed);
+    }
+
+    for (const auto& w : woken) {
+        if (auto waiter = w.lock())
+            waiter->notify();
+    }
+}
@@ -0,0 +1,27 @@
+#pragma once
+
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+// woken by TopicQueue when a watched topic gets messages; implemented by the network engines
+class Waiter {
+public:
+    virtual ~Waiter() = default;
+    // called from publishing threads, must not block
+    virtual void notify() = 0;
+};
+
+// One-shot waiter registrations: notify_all wakes and drops everyone watching, so a waiter that
+// still cares has to watch again. notify_all is a fence and a flag check when nobody watches.
+class WaiterList {
+public:
+    void watch(const std::shared_ptr<Waiter>& waiter);
+    void notify_all();
+
+private:
+    std::mutex mtx;
+    std::vector<std::weak_ptr<Waiter>> waiters;
+    std::atomic<bool> watched{ false };
+};